@@ -0,0 +1,79 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2PlanningService.h"
+
+// STD includes
+#include <cstdlib>
+
+//-----------------------------------------------------------------------------
+// Headless LITTPlanV2 planning service
+// Usage: LITTPlanV2PlanningServer [--threads N] [--max-pending N] [serverName]
+int main(int argc, char* argv[])
+{
+  QCoreApplication app(argc, argv);
+  QTextStream err(stderr);
+
+  QString serverName("LITTPlanV2PlanningService");
+  int threads = 0;
+  int maximumPendingRequests = 0;
+  QStringList arguments = app.arguments();
+  for (int i = 1; i < arguments.count(); ++i)
+    {
+    if (arguments[i] == "--threads" && i + 1 < arguments.count())
+      {
+      threads = arguments[++i].toInt();
+      }
+    else if (arguments[i] == "--max-pending" && i + 1 < arguments.count())
+      {
+      maximumPendingRequests = arguments[++i].toInt();
+      }
+    else if (arguments[i].startsWith("-"))
+      {
+      err << "Usage: " << arguments[0]
+          << " [--threads N] [--max-pending N] [serverName]" << endl;
+      return EXIT_FAILURE;
+      }
+    else
+      {
+      serverName = arguments[i];
+      }
+    }
+
+  qSlicerLITTPlanV2PlanningService service;
+  if (threads > 0)
+    {
+    service.setMaximumThreadCount(threads);
+    }
+  if (maximumPendingRequests > 0)
+    {
+    service.setMaximumPendingRequests(maximumPendingRequests);
+    }
+  if (!service.listen(serverName))
+    {
+    return EXIT_FAILURE;
+    }
+  err << "Planning service listening on " << service.serverName()
+      << " with " << service.maximumThreadCount() << " threads" << endl;
+  return app.exec();
+}
@@ -0,0 +1,106 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2Module.h"
+#include "qSlicerLITTPlanV2ModuleWidget.h"
+#include "qSlicerLITTPlanV2SessionLog.h"
+
+// MRML includes
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkNew.h>
+
+// STD includes
+#include <cstdlib>
+
+//-----------------------------------------------------------------------------
+// Replay a recorded planning session as fast as possible, report the
+// latencies of the events and check the final plan bit for bit. The scene
+// must be in the state the recording started from.
+// Usage: LITTPlanV2SessionReplay [scene.mrml] session.lpl
+// The scene defaults to the one the session was recorded on.
+// The session is replayed by the module widget, which needs a display even
+// though it is never shown: on a headless machine, run the tool under a
+// virtual X server, e.g. xvfb-run LITTPlanV2SessionReplay session.lpl
+int main(int argc, char* argv[])
+{
+  QApplication app(argc, argv);
+  QTextStream out(stdout);
+  QTextStream err(stderr);
+
+  QStringList arguments = app.arguments();
+  if (arguments.count() < 2 || arguments.count() > 3)
+    {
+    err << "Usage: " << arguments[0] << " [scene.mrml] session.lpl" << endl;
+    return EXIT_FAILURE;
+    }
+  qSlicerLITTPlanV2SessionLog log;
+  QString errorString;
+  if (!log.load(arguments.last(), &errorString))
+    {
+    err << "Can't read " << arguments.last() << ": " << errorString << endl;
+    return EXIT_FAILURE;
+    }
+  QString sceneURL = arguments.count() == 3 ? arguments[1] : log.sceneURL();
+
+  vtkNew<vtkMRMLScene> scene;
+  if (!sceneURL.isEmpty())
+    {
+    scene->SetURL(sceneURL.toLatin1());
+    if (!scene->Connect())
+      {
+      err << "Can't load scene " << sceneURL << endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  qSlicerLITTPlanV2Module module;
+  module.setMRMLScene(scene.GetPointer());
+  module.logic();
+  qSlicerLITTPlanV2ModuleWidget* widget =
+    dynamic_cast<qSlicerLITTPlanV2ModuleWidget*>(module.widgetRepresentation());
+  if (!widget)
+    {
+    err << "No module widget" << endl;
+    return EXIT_FAILURE;
+    }
+
+  QVector<double> latencies;
+  QStringList differences;
+  bool identical = widget->replaySession(log, &latencies, &differences);
+  out << log.events().count() << " events replayed" << endl
+      << qSlicerLITTPlanV2SessionLog::latencyReport(log.events(), latencies);
+  if (!identical)
+    {
+    err << "Replay differs from the recording:" << endl;
+    foreach(const QString& difference, differences)
+      {
+      err << "  " << difference << endl;
+      }
+    return EXIT_FAILURE;
+    }
+  out << "Final state is bit-identical to the recording" << endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2CoordinateReferenceEngine.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+//----------------------------------------------------------------------------
+bool equal(vtkMatrix4x4* a, vtkMatrix4x4* b)
+{
+  for (int i = 0; i < 4; ++i)
+    {
+    for (int j = 0; j < 4; ++j)
+      {
+      if (fabs(a->GetElement(i, j) - b->GetElement(i, j)) > 1e-9)
+        {
+        return false;
+        }
+      }
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void setPose(vtkMRMLLinearTransformNode* node, double angle, double x)
+{
+  vtkNew<vtkTransform> transform;
+  transform->Translate(x, 2. * x, -x);
+  transform->RotateWXYZ(angle, 1., 2., 3.);
+  node->GetMatrixTransformToParent()->DeepCopy(transform->GetMatrix());
+}
+}
+
+//----------------------------------------------------------------------------
+int qSlicerLITTPlanV2CoordinateReferenceEngineTest1(int vtkNotUsed(argc),
+                                                    char * vtkNotUsed(argv)[])
+{
+  typedef qSlicerLITTPlanV2CoordinateReferenceEngine Engine;
+
+  // grandParent <- parent <- node, tracker at the top level
+  vtkNew<vtkMRMLScene> scene;
+  vtkNew<vtkMRMLLinearTransformNode> grandParent;
+  vtkNew<vtkMRMLLinearTransformNode> parent;
+  vtkNew<vtkMRMLLinearTransformNode> node;
+  vtkNew<vtkMRMLLinearTransformNode> tracker;
+  scene->AddNode(grandParent.GetPointer());
+  scene->AddNode(parent.GetPointer());
+  scene->AddNode(node.GetPointer());
+  scene->AddNode(tracker.GetPointer());
+  parent->SetAndObserveTransformNodeID(grandParent->GetID());
+  node->SetAndObserveTransformNodeID(parent->GetID());
+  setPose(grandParent.GetPointer(), 30., 10.);
+  setPose(parent.GetPointer(), -45., 5.);
+  setPose(node.GetPointer(), 10., -3.);
+  setPose(tracker.GetPointer(), 90., 100.);
+
+  Engine engine;
+  vtkNew<vtkMatrix4x4> matrix;
+  vtkNew<vtkMatrix4x4> expected;
+  if (!engine.parentToWorld(node.GetPointer(), matrix.GetPointer()))
+    {
+    std::cerr << "Line " << __LINE__ << " - No parent to world" << std::endl;
+    return EXIT_FAILURE;
+    }
+  parent->GetMatrixTransformToWorld(expected.GetPointer());
+  if (!equal(matrix.GetPointer(), expected.GetPointer()) ||
+      engine.numberOfCachedNodes() != 2)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong parent to world" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Modifying an ancestor invalidates the cache
+  setPose(grandParent.GetPointer(), 60., -20.);
+  if (engine.numberOfCachedNodes() != 0)
+    {
+    std::cerr << "Line " << __LINE__ << " - Cache not invalidated: "
+              << engine.numberOfCachedNodes() << std::endl;
+    return EXIT_FAILURE;
+    }
+  engine.worldToParent(node.GetPointer(), matrix.GetPointer());
+  parent->GetMatrixTransformToWorld(expected.GetPointer());
+  expected->Invert();
+  if (!equal(matrix.GetPointer(), expected.GetPointer()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong world to parent" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Reparenting too
+  parent->SetAndObserveTransformNodeID(0);
+  engine.parentToWorld(node.GetPointer(), matrix.GetPointer());
+  expected->DeepCopy(parent->GetMatrixTransformToParent());
+  if (!equal(matrix.GetPointer(), expected.GetPointer()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong parent after reparenting"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Transform expressed in the tracker: R^-1.P.T.P^-1.R
+  if (engine.isReferenceAvailable(Engine::Tracker) ||
+      engine.transformInReference(node.GetPointer(), Engine::Tracker,
+                                  matrix.GetPointer()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Tracker without node" << std::endl;
+    return EXIT_FAILURE;
+    }
+  engine.setReferenceNode(Engine::Tracker, tracker.GetPointer());
+  engine.transformInReference(node.GetPointer(), Engine::Tracker,
+                              matrix.GetPointer());
+  vtkNew<vtkMatrix4x4> parentToWorld;
+  parent->GetMatrixTransformToWorld(parentToWorld.GetPointer());
+  vtkNew<vtkMatrix4x4> worldToParent;
+  vtkMatrix4x4::Invert(parentToWorld.GetPointer(), worldToParent.GetPointer());
+  vtkNew<vtkMatrix4x4> trackerToWorld;
+  tracker->GetMatrixTransformToWorld(trackerToWorld.GetPointer());
+  vtkNew<vtkMatrix4x4> worldToTracker;
+  vtkMatrix4x4::Invert(trackerToWorld.GetPointer(), worldToTracker.GetPointer());
+  vtkNew<vtkTransform> product;
+  product->Concatenate(worldToTracker.GetPointer());
+  product->Concatenate(parentToWorld.GetPointer());
+  product->Concatenate(node->GetMatrixTransformToParent());
+  product->Concatenate(worldToParent.GetPointer());
+  product->Concatenate(trackerToWorld.GetPointer());
+  if (!equal(matrix.GetPointer(), product->GetMatrix()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong transform in tracker"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Setting the transform in the tracker gives back the transform to parent
+  expected->DeepCopy(node->GetMatrixTransformToParent());
+  node->GetMatrixTransformToParent()->Identity();
+  engine.setTransformInReference(node.GetPointer(), Engine::Tracker,
+                                 matrix.GetPointer());
+  if (!equal(node->GetMatrixTransformToParent(), expected.GetPointer()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong transform set in tracker"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Parent is the transform to parent itself
+  engine.transformInReference(node.GetPointer(), Engine::Parent,
+                              matrix.GetPointer());
+  if (!equal(matrix.GetPointer(), node->GetMatrixTransformToParent()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong transform in parent"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
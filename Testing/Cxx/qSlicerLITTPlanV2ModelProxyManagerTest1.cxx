@@ -0,0 +1,199 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModelProxyManager.h"
+
+// MRML includes
+#include <vtkMRMLModelDisplayNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSphereSource.h>
+
+// STD includes
+#include <iostream>
+
+//----------------------------------------------------------------------------
+int qSlicerLITTPlanV2ModelProxyManagerTest1(int argc, char * argv[])
+{
+  QCoreApplication app(argc, argv);
+
+  vtkNew<vtkSphereSource> sphere;
+  sphere->SetThetaResolution(128);
+  sphere->SetPhiResolution(128);
+  sphere->Update();
+
+  vtkNew<vtkMRMLScene> scene;
+  vtkNew<vtkMRMLModelNode> model;
+  scene->AddNode(model.GetPointer());
+  vtkNew<vtkPolyData> polyData;
+  polyData->DeepCopy(sphere->GetOutput());
+  vtkNew<vtkFloatArray> scalars;
+  scalars->SetName("Thickness");
+  for (vtkIdType i = 0; i < polyData->GetNumberOfPoints(); ++i)
+    {
+    scalars->InsertNextValue(polyData->GetPoint(i)[2]);
+    }
+  polyData->GetPointData()->SetScalars(scalars.GetPointer());
+  model->SetAndObservePolyData(polyData.GetPointer());
+  vtkNew<vtkMRMLModelDisplayNode> displayNode;
+  scene->AddNode(displayNode.GetPointer());
+  model->SetAndObserveDisplayNodeID(displayNode->GetID());
+
+  // Models with few points are not decimated
+  sphere->SetThetaResolution(8);
+  sphere->SetPhiResolution(8);
+  sphere->Update();
+  vtkNew<vtkMRMLModelNode> smallModel;
+  scene->AddNode(smallModel.GetPointer());
+  vtkNew<vtkPolyData> smallPolyData;
+  smallPolyData->DeepCopy(sphere->GetOutput());
+  smallModel->SetAndObservePolyData(smallPolyData.GetPointer());
+
+  QList<vtkMRMLModelNode*> models;
+  models << model.GetPointer() << smallModel.GetPointer();
+
+  qSlicerLITTPlanV2ModelProxyManager proxyManager;
+  proxyManager.setMinimumNumberOfPoints(1000);
+  proxyManager.setTargetReduction(0.9);
+
+  proxyManager.prepareProxies(models);
+  // The proxy is computed from a copy: editing the model meanwhile is safe
+  double* point = polyData->GetPoints()->GetPoint(0);
+  polyData->GetPoints()->SetPoint(0, point[0], point[1], point[2]);
+  proxyManager.waitForProxies();
+  proxyManager.prepareProxies(models);
+  proxyManager.waitForProxies();
+  if (!proxyManager.hasProxy(model.GetPointer()) ||
+      proxyManager.hasProxy(smallModel.GetPointer()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Proxies not computed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // The proxy is displayed, the model node keeps its polydata
+  proxyManager.beginInteraction(models);
+  vtkPolyData* proxy = displayNode->GetInputPolyData();
+  if (!proxyManager.isInteracting() ||
+      !proxyManager.isProxyDisplayed(model.GetPointer()) ||
+      proxyManager.isProxyDisplayed(smallModel.GetPointer()) ||
+      !proxy || proxy == polyData.GetPointer() ||
+      proxy->GetNumberOfPolys() > 0.2 * polyData->GetNumberOfPolys() ||
+      model->GetPolyData() != polyData.GetPointer() ||
+      smallModel->GetPolyData() != smallPolyData.GetPointer())
+    {
+    std::cerr << "Line " << __LINE__ << " - Proxy not displayed: "
+              << (proxy ? proxy->GetNumberOfPolys() : 0) << " polys"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  // with the point scalars of the model
+  if (!proxy->GetPointData()->GetScalars())
+    {
+    std::cerr << "Line " << __LINE__ << " - Proxy without scalars" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // The displayed proxy can be moved (pending delta of a hardened model)
+  vtkNew<vtkMatrix4x4> delta;
+  delta->SetElement(0, 3, 100.);
+  proxyManager.setProxyTransform(model.GetPointer(), delta.GetPointer());
+  double bounds[6];
+  proxy->Update();
+  proxy->GetBounds(bounds);
+  if (bounds[0] < 50.)
+    {
+    std::cerr << "Line " << __LINE__ << " - Proxy not transformed: "
+              << bounds[0] << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  proxyManager.endInteraction();
+  polyData->GetBounds(bounds);
+  if (proxyManager.isInteracting() ||
+      displayNode->GetInputPolyData() != polyData.GetPointer() ||
+      bounds[0] > 0.)
+    {
+    std::cerr << "Line " << __LINE__ << " - Model not restored" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // The cached proxy is reused as long as the polydata is not modified
+  if (!proxyManager.hasProxy(model.GetPointer()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Proxy not cached" << std::endl;
+    return EXIT_FAILURE;
+    }
+  polyData->Modified();
+  if (proxyManager.hasProxy(model.GetPointer()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Proxy out of date" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // The proxies of the models removed from the scene are dropped
+  proxyManager.setMRMLScene(scene.GetPointer());
+  proxyManager.prepareProxies(models);
+  const int numberOfProxies = proxyManager.numberOfProxies();
+  scene->RemoveNode(model.GetPointer());
+  if (numberOfProxies != 2 || proxyManager.numberOfProxies() != 1 ||
+      proxyManager.hasProxy(model.GetPointer()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Proxy of a removed model kept: "
+              << numberOfProxies << " then " << proxyManager.numberOfProxies()
+              << " proxies" << std::endl;
+    return EXIT_FAILURE;
+    }
+  proxyManager.waitForProxies();
+
+  // Streamlines are masked: one line out of 2 is kept
+  vtkNew<vtkPolyData> streamlines;
+  vtkNew<vtkPoints> points;
+  vtkNew<vtkCellArray> cells;
+  for (int line = 0; line < 100; ++line)
+    {
+    cells->InsertNextCell(10);
+    for (int i = 0; i < 10; ++i)
+      {
+      cells->InsertCellPoint(points->InsertNextPoint(line, i, 0.));
+      }
+    }
+  streamlines->SetPoints(points.GetPointer());
+  streamlines->SetLines(cells.GetPointer());
+  vtkPolyData* masked = qSlicerLITTPlanV2ModelProxyManager::decimate(
+    streamlines.GetPointer(), 0.5);
+  if (!masked || masked->GetNumberOfLines() != 50)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong number of streamlines: "
+              << (masked ? masked->GetNumberOfLines() : 0) << std::endl;
+    return EXIT_FAILURE;
+    }
+  masked->Delete();
+  return EXIT_SUCCESS;
+}
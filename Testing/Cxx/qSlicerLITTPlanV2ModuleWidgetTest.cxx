@@ -20,19 +20,54 @@
 
 // Qt includes
 #include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QRadioButton>
 
 // CTK includes
 #include "ctkTest.h"
 
 // MRML includes
+#include "qMRMLNodeComboBox.h"
+#include "qMRMLTransformSliders.h"
+#include "qSlicerLITTPlanV2CoordinateReferenceEngine.h"
 #include "qSlicerLITTPlanV2Module.h"
 #include "qSlicerLITTPlanV2ModuleWidget.h"
+#include "qSlicerLITTPlanV2SessionLog.h"
 #include <vtkMRMLScene.h>
 #include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLModelNode.h>
 
 // VTK includes
 #include <vtkMatrix4x4.h>
 #include <vtkNew.h>
+#include <vtkSphereSource.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <cmath>
+
+namespace
+{
+// ----------------------------------------------------------------------------
+// A transform, two models and a skull around them, with the same node IDs
+// in every scene
+void populateScene(vtkMRMLScene* scene)
+{
+  vtkNew<vtkMRMLLinearTransformNode> transformNode;
+  scene->AddNode(transformNode.GetPointer());
+  for (int i = 0; i < 3; ++i)
+    {
+    vtkNew<vtkSphereSource> sphere;
+    sphere->SetCenter(i < 2 ? 10. * i : 0., 0., 0.);
+    sphere->SetRadius(i < 2 ? 0.5 : 80.);
+    sphere->Update();
+    vtkNew<vtkMRMLModelNode> model;
+    model->SetAndObservePolyData(sphere->GetOutput());
+    scene->AddNode(model.GetPointer());
+    }
+}
+}
 
 // ----------------------------------------------------------------------------
 class qSlicerLITTPlanV2ModuleWidgetTester: public QObject
@@ -43,6 +78,8 @@ private slots:
 
   void testIdentity();
   void testInvert();
+  void testEngineReference();
+  void testSessionReplay();
 };
 
 // ----------------------------------------------------------------------------
@@ -91,6 +128,175 @@ void qSlicerLITTPlanV2ModuleWidgetTester::testInvert()
   //qApp->exec();
 }
 
+// ----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidgetTester::testEngineReference()
+{
+  vtkNew<vtkMRMLScene> scene;
+  vtkNew<vtkMRMLLinearTransformNode> transformNode;
+  scene->AddNode(transformNode.GetPointer());
+  // The tracker is rotated by 90 degrees around IS
+  vtkNew<vtkMRMLLinearTransformNode> trackerNode;
+  scene->AddNode(trackerNode.GetPointer());
+  vtkNew<vtkTransform> tracker;
+  tracker->Translate(100., 0., 0.);
+  tracker->RotateZ(90.);
+  trackerNode->GetMatrixTransformToParent()->DeepCopy(tracker->GetMatrix());
+
+  qSlicerLITTPlanV2Module transformsModule;
+  transformsModule.setMRMLScene(scene.GetPointer());
+  transformsModule.logic();
+  qSlicerLITTPlanV2ModuleWidget* transformsWidget =
+    dynamic_cast<qSlicerLITTPlanV2ModuleWidget*>(transformsModule.widgetRepresentation());
+  qMRMLNodeComboBox* transformNodeSelector =
+    transformsWidget->findChild<qMRMLNodeComboBox*>("TransformNodeSelector");
+  transformNodeSelector->setCurrentNode(transformNode.GetPointer());
+
+  // The tracker reference is selected and placed from the panel
+  QRadioButton* trackerRadioButton =
+    transformsWidget->findChild<QRadioButton*>("TrackerRadioButton");
+  QVERIFY(trackerRadioButton);
+  trackerRadioButton->click();
+  qMRMLNodeComboBox* referenceNodeSelector =
+    transformsWidget->findChild<qMRMLNodeComboBox*>("ReferenceNodeSelector");
+  QVERIFY(referenceNodeSelector && referenceNodeSelector->isEnabled());
+  referenceNodeSelector->setCurrentNode(trackerNode.GetPointer());
+  QCOMPARE(transformsWidget->coordinateReferenceEngine()->referenceNode(
+    qSlicerLITTPlanV2CoordinateReferenceEngine::Tracker),
+    static_cast<vtkMRMLTransformNode*>(trackerNode.GetPointer()));
+
+  // The sliders edit the motion in the tracker coordinates: a translation
+  // along the tracker LR axis moves the transformed nodes along PA.
+  qMRMLTransformSliders* translationSliders =
+    transformsWidget->findChild<qMRMLTransformSliders*>("TranslationSliders");
+  vtkMRMLLinearTransformNode* slidersNode =
+    translationSliders->mrmlTransformNode();
+  QVERIFY(slidersNode && slidersNode != transformNode.GetPointer());
+  slidersNode->GetMatrixTransformToParent()->SetElement(0, 3, 5.);
+  vtkMatrix4x4* matrix = transformNode->GetMatrixTransformToParent();
+  QVERIFY(fabs(matrix->GetElement(0, 3)) < 1e-9);
+  QVERIFY(fabs(matrix->GetElement(1, 3) - 5.) < 1e-9);
+
+  // Edits of the active transform are shown in the tracker coordinates
+  matrix->SetElement(1, 3, -2.);
+  QVERIFY(fabs(slidersNode->GetMatrixTransformToParent()->GetElement(0, 3)
+               + 2.) < 1e-9);
+
+  // Back to Local, the sliders edit the transform to parent through the
+  // engine
+  transformsWidget->findChild<QRadioButton*>("LocalRadioButton")->click();
+  QVERIFY(!referenceNodeSelector->isEnabled());
+  slidersNode = translationSliders->mrmlTransformNode();
+  QVERIFY(slidersNode && slidersNode != transformNode.GetPointer());
+  QVERIFY(fabs(slidersNode->GetMatrixTransformToParent()->GetElement(1, 3)
+               + 2.) < 1e-9);
+  slidersNode->GetMatrixTransformToParent()->SetElement(0, 3, 3.);
+  QVERIFY(fabs(matrix->GetElement(0, 3) - 3.) < 1e-9);
+
+  // In Global, the motion is expressed in RAS: under the tracker, a
+  // translation along LR is a translation along PA in the tracker.
+  transformNode->SetAndObserveTransformNodeID(trackerNode->GetID());
+  matrix->Identity();
+  transformsWidget->findChild<QRadioButton*>("GlobalRadioButton")->click();
+  slidersNode = translationSliders->mrmlTransformNode();
+  QVERIFY(slidersNode && slidersNode != transformNode.GetPointer());
+  slidersNode->GetMatrixTransformToParent()->SetElement(0, 3, 4.);
+  QVERIFY(fabs(matrix->GetElement(0, 3)) < 1e-9);
+  QVERIFY(fabs(matrix->GetElement(1, 3) + 4.) < 1e-9);
+}
+
+// ----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidgetTester::testSessionReplay()
+{
+  QString fileName = QDir::temp().filePath("qSlicerLITTPlanV2SessionTest.lpl");
+  {
+  vtkNew<vtkMRMLScene> scene;
+  populateScene(scene.GetPointer());
+  qSlicerLITTPlanV2Module transformsModule;
+  transformsModule.setMRMLScene(scene.GetPointer());
+  transformsModule.logic();
+  qSlicerLITTPlanV2ModuleWidget* transformsWidget =
+    dynamic_cast<qSlicerLITTPlanV2ModuleWidget*>(transformsModule.widgetRepresentation());
+
+  vtkMRMLLinearTransformNode* transformNode =
+    vtkMRMLLinearTransformNode::SafeDownCast(
+      scene->GetFirstNodeByClass("vtkMRMLLinearTransformNode"));
+  QStringList modelIDs;
+  modelIDs << scene->GetNthNodeByClass(0, "vtkMRMLModelNode")->GetID()
+           << scene->GetNthNodeByClass(1, "vtkMRMLModelNode")->GetID();
+
+  transformsWidget->startSessionRecording();
+  transformsWidget->transformNodes(modelIDs);
+  vtkNew<vtkTransform> transform;
+  for (int i = 0; i < 5; ++i)
+    {
+    transform->RotateWXYZ(7., 1., 2., 3.);
+    transform->Translate(1.5, -0.5, 0.25);
+    transformNode->GetMatrixTransformToParent()->DeepCopy(
+      transform->GetMatrix());
+    }
+  // The optimization is replayed from its inputs, not from its result
+  transformsWidget->findChild<qMRMLNodeComboBox*>("TumorModelSelector")
+    ->setCurrentNode(scene->GetNodeByID(modelIDs[1].toLatin1()));
+  transformsWidget->findChild<qMRMLNodeComboBox*>("SkullModelSelector")
+    ->setCurrentNode(scene->GetNthNodeByClass(2, "vtkMRMLModelNode"));
+  transformsWidget->findChild<qMRMLNodeComboBox*>("TractModelSelector")
+    ->setCurrentNode(0);
+  QVERIFY(transformsWidget->optimizeTrajectory());
+  transformsWidget->hardenNodes(QStringList() << modelIDs[0]);
+  transformsWidget->invert();
+  transformsWidget->untransformNodes(QStringList() << modelIDs[1]);
+  // A log that can't be saved is kept: the recording goes on
+  QVERIFY(!transformsWidget->stopSessionRecording(
+    QDir::temp().filePath("doesNotExist/qSlicerLITTPlanV2SessionTest.lpl")));
+  QVERIFY(transformsWidget->isRecordingSession());
+  QVERIFY(transformsWidget->stopSessionRecording(fileName));
+  const qSlicerLITTPlanV2SessionLog& recordedLog =
+    transformsWidget->sessionLog();
+  QVERIFY(recordedLog.events().count() > 0);
+  QCOMPARE(recordedLog.initialState().Matrices.count(), 1);
+  QCOMPARE(recordedLog.finalState().Trajectories.count(), 1);
+  int optimizations = 0;
+  foreach(const qSlicerLITTPlanV2SessionLog::Event& event, recordedLog.events())
+    {
+    optimizations +=
+      event.Type == qSlicerLITTPlanV2SessionLog::OptimizeTrajectory ? 1 : 0;
+    }
+  QCOMPARE(optimizations, 1);
+  }
+
+  qSlicerLITTPlanV2SessionLog log;
+  QVERIFY(log.load(fileName));
+  QFile::remove(fileName);
+
+  // Replay on a fresh copy of the initial scene
+  vtkNew<vtkMRMLScene> scene;
+  populateScene(scene.GetPointer());
+  qSlicerLITTPlanV2Module transformsModule;
+  transformsModule.setMRMLScene(scene.GetPointer());
+  transformsModule.logic();
+  qSlicerLITTPlanV2ModuleWidget* transformsWidget =
+    dynamic_cast<qSlicerLITTPlanV2ModuleWidget*>(transformsModule.widgetRepresentation());
+
+  // A scene edited since the recording started is refused
+  vtkMRMLLinearTransformNode* transformNode =
+    vtkMRMLLinearTransformNode::SafeDownCast(
+      scene->GetFirstNodeByClass("vtkMRMLLinearTransformNode"));
+  transformNode->GetMatrixTransformToParent()->SetElement(0, 3, 1.);
+  QVector<double> latencies;
+  QStringList differences;
+  QVERIFY(!transformsWidget->replaySession(log, &latencies, &differences));
+  QCOMPARE(differences.count(), 1);
+  QVERIFY(differences[0].startsWith("Initial state"));
+  QCOMPARE(latencies.count(), 0);
+  QCOMPARE(transformNode->GetMatrixTransformToParent()->GetElement(0, 3), 1.);
+
+  transformNode->GetMatrixTransformToParent()->SetElement(0, 3, 0.);
+  bool identical = transformsWidget->replaySession(log, &latencies, &differences);
+  QCOMPARE(differences, QStringList());
+  QVERIFY(identical);
+  QCOMPARE(latencies.count(), log.events().count());
+}
+
 // ----------------------------------------------------------------------------
 CTK_TEST_MAIN(qSlicerLITTPlanV2ModuleWidgetTest)
 #include "moc_qSlicerLITTPlanV2ModuleWidgetTest.cxx"
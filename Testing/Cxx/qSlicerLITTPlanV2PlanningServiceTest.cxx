@@ -0,0 +1,300 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QLocalSocket>
+#include <QTextStream>
+
+// CTK includes
+#include "ctkTest.h"
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2PlanningService.h"
+#include "qSlicerLITTPlanV2SharedAssetCache.h"
+
+// MRML includes
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkCellData.h>
+#include <vtkFloatArray.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataWriter.h>
+#include <vtkSphereSource.h>
+
+// ----------------------------------------------------------------------------
+/// Minimal client of the planning service: sends tagged requests and
+/// collects the replies by tag.
+class qSlicerLITTPlanV2StubClient
+{
+public:
+  bool connectToServer(const QString& serverName)
+  {
+    this->Socket.connectToServer(serverName);
+    return this->Socket.waitForConnected(5000);
+  }
+  void send(const QString& tag, const QString& request)
+  {
+    this->Socket.write(QString("%1\t%2\n").arg(tag).arg(request).toUtf8());
+    this->Socket.flush();
+  }
+  QString reply(const QString& tag)
+  {
+    QElapsedTimer timer;
+    timer.start();
+    while (!this->Replies.contains(tag))
+      {
+      while (!this->Socket.canReadLine())
+        {
+        if (timer.elapsed() > 10000)
+          {
+          return QString("TIMEOUT");
+          }
+        // The service runs in this thread: let it process the connection.
+        QCoreApplication::processEvents();
+        this->Socket.waitForReadyRead(10);
+        }
+      QString line = QString::fromUtf8(this->Socket.readLine()).trimmed();
+      int separator = line.indexOf(' ');
+      this->Replies[line.left(separator)] = line.mid(separator + 1);
+      }
+    return this->Replies.take(tag);
+  }
+  QString request(const QString& request)
+  {
+    QString tag = QString::number(++this->LastTag);
+    this->send(tag, request);
+    return this->reply(tag);
+  }
+
+  QLocalSocket Socket;
+  QHash<QString, QString> Replies;
+  int LastTag;
+
+  qSlicerLITTPlanV2StubClient() : LastTag(0) {}
+};
+
+// ----------------------------------------------------------------------------
+class qSlicerLITTPlanV2PlanningServiceTester: public QObject
+{
+  Q_OBJECT
+
+private slots:
+  void initTestCase();
+  void cleanupTestCase();
+
+  void testSessions();
+  void testSharedAssets();
+  void testStatistics();
+
+private:
+  QString TransformFileName;
+  QString AssetFileName;
+};
+
+// ----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningServiceTester::initTestCase()
+{
+  this->TransformFileName = QDir::temp().filePath(
+    "qSlicerLITTPlanV2PlanningServiceTest.tfm");
+  QFile transformFile(this->TransformFileName);
+  QVERIFY(transformFile.open(QIODevice::WriteOnly | QIODevice::Text));
+  QTextStream stream(&transformFile);
+  stream << "#Insight Transform File V1.0\n"
+         << "# Transform 0\n"
+         << "Transform: AffineTransform_double_3_3\n"
+         << "Parameters: 1 0 0 0 1 0 0 0 1 10 20 30\n"
+         << "FixedParameters: 0 0 0\n";
+  transformFile.close();
+
+  this->AssetFileName = QDir::temp().filePath(
+    "qSlicerLITTPlanV2PlanningServiceTest.vtk");
+  vtkNew<vtkSphereSource> sphere;
+  sphere->Update();
+  // Texture coordinates and a named cell array are shared too
+  vtkNew<vtkPolyData> asset;
+  asset->DeepCopy(sphere->GetOutput());
+  vtkNew<vtkFloatArray> tcoords;
+  tcoords->SetNumberOfComponents(2);
+  tcoords->SetNumberOfTuples(asset->GetNumberOfPoints());
+  tcoords->FillComponent(0, 0.25);
+  tcoords->FillComponent(1, 0.75);
+  asset->GetPointData()->SetTCoords(tcoords.GetPointer());
+  vtkNew<vtkFloatArray> labels;
+  labels->SetName("Label");
+  labels->SetNumberOfTuples(asset->GetNumberOfCells());
+  labels->FillComponent(0, 3.);
+  asset->GetCellData()->AddArray(labels.GetPointer());
+  vtkNew<vtkPolyDataWriter> writer;
+  writer->SetInput(asset.GetPointer());
+  writer->SetFileName(this->AssetFileName.toLatin1());
+  QVERIFY(writer->Write());
+}
+
+// ----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningServiceTester::cleanupTestCase()
+{
+  QFile::remove(this->TransformFileName);
+  QFile::remove(this->AssetFileName);
+}
+
+// ----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningServiceTester::testSessions()
+{
+  qSlicerLITTPlanV2PlanningService service;
+  service.setMaximumThreadCount(2);
+  QVERIFY(service.listen("qSlicerLITTPlanV2PlanningServiceTest"));
+
+  qSlicerLITTPlanV2StubClient client;
+  QVERIFY(client.connectToServer(service.serverName()));
+  QCOMPARE(client.request("OPEN\tcaseA"), QString("OK"));
+  QCOMPARE(client.request("OPEN\tcaseB"), QString("OK"));
+  QCOMPARE(client.request("OPEN\tcaseA"), QString("ERROR case already opened"));
+  QCOMPARE(client.request("CASES"), QString("OK caseA caseB"));
+
+  // Scenes are isolated
+  QString reply = client.request(
+    QString("LOAD_TRANSFORM\tcaseA\t%1").arg(this->TransformFileName));
+  QVERIFY(reply.startsWith("OK "));
+  QString nodeID = reply.mid(3);
+  QCOMPARE(service.scene("caseA")->GetNumberOfNodesByClass(
+    "vtkMRMLLinearTransformNode"), 1);
+  QCOMPARE(service.scene("caseB")->GetNumberOfNodesByClass(
+    "vtkMRMLLinearTransformNode"), 0);
+  QVERIFY(client.request(QString("MATRIX\tcaseB\t%1").arg(nodeID))
+          .startsWith("ERROR"));
+
+  QStringList elements =
+    client.request(QString("MATRIX\tcaseA\t%1").arg(nodeID)).split(' ');
+  QCOMPARE(elements.count(), 17);
+  QCOMPARE(elements[0], QString("OK"));
+
+  QCOMPARE(client.request("CLOSE\tcaseA"), QString("OK"));
+  QCOMPARE(client.request("CASES"), QString("OK caseB"));
+  QVERIFY(service.scene("caseA") == 0);
+  QVERIFY(client.request("UNKNOWN\tcaseB").startsWith("ERROR"));
+}
+
+// ----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningServiceTester::testSharedAssets()
+{
+  qSlicerLITTPlanV2PlanningService service;
+  QVERIFY(service.listen("qSlicerLITTPlanV2PlanningServiceTest"));
+
+  qSlicerLITTPlanV2StubClient client;
+  QVERIFY(client.connectToServer(service.serverName()));
+  const int caseCount = 8;
+  for (int i = 0; i < caseCount; ++i)
+    {
+    QCOMPARE(client.request(QString("OPEN\tcase%1").arg(i)), QString("OK"));
+    }
+  // Pipeline the requests: they are executed concurrently
+  for (int i = 0; i < caseCount; ++i)
+    {
+    client.send(QString("acquire%1").arg(i),
+      QString("ACQUIRE\tcase%1\t%2").arg(i).arg(this->AssetFileName));
+    }
+  for (int i = 0; i < caseCount; ++i)
+    {
+    QString reply = client.reply(QString("acquire%1").arg(i));
+    QVERIFY(reply.startsWith("OK vtkPolyData "));
+    QCOMPARE(service.scene(QString("case%1").arg(i))->GetNodeByID(
+      reply.section(' ', 2).toLatin1())->GetClassName(), "vtkMRMLModelNode");
+    }
+  qSlicerLITTPlanV2SharedAssetCache* assets = service.sharedAssets();
+  QCOMPARE(assets->count(), 1);
+  QCOMPARE(assets->useCount(this->AssetFileName), caseCount);
+
+  // The models of the cases view the memory of the shared asset
+  vtkPolyData* asset = vtkPolyData::SafeDownCast(
+    assets->asset(this->AssetFileName));
+  QVERIFY(asset != 0);
+  for (int i = 0; i < caseCount; ++i)
+    {
+    vtkMRMLModelNode* model = vtkMRMLModelNode::SafeDownCast(
+      service.scene(QString("case%1").arg(i))->GetFirstNodeByClass(
+        "vtkMRMLModelNode"));
+    QVERIFY(model != 0);
+    QVERIFY(model->GetPolyData()->GetPoints()->GetVoidPointer(0) ==
+            asset->GetPoints()->GetVoidPointer(0));
+    QCOMPARE(model->GetPolyData()->GetNumberOfCells(), asset->GetNumberOfCells());
+    QVERIFY(model->GetPolyData()->GetPointData()->GetNormals() != 0);
+    vtkDataArray* tcoords = model->GetPolyData()->GetPointData()->GetTCoords();
+    QVERIFY(tcoords != 0);
+    QVERIFY(tcoords->GetVoidPointer(0) ==
+            asset->GetPointData()->GetTCoords()->GetVoidPointer(0));
+    vtkDataArray* labels =
+      model->GetPolyData()->GetCellData()->GetArray("Label");
+    QVERIFY(labels != 0);
+    QCOMPARE(labels->GetComponent(0, 0), 3.);
+    // The model is marked as a read-only view of the asset
+    QCOMPARE(QString(model->GetAttribute(
+      qSlicerLITTPlanV2SharedAssetCache::sharedAssetAttributeName())),
+      this->AssetFileName);
+    }
+
+  for (int i = 0; i < caseCount - 1; ++i)
+    {
+    QCOMPARE(client.request(QString("CLOSE\tcase%1").arg(i)), QString("OK"));
+    }
+  QCOMPARE(assets->useCount(this->AssetFileName), 1);
+  QVERIFY(assets->asset(this->AssetFileName) != 0);
+  QCOMPARE(client.request(QString("CLOSE\tcase%1").arg(caseCount - 1)),
+           QString("OK"));
+  QCOMPARE(assets->count(), 0);
+
+  QVERIFY(client.request("OPEN\tcaseC") == "OK");
+  QVERIFY(client.request("ACQUIRE\tcaseC\tdoesNotExist.nrrd").startsWith("ERROR"));
+  QCOMPARE(assets->count(), 0);
+
+  // Corrupt files are errors, not empty data
+  QString corruptFileName = QDir::temp().filePath(
+    "qSlicerLITTPlanV2PlanningServiceTestCorrupt.nrrd");
+  QFile corruptFile(corruptFileName);
+  QVERIFY(corruptFile.open(QIODevice::WriteOnly));
+  corruptFile.write("not a nrrd file");
+  corruptFile.close();
+  QVERIFY(client.request(QString("ACQUIRE\tcaseC\t%1").arg(corruptFileName))
+          .startsWith("ERROR"));
+  QFile::remove(corruptFileName);
+  QCOMPARE(assets->count(), 0);
+}
+
+// ----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningServiceTester::testStatistics()
+{
+  qSlicerLITTPlanV2PlanningService service;
+  QCOMPARE(service.execute("OPEN caseA"), QString("OK"));
+  QCOMPARE(service.execute("CLOSE caseA"), QString("OK"));
+  QString statistics = service.execute("STATS");
+  QVERIFY(statistics.startsWith("OK "));
+  QVERIFY(statistics.contains("OPEN count=1"));
+  QVERIFY(statistics.contains("CLOSE count=1"));
+}
+
+// ----------------------------------------------------------------------------
+CTK_TEST_MAIN(qSlicerLITTPlanV2PlanningServiceTest)
+#include "moc_qSlicerLITTPlanV2PlanningServiceTest.cxx"
@@ -0,0 +1,179 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ResultCache.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+
+// STD includes
+#include <iostream>
+
+namespace
+{
+//----------------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> createImage(double value)
+{
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetDimensions(20, 30, 10);
+  image->SetOrigin(-10., 5., 2.5);
+  image->SetSpacing(0.5, 1., 1.5);
+  vtkNew<vtkDoubleArray> scalars;
+  scalars->SetNumberOfTuples(image->GetNumberOfPoints());
+  vtkNew<vtkFloatArray> tensors;
+  tensors->SetName("Orientation");
+  tensors->SetNumberOfComponents(6);
+  tensors->SetNumberOfTuples(image->GetNumberOfPoints());
+  for (vtkIdType i = 0; i < image->GetNumberOfPoints(); ++i)
+    {
+    scalars->SetValue(i, value * i);
+    for (int c = 0; c < 6; ++c)
+      {
+      tensors->SetComponent(i, c, i + c);
+      }
+    }
+  image->GetPointData()->SetScalars(scalars.GetPointer());
+  image->GetPointData()->AddArray(tensors.GetPointer());
+  return image;
+}
+}
+
+//----------------------------------------------------------------------------
+int qSlicerLITTPlanV2ResultCacheTest1(int argc, char * argv[])
+{
+  QCoreApplication app(argc, argv);
+
+  QDir temporaryDirectory(QDir::tempPath());
+  QString cacheDirectory = temporaryDirectory.filePath(
+    QString("qSlicerLITTPlanV2ResultCacheTest1-%1").arg(app.applicationPid()));
+
+  qSlicerLITTPlanV2ResultCache cache(cacheDirectory);
+  cache.clear();
+
+  // Keys depend on the matrix and on the version of the algorithm
+  vtkNew<vtkMatrix4x4> matrix;
+  QList<QByteArray> hashes;
+  hashes << qSlicerLITTPlanV2ResultCache::hashMatrix(matrix.GetPointer());
+  QString key = qSlicerLITTPlanV2ResultCache::key("Test", 1, hashes);
+  matrix->SetElement(0, 3, 1e-9);
+  QList<QByteArray> movedHashes;
+  movedHashes << qSlicerLITTPlanV2ResultCache::hashMatrix(matrix.GetPointer());
+  if (key.isEmpty() ||
+      key != qSlicerLITTPlanV2ResultCache::key("Test", 1, hashes) ||
+      key == qSlicerLITTPlanV2ResultCache::key("Test", 1, movedHashes) ||
+      key == qSlicerLITTPlanV2ResultCache::key("Test", 2, hashes))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong keys" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if (cache.load(key) || cache.misses() != 1)
+    {
+    std::cerr << "Line " << __LINE__ << " - Empty cache hit" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Round trip
+  vtkSmartPointer<vtkImageData> image = createImage(1.);
+  if (!cache.store(key, image) || !cache.contains(key) || cache.size() <= 0)
+    {
+    std::cerr << "Line " << __LINE__ << " - Failed to store" << std::endl;
+    return EXIT_FAILURE;
+    }
+  vtkSmartPointer<vtkImageData> cachedImage = cache.load(key);
+  if (!cachedImage || cache.hits() != 1 ||
+      qSlicerLITTPlanV2ResultCache::hashImageData(cachedImage) !=
+      qSlicerLITTPlanV2ResultCache::hashImageData(image) ||
+      !cachedImage->GetPointData()->GetScalars() ||
+      !cachedImage->GetPointData()->GetArray("Orientation"))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong cached image" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // The mapping outlives the image
+  vtkSmartPointer<vtkDataArray> orientation =
+    cachedImage->GetPointData()->GetArray("Orientation");
+  cachedImage = 0;
+  if (orientation->GetComponent(10, 5) != 15.)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong cached value" << std::endl;
+    return EXIT_FAILURE;
+    }
+  orientation = 0;
+
+  // Least recently used results are evicted
+  qint64 resultSize = cache.size();
+  QString otherKey =
+    qSlicerLITTPlanV2ResultCache::key("Test", 1, movedHashes);
+  cache.setMaximumSize(resultSize);
+  if (!cache.store(otherKey, createImage(2.)) ||
+      cache.contains(key) || !cache.contains(otherKey) ||
+      cache.size() > resultSize)
+    {
+    std::cerr << "Line " << __LINE__ << " - Eviction failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Corrupted results are misses and are removed
+  QString fileName = QDir(cacheDirectory).filePath(otherKey + ".lpc");
+  QFile file(fileName);
+  if (!file.resize(file.size() / 2))
+    {
+    std::cerr << "Line " << __LINE__ << " - Can't truncate" << std::endl;
+    return EXIT_FAILURE;
+    }
+  int misses = cache.misses();
+  if (cache.load(otherKey) || cache.misses() != misses + 1 ||
+      cache.contains(otherKey))
+    {
+    std::cerr << "Line " << __LINE__ << " - Truncated result loaded" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // Null number of components of the first array: its header follows the
+  // 88 bytes of the file header, the number of components is at byte 68.
+  if (!cache.store(otherKey, createImage(2.)) ||
+      !file.open(QIODevice::ReadWrite) || !file.seek(88 + 68))
+    {
+    std::cerr << "Line " << __LINE__ << " - Can't corrupt" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const qint32 numberOfComponents = 0;
+  file.write(reinterpret_cast<const char*>(&numberOfComponents),
+             sizeof(numberOfComponents));
+  file.close();
+  if (cache.load(otherKey) || cache.misses() != misses + 2 ||
+      cache.contains(otherKey))
+    {
+    std::cerr << "Line " << __LINE__ << " - Corrupted result loaded" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  cache.clear();
+  QDir().rmdir(cacheDirectory);
+  return EXIT_SUCCESS;
+}
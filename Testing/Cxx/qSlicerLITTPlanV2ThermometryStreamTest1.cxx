@@ -0,0 +1,188 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QtConcurrentRun>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ThermometryStream.h"
+#include "vtkLITTPlanV2ThermalDoseAccumulator.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkXMLImageDataWriter.h>
+
+// STD includes
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+//----------------------------------------------------------------------------
+/// Acquisition thread: push count frames, one per second, until a frame
+/// is rejected. Returns the number of frames accepted.
+int pushFrames(qSlicerLITTPlanV2ThermometryStream* stream,
+               vtkImageData* frame, vtkMatrix4x4* ijkToRAS, int count)
+{
+  int accepted = 0;
+  while (accepted < count && stream->pushFrame(frame, ijkToRAS, accepted))
+    {
+    ++accepted;
+    }
+  return accepted;
+}
+
+//----------------------------------------------------------------------------
+bool checkDamage(qSlicerLITTPlanV2ThermometryStream* stream, int frames,
+                 int line)
+{
+  vtkLITTPlanV2ThermalDoseAccumulator* accumulator = stream->accumulator();
+  // Constant temperature: the damage is the rate times the duration
+  const double expected = accumulator->DamageRate(60.) * (frames - 1);
+  const double damage =
+    accumulator->GetDamage()->GetScalarComponentAsDouble(1, 2, 3, 0);
+  if (accumulator->GetNumberOfFrames() != frames ||
+      accumulator->GetLastTime() != frames - 1 ||
+      fabs(damage - expected) > 1e-6 * expected)
+    {
+    std::cerr << "Line " << line << " - Frames dropped: "
+              << accumulator->GetNumberOfFrames() << " frames, damage "
+              << damage << " instead of " << expected << std::endl;
+    return false;
+    }
+  return true;
+}
+}
+
+//----------------------------------------------------------------------------
+int qSlicerLITTPlanV2ThermometryStreamTest1(int argc, char * argv[])
+{
+  QCoreApplication app(argc, argv);
+
+  vtkNew<vtkImageData> frame;
+  frame->SetDimensions(4, 4, 4);
+  frame->SetScalarTypeToFloat();
+  frame->SetNumberOfScalarComponents(1);
+  frame->AllocateScalars();
+  float* temperatures = static_cast<float*>(frame->GetScalarPointer());
+  for (int i = 0; i < 4 * 4 * 4; ++i)
+    {
+    temperatures[i] = 60.f;
+    }
+  vtkNew<vtkMatrix4x4> ijkToRAS;
+
+  // Same geometry as the frames
+  vtkNew<vtkImageData> labelMap;
+  labelMap->SetDimensions(4, 4, 4);
+  labelMap->SetScalarTypeToUnsignedChar();
+  labelMap->SetNumberOfScalarComponents(1);
+  labelMap->AllocateScalars();
+  vtkNew<vtkMRMLScalarVolumeNode> damageVolume;
+  damageVolume->SetAndObserveImageData(labelMap.GetPointer());
+
+  qSlicerLITTPlanV2ThermometryStream stream;
+  stream.setDamageVolumeNode(damageVolume.GetPointer());
+  stream.setMaximumNumberOfPendingFrames(1);
+
+  // The frames pushed faster than they are processed are all accumulated,
+  // in order.
+  const int numberOfFrames = 30;
+  if (!stream.start())
+    {
+    std::cerr << "Line " << __LINE__ << " - Stream not started" << std::endl;
+    return EXIT_FAILURE;
+    }
+  QFuture<int> acquisition = QtConcurrent::run(
+    pushFrames, &stream, frame.GetPointer(), ijkToRAS.GetPointer(),
+    numberOfFrames);
+  acquisition.waitForFinished();
+  stream.flush();
+  if (acquisition.result() != numberOfFrames ||
+      !checkDamage(&stream, numberOfFrames, __LINE__) ||
+      stream.numberOfFrames() < 1 ||
+      labelMap->GetScalarComponentAsDouble(1, 2, 3, 0) != 1.)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong stream: "
+              << acquisition.result() << " frames accepted, "
+              << stream.numberOfFrames() << " displayed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // The buffers are reused: one pending, one processed, one being copied
+  if (stream.numberOfFrameBuffers() > 3)
+    {
+    std::cerr << "Line " << __LINE__ << " - Buffers not reused: "
+              << stream.numberOfFrameBuffers() << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Stopping releases the blocked acquisition, the frames left are rejected
+  stream.start();
+  acquisition = QtConcurrent::run(
+    pushFrames, &stream, frame.GetPointer(), ijkToRAS.GetPointer(), 100000);
+  stream.stop();
+  acquisition.waitForFinished();
+  if (stream.isRunning() || acquisition.result() >= 100000 ||
+      stream.accumulator()->GetNumberOfFrames() > acquisition.result() ||
+      stream.pushFrame(frame.GetPointer(), ijkToRAS.GetPointer(), 0.) ||
+      stream.numberOfFrameBuffers() > 3)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong stop: "
+              << acquisition.result() << " frames accepted, "
+              << stream.numberOfFrameBuffers() << " buffers" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // The frames still queued at the end of a replay are processed
+  const QString directory = QDir::temp().filePath(
+    QString("qSlicerLITTPlanV2ThermometryStreamTest1-%1")
+    .arg(app.applicationPid()));
+  QDir().mkpath(directory);
+  vtkNew<vtkXMLImageDataWriter> writer;
+  writer->SetInput(frame.GetPointer());
+  QStringList fileNames;
+  for (int i = 0; i < numberOfFrames; ++i)
+    {
+    fileNames << QDir(directory).filePath(
+      QString("frame%1.vti").arg(i, 3, 10, QChar('0')));
+    writer->SetFileName(fileNames.back().toLatin1());
+    writer->Write();
+    }
+  bool replayed = stream.replayDirectory(directory, 1., 0.);
+  while (stream.isRunning())
+    {
+    app.processEvents();
+    }
+  foreach(const QString& fileName, fileNames)
+    {
+    QFile::remove(fileName);
+    }
+  QDir().rmdir(directory);
+  if (!replayed || !checkDamage(&stream, numberOfFrames, __LINE__))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong replay" << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
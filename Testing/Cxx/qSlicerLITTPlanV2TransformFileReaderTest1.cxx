@@ -0,0 +1,293 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2TransformFileReader.h"
+
+// Logic includes
+#include "vtkSlicerTransformLogic.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+
+// STD includes
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+//----------------------------------------------------------------------------
+bool compareMatrices(vtkMatrix4x4* matrix, vtkMatrix4x4* expected, int line)
+{
+  for (int i = 0; i < 4; ++i)
+    {
+    for (int j = 0; j < 4; ++j)
+      {
+      if (fabs(matrix->GetElement(i, j) - expected->GetElement(i, j)) > 1e-9)
+        {
+        std::cerr << "Line " << line << " - Wrong element (" << i << ", " << j
+                  << "): " << matrix->GetElement(i, j) << " instead of "
+                  << expected->GetElement(i, j) << std::endl;
+        return false;
+        }
+      }
+    }
+  return true;
+}
+}
+
+//----------------------------------------------------------------------------
+int qSlicerLITTPlanV2TransformFileReaderTest1(int argc, char * argv[])
+{
+  QCoreApplication app(argc, argv);
+  // The import timings are only reported with --timing (never under ctest)
+  const bool printTimings = argc > 1 && QString(argv[argc - 1]) == "--timing";
+  const int numberOfArguments = printTimings ? argc - 1 : argc;
+  if (numberOfArguments < 2)
+    {
+    std::cerr << "Usage: qSlicerLITTPlanV2TransformFileReaderTest1 "
+              << "affineTransform.txt [numberOfFiles] [--timing]" << std::endl;
+    return EXIT_FAILURE;
+    }
+  const QString fileName = argv[1];
+  const int numberOfFiles = numberOfArguments > 2 ? atoi(argv[2]) : 500;
+
+  // Single transform
+  qSlicerLITTPlanV2TransformFileReader::File file =
+    qSlicerLITTPlanV2TransformFileReader::readFile(fileName);
+  if (!file.ErrorString.isEmpty() || file.Transforms.count() != 1 ||
+      file.Transforms[0].Type != "AffineTransform_double_3_3" ||
+      file.Transforms[0].Parameters.count() != 12 ||
+      file.Transforms[0].Parameters[0] != -1.21169 ||
+      file.Transforms[0].Parameters[11] != 131. ||
+      file.Transforms[0].FixedParameters.count() != 3 ||
+      file.Transforms[0].FixedParameters[2] != 366.2)
+    {
+    std::cerr << "Line " << __LINE__ << " - Failed to parse " << argv[1]
+              << ": " << qPrintable(file.ErrorString) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Several transforms, CRLF line endings
+  const char multipleTransforms[] =
+    "#Insight Transform File V1.0\r\n"
+    "# Transform 0\r\n"
+    "Transform: TranslationTransform_double_3_3\r\n"
+    "Parameters: 1 -2.5 3e1\r\n"
+    "FixedParameters: \r\n"
+    "# Transform 1\r\n"
+    "Transform: VersorRigid3DTransform_double_3_3\r\n"
+    "Parameters: 0 0 0.7071067811865476 10 20 30\r\n"
+    "FixedParameters: 1 2 3\r\n";
+  QList<qSlicerLITTPlanV2TransformFileReader::Transform> transforms;
+  if (!qSlicerLITTPlanV2TransformFileReader::parse(
+        multipleTransforms, multipleTransforms + sizeof(multipleTransforms) - 1,
+        transforms) ||
+      transforms.count() != 2 ||
+      transforms[0].Parameters[2] != 30. ||
+      transforms[1].FixedParameters.count() != 3 ||
+      !qSlicerLITTPlanV2TransformFileReader::isLinear(transforms[0]) ||
+      !qSlicerLITTPlanV2TransformFileReader::isLinear(transforms[1]))
+    {
+    std::cerr << "Line " << __LINE__ << " - Failed to parse several transforms"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  // A resampling translation of (1, -2.5, 30) in LPS is a modeling
+  // translation of (1, -2.5, -30) in RAS.
+  vtkNew<vtkMatrix4x4> matrix;
+  vtkNew<vtkMatrix4x4> expected;
+  expected->SetElement(0, 3, 1.);
+  expected->SetElement(1, 3, -2.5);
+  expected->SetElement(2, 3, -30.);
+  qSlicerLITTPlanV2TransformFileReader::matrixTransformToParent(
+    transforms[0], matrix.GetPointer());
+  if (!compareMatrices(matrix.GetPointer(), expected.GetPointer(), __LINE__))
+    {
+    return EXIT_FAILURE;
+    }
+
+  const char invalid[] =
+    "#Insight Transform File V1.0\n"
+    "Transform: AffineTransform_double_3_3\n"
+    "Parameters: 1 0 0 0 1 0 0 0 1 0 0 1.2.3\n";
+  QString errorString;
+  if (qSlicerLITTPlanV2TransformFileReader::parse(
+        invalid, invalid + sizeof(invalid) - 1, transforms, &errorString) ||
+      errorString.isEmpty())
+    {
+    std::cerr << "Line " << __LINE__ << " - Invalid file parsed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Bulk import, compared with vtkSlicerTransformLogic::AddTransform()
+  QDir temporaryDirectory(QDir::tempPath());
+  const QString directory = temporaryDirectory.filePath(
+    QString("qSlicerLITTPlanV2TransformFileReaderTest1-%1").arg(app.applicationPid()));
+  QDir().mkpath(directory);
+  QStringList fileNames;
+  for (int i = 0; i < numberOfFiles; ++i)
+    {
+    fileNames << QDir(directory).filePath(QString("transform%1.txt").arg(i, 6, 10, QChar('0')));
+    QFile::copy(fileName, fileNames.back());
+    }
+
+  QElapsedTimer timer;
+  timer.start();
+  vtkNew<vtkMRMLScene> scene;
+  QStringList errors;
+  QStringList nodeIDs = qSlicerLITTPlanV2TransformFileReader::importDirectory(
+    directory, scene.GetPointer(), &errors);
+  const qint64 importTime = timer.nsecsElapsed();
+
+  timer.restart();
+  vtkNew<vtkMRMLScene> referenceScene;
+  vtkNew<vtkSlicerTransformLogic> transformLogic;
+  QStringList referenceNodeIDs;
+  foreach(const QString& transformFileName, fileNames)
+    {
+    vtkMRMLTransformNode* node = transformLogic->AddTransform(
+      transformFileName.toLatin1(), referenceScene.GetPointer());
+    referenceNodeIDs << (node ? node->GetID() : "");
+    }
+  const qint64 referenceTime = timer.nsecsElapsed();
+
+  foreach(const QString& transformFileName, fileNames)
+    {
+    QFile::remove(transformFileName);
+    }
+  QDir().rmdir(directory);
+
+  if (printTimings)
+    {
+    std::cout << numberOfFiles << " files imported in "
+              << importTime / 1e6 << " ms, "
+              << referenceTime / 1e6 << " ms with AddTransform (x"
+              << static_cast<double>(referenceTime) / qMax(importTime, qint64(1))
+              << ")" << std::endl;
+    }
+
+  if (!errors.isEmpty() || nodeIDs.count() != numberOfFiles ||
+      referenceNodeIDs.count() != numberOfFiles)
+    {
+    std::cerr << "Line " << __LINE__ << " - Import failed: "
+              << nodeIDs.count() << " nodes, "
+              << qPrintable(errors.join("\n")) << std::endl;
+    return EXIT_FAILURE;
+    }
+  for (int i = 0; i < numberOfFiles; ++i)
+    {
+    vtkMRMLLinearTransformNode* node = vtkMRMLLinearTransformNode::SafeDownCast(
+      scene->GetNodeByID(nodeIDs[i].toLatin1()));
+    vtkMRMLLinearTransformNode* referenceNode =
+      vtkMRMLLinearTransformNode::SafeDownCast(
+        referenceScene->GetNodeByID(referenceNodeIDs[i].toLatin1()));
+    if (!node || !referenceNode ||
+        !compareMatrices(node->GetMatrixTransformToParent(),
+                         referenceNode->GetMatrixTransformToParent(), __LINE__))
+      {
+      return EXIT_FAILURE;
+      }
+    if (QString(node->GetName()) != referenceNode->GetName() ||
+        !node->GetStorageNode())
+      {
+      std::cerr << "Line " << __LINE__ << " - Wrong node " << node->GetName()
+                << " instead of " << referenceNode->GetName() << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  // Names are unique in the scene
+  QString nodeID = qSlicerLITTPlanV2TransformFileReader::addTransformNode(
+    file, scene.GetPointer());
+  QString otherNodeID = qSlicerLITTPlanV2TransformFileReader::addTransformNode(
+    file, scene.GetPointer());
+  vtkMRMLNode* node = scene->GetNodeByID(nodeID.toLatin1());
+  vtkMRMLNode* otherNode = scene->GetNodeByID(otherNodeID.toLatin1());
+  if (!node || !otherNode || QString(node->GetName()) == otherNode->GetName())
+    {
+    std::cerr << "Line " << __LINE__ << " - Names not unique" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Composite transforms are not added by the reader...
+  qSlicerLITTPlanV2TransformFileReader::File compositeFile;
+  compositeFile.FileName = "composite.tfm";
+  qSlicerLITTPlanV2TransformFileReader::parse(
+    multipleTransforms, multipleTransforms + sizeof(multipleTransforms) - 1,
+    compositeFile.Transforms);
+  if (compositeFile.Transforms.count() != 2 ||
+      !qSlicerLITTPlanV2TransformFileReader::addTransformNode(
+        compositeFile, scene.GetPointer()).isEmpty())
+    {
+    std::cerr << "Line " << __LINE__ << " - Composite transform added"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // ...but imported with vtkSlicerTransformLogic
+  QDir().mkpath(directory);
+  const QString compositeFileName = QDir(directory).filePath("composite.tfm");
+  QFile composite(compositeFileName);
+  composite.open(QIODevice::WriteOnly);
+  composite.write(multipleTransforms, sizeof(multipleTransforms) - 1);
+  composite.close();
+  vtkNew<vtkMRMLScene> compositeScene;
+  errors.clear();
+  nodeIDs = qSlicerLITTPlanV2TransformFileReader::importDirectory(
+    directory, compositeScene.GetPointer(), &errors);
+  QFile::remove(compositeFileName);
+  if (!errors.isEmpty() || nodeIDs.count() != 1 ||
+      !vtkMRMLTransformNode::SafeDownCast(
+        compositeScene->GetNodeByID(nodeIDs[0].toLatin1())))
+    {
+    std::cerr << "Line " << __LINE__ << " - Composite file not imported: "
+              << qPrintable(errors.join("\n")) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Files without transform are reported as such
+  const QString emptyFileName = QDir(directory).filePath("empty.tfm");
+  QFile empty(emptyFileName);
+  empty.open(QIODevice::WriteOnly);
+  empty.write("#Insight Transform File V1.0\n");
+  empty.close();
+  errors.clear();
+  nodeIDs = qSlicerLITTPlanV2TransformFileReader::importFiles(
+    QStringList() << emptyFileName, compositeScene.GetPointer(), &errors);
+  QFile::remove(emptyFileName);
+  QDir().rmdir(directory);
+  if (!nodeIDs.isEmpty() || errors.count() != 1 ||
+      !errors[0].endsWith(": No transform"))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong error for an empty file: "
+              << qPrintable(errors.join("\n")) << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// LITTPlanV2 includes
+#include "vtkLITTPlanV2ModelHardener.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPolyData.h>
+#include <vtkSphereSource.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+//----------------------------------------------------------------------------
+bool checkPoints(vtkPolyData* reference, vtkMatrix4x4* matrix,
+                 vtkPolyData* polyData, int line)
+{
+  for (vtkIdType i = 0; i < reference->GetNumberOfPoints(); ++i)
+    {
+    double in[4] = {0., 0., 0., 1.};
+    reference->GetPoint(i, in);
+    double expected[4];
+    matrix->MultiplyPoint(in, expected);
+    double* point = polyData->GetPoint(i);
+    for (int c = 0; c < 3; ++c)
+      {
+      if (fabs(point[c] - expected[c]) > 1e-4)
+        {
+        std::cerr << "Line " << line << " - Wrong point " << i << ": "
+                  << point[c] << " instead of " << expected[c] << std::endl;
+        return false;
+        }
+      }
+    }
+  return true;
+}
+}
+
+//----------------------------------------------------------------------------
+int vtkLITTPlanV2ModelHardenerTest1(int vtkNotUsed(argc),
+                                    char * vtkNotUsed(argv)[])
+{
+  vtkNew<vtkSphereSource> sphere;
+  sphere->SetThetaResolution(32);
+  sphere->SetPhiResolution(32);
+  sphere->Update();
+  vtkNew<vtkPolyData> original;
+  original->DeepCopy(sphere->GetOutput());
+
+  vtkNew<vtkMRMLScene> scene;
+  vtkNew<vtkMRMLLinearTransformNode> transform;
+  scene->AddNode(transform.GetPointer());
+  vtkNew<vtkPolyData> polyData;
+  polyData->DeepCopy(original.GetPointer());
+  vtkNew<vtkMRMLModelNode> model;
+  model->SetAndObservePolyData(polyData.GetPointer());
+  scene->AddNode(model.GetPointer());
+  model->SetAndObserveTransformNodeID(transform->GetID());
+
+  vtkMatrix4x4* matrix = transform->GetMatrixTransformToParent();
+  matrix->SetElement(0, 3, 10.);
+  matrix->SetElement(1, 3, -5.);
+
+  vtkNew<vtkLITTPlanV2ModelHardener> hardener;
+  // Small chunks to exercise the chunking with several threads
+  hardener->SetChunkSize(100);
+  hardener->SetNumberOfThreads(4);
+  if (!hardener->Harden(model.GetPointer(), transform.GetPointer()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Harden failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (model->GetParentTransformNode() != 0 ||
+      !checkPoints(original.GetPointer(), matrix, polyData.GetPointer(),
+                   __LINE__))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong hardening" << std::endl;
+    return EXIT_FAILURE;
+    }
+  vtkNew<vtkMatrix4x4> hardened;
+  if (!vtkLITTPlanV2ModelHardener::GetHardenedMatrix(model.GetPointer(),
+                                                     hardened.GetPointer()) ||
+      hardened->GetElement(0, 3) != 10.)
+    {
+    std::cerr << "Line " << __LINE__ << " - Matrix not recorded" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Edit the transform: only the delta is applied to the hardened model
+  matrix->SetElement(0, 0, 0.);
+  matrix->SetElement(0, 1, -1.);
+  matrix->SetElement(1, 0, 1.);
+  matrix->SetElement(1, 1, 0.);
+  if (hardener->UpdateHardenedModels(scene.GetPointer(),
+                                     transform.GetPointer()) != 1 ||
+      !checkPoints(original.GetPointer(), matrix, polyData.GetPointer(),
+                   __LINE__))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong update" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // Normals are rotated too
+  double* normal = polyData->GetPointData()->GetNormals()->GetTuple3(0);
+  double* originalNormal = original->GetPointData()->GetNormals()->GetTuple3(0);
+  if (fabs(normal[0] + originalNormal[1]) > 1e-5 ||
+      fabs(normal[1] - originalNormal[0]) > 1e-5)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong normals" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // Nothing to do if the transform didn't change
+  if (hardener->UpdateHardenedModels(scene.GetPointer(),
+                                     transform.GetPointer()) != 0)
+    {
+    std::cerr << "Line " << __LINE__ << " - Unnecessary update" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Model under a child of the transform: the child is baked too
+  vtkNew<vtkMRMLLinearTransformNode> child;
+  scene->AddNode(child.GetPointer());
+  child->SetAndObserveTransformNodeID(transform->GetID());
+  child->GetMatrixTransformToParent()->SetElement(2, 3, 7.);
+  vtkNew<vtkPolyData> nestedPolyData;
+  nestedPolyData->DeepCopy(original.GetPointer());
+  vtkNew<vtkMRMLModelNode> nestedModel;
+  nestedModel->SetAndObservePolyData(nestedPolyData.GetPointer());
+  scene->AddNode(nestedModel.GetPointer());
+  nestedModel->SetAndObserveTransformNodeID(child->GetID());
+  vtkNew<vtkMatrix4x4> childToWorld;
+  child->GetMatrixTransformToWorld(childToWorld.GetPointer());
+  if (!hardener->Harden(nestedModel.GetPointer(), transform.GetPointer()) ||
+      !checkPoints(original.GetPointer(), childToWorld.GetPointer(),
+                   nestedPolyData.GetPointer(), __LINE__))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong nested hardening" << std::endl;
+    return EXIT_FAILURE;
+    }
+  // and editing the transform moves it with its child
+  matrix->SetElement(1, 3, 12.);
+  child->GetMatrixTransformToWorld(childToWorld.GetPointer());
+  // The delta can be read without being applied
+  vtkNew<vtkMatrix4x4> delta;
+  if (!vtkLITTPlanV2ModelHardener::GetHardenedDelta(
+        nestedModel.GetPointer(), transform.GetPointer(), delta.GetPointer()) ||
+      fabs(delta->GetElement(1, 3) - 12.) > 1e-6 ||
+      fabs(delta->GetElement(0, 0) - 1.) > 1e-6 ||
+      vtkLITTPlanV2ModelHardener::GetHardenedDelta(
+        model.GetPointer(), child.GetPointer(), delta.GetPointer()))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong delta" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (hardener->UpdateHardenedModels(scene.GetPointer(),
+                                     transform.GetPointer()) != 2 ||
+      !checkPoints(original.GetPointer(), childToWorld.GetPointer(),
+                   nestedPolyData.GetPointer(), __LINE__) ||
+      !checkPoints(original.GetPointer(), matrix, polyData.GetPointer(),
+                   __LINE__))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong nested update" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Rounding errors don't accumulate over many edits: the updates start
+  // from the anchored geometry, not from the rounded points.
+  for (int i = 0; i < 2000; ++i)
+    {
+    vtkNew<vtkTransform> edit;
+    edit->Translate(100. + i % 3, -80., 50.);
+    edit->RotateWXYZ(7. * i, 1., 2., 3.);
+    matrix->DeepCopy(edit->GetMatrix());
+    hardener->UpdateHardenedModels(scene.GetPointer(), transform.GetPointer());
+    }
+  if (!checkPoints(original.GetPointer(), matrix, polyData.GetPointer(),
+                   __LINE__) ||
+      hardener->GetNumberOfAnchors() != 2)
+    {
+    std::cerr << "Line " << __LINE__ << " - Drift after many edits" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // A model that is not under the transform is left untouched
+  vtkNew<vtkMRMLLinearTransformNode> other;
+  scene->AddNode(other.GetPointer());
+  other->GetMatrixTransformToParent()->SetElement(0, 3, -30.);
+  vtkNew<vtkPolyData> otherPolyData;
+  otherPolyData->DeepCopy(original.GetPointer());
+  vtkNew<vtkMRMLModelNode> otherModel;
+  otherModel->SetAndObservePolyData(otherPolyData.GetPointer());
+  scene->AddNode(otherModel.GetPointer());
+  otherModel->SetAndObserveTransformNodeID(other->GetID());
+  vtkNew<vtkMatrix4x4> identity;
+  if (hardener->Harden(otherModel.GetPointer(), transform.GetPointer()) ||
+      otherModel->GetParentTransformNode() != other.GetPointer() ||
+      !checkPoints(original.GetPointer(), identity.GetPointer(),
+                   otherPolyData.GetPointer(), __LINE__))
+    {
+    std::cerr << "Line " << __LINE__ << " - Model not under the transform "
+              << "hardened" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// LITTPlanV2 includes
+#include "vtkLITTPlanV2ThermalDoseAccumulator.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+
+// STD includes
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+//----------------------------------------------------------------------------
+void fillFrame(vtkImageData* frame, double temperature, double gradient)
+{
+  int* dims = frame->GetDimensions();
+  for (int k = 0; k < dims[2]; ++k)
+    {
+    for (int j = 0; j < dims[1]; ++j)
+      {
+      for (int i = 0; i < dims[0]; ++i)
+        {
+        *static_cast<float*>(frame->GetScalarPointer(i, j, k)) =
+          static_cast<float>(temperature + gradient * i);
+        }
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+double value(vtkImageData* image, int i, int j, int k)
+{
+  return image->GetScalarComponentAsDouble(i, j, k, 0);
+}
+}
+
+//----------------------------------------------------------------------------
+int vtkLITTPlanV2ThermalDoseAccumulatorTest1(int vtkNotUsed(argc),
+                                             char * vtkNotUsed(argv)[])
+{
+  vtkNew<vtkImageData> frame;
+  frame->SetDimensions(4, 4, 4);
+  frame->SetScalarTypeToFloat();
+  frame->SetNumberOfScalarComponents(1);
+  frame->AllocateScalars();
+  fillFrame(frame.GetPointer(), 60., 0.);
+
+  vtkNew<vtkLITTPlanV2ThermalDoseAccumulator> accumulator;
+  accumulator->SetNumberOfThreads(3);
+  int dimensions[3] = {8, 8, 4};
+  accumulator->Initialize(dimensions);
+
+  // The frame covers the grid voxels i < 4 only
+  vtkNew<vtkMatrix4x4> gridIJKToFrameIJK;
+  for (int frameIndex = 0; frameIndex <= 10; ++frameIndex)
+    {
+    if (!accumulator->AddFrame(frame.GetPointer(),
+                               gridIJKToFrameIJK.GetPointer(), frameIndex))
+      {
+      std::cerr << "Line " << __LINE__ << " - Frame " << frameIndex
+                << " not accumulated" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+  if (accumulator->AddFrame(frame.GetPointer(),
+                            gridIJKToFrameIJK.GetPointer(), 5.) ||
+      accumulator->GetNumberOfFrames() != 11)
+    {
+    std::cerr << "Line " << __LINE__ << " - Older frame accumulated"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Constant temperature: the damage is the rate times the duration
+  const double heated = accumulator->DamageRate(60.) * 10.;
+  const double background = accumulator->DamageRate(37.) * 10.;
+  double damage = value(accumulator->GetDamage(), 2, 3, 1);
+  if (fabs(damage - heated) > 1e-6 * heated ||
+      fabs(value(accumulator->GetDamage(), 6, 3, 1) - background) >
+        1e-6 * background + 1e-12)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong damage: " << damage
+              << " instead of " << heated << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (heated < 1. || background > 1. ||
+      value(accumulator->GetLabelMap(), 2, 3, 1) != 1. ||
+      value(accumulator->GetLabelMap(), 6, 3, 1) != 0.)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong label map" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Registration: the frame is shifted by 4 voxels along i
+  accumulator->Initialize(dimensions);
+  gridIJKToFrameIJK->SetElement(0, 3, -4.);
+  accumulator->AddFrame(frame.GetPointer(), gridIJKToFrameIJK.GetPointer(), 0.);
+  accumulator->AddFrame(frame.GetPointer(), gridIJKToFrameIJK.GetPointer(), 10.);
+  if (value(accumulator->GetLabelMap(), 5, 0, 0) != 1. ||
+      value(accumulator->GetLabelMap(), 1, 0, 0) != 0. ||
+      fabs(value(accumulator->GetDamage(), 5, 0, 0) - heated) > 1e-6 * heated)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong registered damage: "
+              << value(accumulator->GetDamage(), 5, 0, 0) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Trilinear interpolation between the frame voxels
+  fillFrame(frame.GetPointer(), 40., 2.);
+  gridIJKToFrameIJK->Identity();
+  gridIJKToFrameIJK->SetElement(0, 0, 0.5);
+  accumulator->AddFrame(frame.GetPointer(), gridIJKToFrameIJK.GetPointer(), 11.);
+  if (fabs(value(accumulator->GetTemperature(), 1, 2, 2) - 41.) > 1e-4 ||
+      fabs(value(accumulator->GetTemperature(), 7, 2, 2) - 46.) > 1e-4)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong temperature: "
+              << value(accumulator->GetTemperature(), 1, 2, 2) << " "
+              << value(accumulator->GetTemperature(), 7, 2, 2) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
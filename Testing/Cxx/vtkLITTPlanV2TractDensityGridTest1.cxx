@@ -0,0 +1,134 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// LITTPlanV2 includes
+#include "vtkLITTPlanV2TractDensityGrid.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+// STD includes
+#include <cmath>
+#include <iostream>
+
+//----------------------------------------------------------------------------
+int vtkLITTPlanV2TractDensityGridTest1(int vtkNotUsed(argc),
+                                       char * vtkNotUsed(argv)[])
+{
+  // Bundle of streamlines along the x axis, around (y=0, z=0)
+  vtkNew<vtkPoints> points;
+  vtkNew<vtkCellArray> lines;
+  for (int line = 0; line < 5; ++line)
+    {
+    double y = -1. + 0.5 * line;
+    lines->InsertNextCell(11);
+    for (int i = 0; i <= 10; ++i)
+      {
+      lines->InsertCellPoint(points->InsertNextPoint(-20. + 4. * i, y, 0.));
+      }
+    }
+  vtkNew<vtkPolyData> tracts;
+  tracts->SetPoints(points.GetPointer());
+  tracts->SetLines(lines.GetPointer());
+
+  vtkNew<vtkLITTPlanV2TractDensityGrid> grid;
+  grid->SetInput(tracts.GetPointer());
+  grid->SetNumberOfThreads(4);
+  vtkNew<vtkMatrix4x4> inputToRAS;
+  grid->SetInputToRASMatrix(inputToRAS.GetPointer());
+  grid->Update();
+
+  double inside[3] = {0., 0., 0.};
+  double outside[3] = {0., 0., 10.};
+  if (grid->EvaluateDensity(inside) <= 0. ||
+      grid->EvaluateDensity(outside) != 0.)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong density: "
+              << grid->EvaluateDensity(inside) << " "
+              << grid->EvaluateDensity(outside) << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  double orientation[3];
+  if (!grid->EvaluateOrientation(inside, orientation) ||
+      fabs(fabs(orientation[0]) - 1.) > 1e-3)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong orientation: "
+              << orientation[0] << " " << orientation[1] << " "
+              << orientation[2] << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // A trajectory crossing the bundle costs more than one missing it
+  double entry[3] = {0., 0., 20.};
+  double target[3] = {0., 0., -5.};
+  double missingTarget[3] = {0., 0., 5.};
+  if (grid->EvaluateTrajectoryCost(entry, target) <=
+      grid->EvaluateTrajectoryCost(entry, missingTarget))
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong trajectory cost" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Moving the registration must not re-voxelize the streamlines, but the
+  // queries must follow the registration.
+  unsigned long gridTime = grid->GetOutput()->GetMTime();
+  double densityBefore = grid->EvaluateDensity(inside);
+  inputToRAS->SetElement(2, 3, 10.);
+  inputToRAS->SetElement(0, 0, 0.);
+  inputToRAS->SetElement(0, 1, -1.);
+  inputToRAS->SetElement(1, 0, 1.);
+  inputToRAS->SetElement(1, 1, 0.);
+  grid->Update();
+  if (grid->GetOutput()->GetMTime() != gridTime)
+    {
+    std::cerr << "Line " << __LINE__ << " - Grid was rebuilt" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (fabs(grid->EvaluateDensity(outside) - densityBefore) > 1e-6 ||
+      grid->EvaluateDensity(inside) != 0.)
+    {
+    std::cerr << "Line " << __LINE__ << " - Registration not applied: "
+              << grid->EvaluateDensity(outside) << std::endl;
+    return EXIT_FAILURE;
+    }
+  // The bundle is now along the RAS y axis
+  if (!grid->EvaluateOrientation(outside, orientation) ||
+      fabs(fabs(orientation[1]) - 1.) > 1e-3)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong registered orientation: "
+              << orientation[0] << " " << orientation[1] << " "
+              << orientation[2] << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Modifying the streamlines triggers a re-voxelization
+  points->Modified();
+  grid->Update();
+  if (grid->GetOutput()->GetMTime() == gridTime)
+    {
+    std::cerr << "Line " << __LINE__ << " - Grid not rebuilt" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
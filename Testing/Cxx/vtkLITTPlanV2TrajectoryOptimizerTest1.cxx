@@ -0,0 +1,158 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// LITTPlanV2 includes
+#include "vtkLITTPlanV2TrajectoryOptimizer.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkSphereSource.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+//----------------------------------------------------------------------------
+int vtkLITTPlanV2TrajectoryOptimizerTest1(int argc, char * argv[])
+{
+  // The search timings are only reported with --timing (never under ctest)
+  const bool printTimings = argc > 1 && strcmp(argv[1], "--timing") == 0;
+
+  // Spherical skull centered on the target: without the length and skull
+  // angle terms (sensitive to the tessellation), only the coverage term
+  // differs between the trajectories.
+  vtkNew<vtkSphereSource> skull;
+  skull->SetRadius(80.);
+  skull->SetThetaResolution(64);
+  skull->SetPhiResolution(64);
+  skull->Update();
+
+  vtkNew<vtkLITTPlanV2TrajectoryOptimizer> optimizer;
+  optimizer->SetSkull(skull->GetOutput());
+  optimizer->SetTarget(0., 0., 0.);
+  optimizer->SetTumorAxis(0., 0.6, 0.8);
+  optimizer->SetLengthWeight(0.);
+  optimizer->SetSkullAngleWeight(0.);
+  optimizer->SetNumberOfSamples(500);
+  optimizer->SetNumberOfThreads(4);
+  if (!optimizer->Optimize())
+    {
+    std::cerr << "Line " << __LINE__ << " - Optimize failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  double* direction = optimizer->GetDirection();
+  double alignment = fabs(0.6 * direction[1] + 0.8 * direction[2]);
+  if (!optimizer->GetConverged() || alignment < 0.9999)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong trajectory: "
+              << direction[0] << " " << direction[1] << " " << direction[2]
+              << " converged: " << optimizer->GetConverged() << std::endl;
+    return EXIT_FAILURE;
+    }
+  double* entry = optimizer->GetEntry();
+  double radius = sqrt(entry[0] * entry[0] + entry[1] * entry[1] +
+                       entry[2] * entry[2]);
+  if (radius < 79. || radius > 80.001)
+    {
+    std::cerr << "Line " << __LINE__ << " - Entry not on the skull: "
+              << radius << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (optimizer->GetCoarseSearchTime() < 0. ||
+      optimizer->GetRefinementTime() < 0.)
+    {
+    std::cerr << "Line " << __LINE__ << " - Wrong timings" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // The threads of the coarse search don't wait for each other: same
+  // result with a single thread, in more time.
+  const double parallelTime = optimizer->GetCoarseSearchTime();
+  const double parallelCost = optimizer->GetCost();
+  optimizer->SetNumberOfThreads(1);
+  optimizer->Optimize();
+  if (optimizer->GetCost() != parallelCost)
+    {
+    std::cerr << "Line " << __LINE__ << " - Cost depends on the threads: "
+              << optimizer->GetCost() << " != " << parallelCost << std::endl;
+    return EXIT_FAILURE;
+    }
+  if (printTimings)
+    {
+    std::cout << "Coarse search: " << optimizer->GetCoarseSearchTime()
+              << "s with 1 thread, " << parallelTime << "s with 4 threads (x"
+              << optimizer->GetCoarseSearchTime() / std::max(parallelTime, 1e-9)
+              << ")" << std::endl;
+    }
+  optimizer->SetNumberOfThreads(4);
+  optimizer->Optimize();
+  direction = optimizer->GetDirection();
+
+  vtkNew<vtkMatrix4x4> pose;
+  optimizer->GetTrajectoryMatrix(pose.GetPointer());
+  for (int i = 0; i < 3; ++i)
+    {
+    if (fabs(pose->GetElement(i, 2) - direction[i]) > 1e-12)
+      {
+      std::cerr << "Line " << __LINE__ << " - Wrong pose" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  // A critical structure along the tumor axis, above the target, pushes the
+  // trajectory to the other side.
+  vtkNew<vtkImageData> distanceMap;
+  distanceMap->SetDimensions(41, 41, 41);
+  distanceMap->SetScalarTypeToDouble();
+  distanceMap->AllocateScalars();
+  for (int k = 0; k < 41; ++k)
+    {
+    for (int j = 0; j < 41; ++j)
+      {
+      for (int i = 0; i < 41; ++i)
+        {
+        // IJK (20,32,36) is RAS (0, 24, 32), on the axis 40mm away
+        double d = sqrt(double((i - 20) * (i - 20) + (j - 32) * (j - 32) +
+                               (k - 36) * (k - 36))) * 2.;
+        distanceMap->SetScalarComponentFromDouble(i, j, k, 0, d);
+        }
+      }
+    }
+  // 2mm voxels, centered on the target
+  vtkNew<vtkMatrix4x4> rasToIJK;
+  for (int i = 0; i < 3; ++i)
+    {
+    rasToIJK->SetElement(i, i, 0.5);
+    rasToIJK->SetElement(i, 3, 20.);
+    }
+  optimizer->SetClearanceMap(distanceMap.GetPointer(), rasToIJK.GetPointer());
+  optimizer->Optimize();
+  direction = optimizer->GetDirection();
+  if (0.6 * direction[1] + 0.8 * direction[2] > -0.99)
+    {
+    std::cerr << "Line " << __LINE__ << " - Critical structure not avoided: "
+              << direction[0] << " " << direction[1] << " " << direction[2]
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,368 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QDebug>
+#include <QHash>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2CoordinateReferenceEngine.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+
+// VTK includes
+#include <vtkCommand.h>
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+#include <vtkWeakPointer.h>
+
+//-----------------------------------------------------------------------------
+class qSlicerLITTPlanV2CoordinateReferenceEnginePrivate
+{
+  Q_DECLARE_PUBLIC(qSlicerLITTPlanV2CoordinateReferenceEngine);
+protected:
+  qSlicerLITTPlanV2CoordinateReferenceEngine* const q_ptr;
+public:
+  typedef qSlicerLITTPlanV2CoordinateReferenceEngine Engine;
+  struct Entry
+  {
+    Entry() : UpToDate(false), Linear(false) {}
+    vtkSmartPointer<vtkMatrix4x4> ToWorld;
+    vtkSmartPointer<vtkMatrix4x4> FromWorld;
+    bool UpToDate;
+    bool Linear;
+  };
+  qSlicerLITTPlanV2CoordinateReferenceEnginePrivate(
+    qSlicerLITTPlanV2CoordinateReferenceEngine& object);
+
+  /// Return the up to date entry of the node, 0 if its transform to world
+  /// is not linear. The entries of the ancestors are updated on the way.
+  const Entry* entry(vtkMRMLTransformNode* node);
+  /// Transform from the reference to RAS and its inverse, 0 if unavailable
+  vtkMatrix4x4* toWorld(Engine::Reference reference, vtkMRMLTransformNode* node,
+                        bool inverse);
+
+  QHash<vtkMRMLTransformNode*, Entry> Entries;
+  vtkWeakPointer<vtkMRMLTransformNode> ReferenceNodes[Engine::NumberOfReferences];
+  vtkSmartPointer<vtkMatrix4x4> Identity;
+};
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2CoordinateReferenceEnginePrivate
+::qSlicerLITTPlanV2CoordinateReferenceEnginePrivate(
+  qSlicerLITTPlanV2CoordinateReferenceEngine& object)
+  : q_ptr(&object)
+{
+  this->Identity = vtkSmartPointer<vtkMatrix4x4>::New();
+}
+
+//-----------------------------------------------------------------------------
+const qSlicerLITTPlanV2CoordinateReferenceEnginePrivate::Entry*
+qSlicerLITTPlanV2CoordinateReferenceEnginePrivate::entry(vtkMRMLTransformNode* node)
+{
+  Q_Q(qSlicerLITTPlanV2CoordinateReferenceEngine);
+  QHash<vtkMRMLTransformNode*, Entry>::iterator it = this->Entries.find(node);
+  if (it == this->Entries.end())
+    {
+    // Modifications of the node and of its ancestors are propagated down
+    // the tree as TransformModifiedEvent, reparenting too. The high
+    // priority invalidates the cache before the other observers use it.
+    q->qvtkConnect(node, vtkMRMLTransformableNode::TransformModifiedEvent,
+                   q, SLOT(onTransformModified(vtkObject*)), 10.);
+    q->qvtkConnect(node, vtkCommand::DeleteEvent,
+                   q, SLOT(onNodeDeleted(vtkObject*)));
+    Entry newEntry;
+    newEntry.ToWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+    newEntry.FromWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+    it = this->Entries.insert(node, newEntry);
+    }
+  if (!it->UpToDate)
+    {
+    // Reuse the cached transform to world of the parent
+    vtkMRMLLinearTransformNode* linearNode =
+      vtkMRMLLinearTransformNode::SafeDownCast(node);
+    vtkMRMLTransformNode* parent = node->GetParentTransformNode();
+    const Entry* parentEntry = parent ? this->entry(parent) : 0;
+    // this->Entries may have been rehashed by the recursion
+    it = this->Entries.find(node);
+    it->Linear = linearNode && (!parent || parentEntry);
+    if (it->Linear)
+      {
+      vtkMatrix4x4::Multiply4x4(
+        parentEntry ? parentEntry->ToWorld.GetPointer() : this->Identity.GetPointer(),
+        linearNode->GetMatrixTransformToParent(), it->ToWorld);
+      vtkMatrix4x4::Invert(it->ToWorld, it->FromWorld);
+      }
+    it->UpToDate = true;
+    }
+  return it->Linear ? &it.value() : 0;
+}
+
+//-----------------------------------------------------------------------------
+vtkMatrix4x4* qSlicerLITTPlanV2CoordinateReferenceEnginePrivate::toWorld(
+  Engine::Reference reference, vtkMRMLTransformNode* node, bool inverse)
+{
+  switch (reference)
+    {
+    case Engine::World:
+      return this->Identity;
+    case Engine::Parent:
+      node = node ? node->GetParentTransformNode() : 0;
+      if (!node)
+        {
+        return this->Identity;
+        }
+      break;
+    case Engine::StereotacticFrame:
+    case Engine::ACPC:
+    case Engine::Tracker:
+      node = this->ReferenceNodes[reference];
+      if (!node)
+        {
+        return 0;
+        }
+      break;
+    default:
+      return 0;
+    }
+  const Entry* nodeEntry = this->entry(node);
+  if (!nodeEntry)
+    {
+    return 0;
+    }
+  return inverse ? nodeEntry->FromWorld : nodeEntry->ToWorld;
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2CoordinateReferenceEngine::qSlicerLITTPlanV2CoordinateReferenceEngine(QObject* _parent)
+  : Superclass(_parent)
+  , d_ptr(new qSlicerLITTPlanV2CoordinateReferenceEnginePrivate(*this))
+{
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2CoordinateReferenceEngine::~qSlicerLITTPlanV2CoordinateReferenceEngine()
+{
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2CoordinateReferenceEngine::setReferenceNode(
+  Reference reference, vtkMRMLTransformNode* node)
+{
+  Q_D(qSlicerLITTPlanV2CoordinateReferenceEngine);
+  if (reference != StereotacticFrame && reference != ACPC &&
+      reference != Tracker)
+    {
+    qWarning() << "qSlicerLITTPlanV2CoordinateReferenceEngine::setReferenceNode:"
+               << "the reference" << reference << "has no node";
+    return;
+    }
+  d->ReferenceNodes[reference] = node;
+}
+
+//-----------------------------------------------------------------------------
+vtkMRMLTransformNode* qSlicerLITTPlanV2CoordinateReferenceEngine
+::referenceNode(Reference reference)const
+{
+  Q_D(const qSlicerLITTPlanV2CoordinateReferenceEngine);
+  if (reference < 0 || reference >= NumberOfReferences)
+    {
+    return 0;
+    }
+  return d->ReferenceNodes[reference];
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2CoordinateReferenceEngine
+::isReferenceAvailable(Reference reference)const
+{
+  return reference == World || reference == Parent ||
+    this->referenceNode(reference) != 0;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2CoordinateReferenceEngine::parentToWorld(
+  vtkMRMLTransformNode* node, vtkMatrix4x4* matrix)
+{
+  return this->referenceToWorld(Parent, matrix, node);
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2CoordinateReferenceEngine::worldToParent(
+  vtkMRMLTransformNode* node, vtkMatrix4x4* matrix)
+{
+  return this->worldToReference(Parent, matrix, node);
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2CoordinateReferenceEngine::referenceToWorld(
+  Reference reference, vtkMatrix4x4* matrix, vtkMRMLTransformNode* node)
+{
+  Q_D(qSlicerLITTPlanV2CoordinateReferenceEngine);
+  vtkMatrix4x4* toWorld = d->toWorld(reference, node, false);
+  if (!toWorld || !matrix)
+    {
+    return false;
+    }
+  matrix->DeepCopy(toWorld);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2CoordinateReferenceEngine::worldToReference(
+  Reference reference, vtkMatrix4x4* matrix, vtkMRMLTransformNode* node)
+{
+  Q_D(qSlicerLITTPlanV2CoordinateReferenceEngine);
+  vtkMatrix4x4* fromWorld = d->toWorld(reference, node, true);
+  if (!fromWorld || !matrix)
+    {
+    return false;
+    }
+  matrix->DeepCopy(fromWorld);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2CoordinateReferenceEngine::referenceToReference(
+  Reference from, Reference to, vtkMatrix4x4* matrix, vtkMRMLTransformNode* node)
+{
+  Q_D(qSlicerLITTPlanV2CoordinateReferenceEngine);
+  vtkMatrix4x4* fromToWorld = d->toWorld(from, node, false);
+  vtkMatrix4x4* worldToTo = d->toWorld(to, node, true);
+  if (!fromToWorld || !worldToTo || !matrix)
+    {
+    return false;
+    }
+  vtkMatrix4x4::Multiply4x4(worldToTo, fromToWorld, matrix);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2CoordinateReferenceEngine::transformInReference(
+  vtkMRMLTransformNode* node, Reference reference, vtkMatrix4x4* matrix)
+{
+  vtkMRMLLinearTransformNode* linearNode =
+    vtkMRMLLinearTransformNode::SafeDownCast(node);
+  if (!linearNode || !matrix)
+    {
+    return false;
+    }
+  if (reference == Parent)
+    {
+    matrix->DeepCopy(linearNode->GetMatrixTransformToParent());
+    return true;
+    }
+  // M = (reference to parent)^-1 . T . (reference to parent)
+  vtkSmartPointer<vtkMatrix4x4> referenceToParent =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> parentToReference =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  if (!this->referenceToReference(reference, Parent, referenceToParent, node) ||
+      !this->referenceToReference(Parent, reference, parentToReference, node))
+    {
+    return false;
+    }
+  vtkSmartPointer<vtkMatrix4x4> transformedToParent =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Multiply4x4(linearNode->GetMatrixTransformToParent(),
+                            referenceToParent, transformedToParent);
+  vtkMatrix4x4::Multiply4x4(parentToReference, transformedToParent, matrix);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2CoordinateReferenceEngine::setTransformInReference(
+  vtkMRMLTransformNode* node, Reference reference, vtkMatrix4x4* matrix)
+{
+  vtkMRMLLinearTransformNode* linearNode =
+    vtkMRMLLinearTransformNode::SafeDownCast(node);
+  if (!linearNode || !matrix)
+    {
+    return false;
+    }
+  if (reference == Parent)
+    {
+    linearNode->GetMatrixTransformToParent()->DeepCopy(matrix);
+    return true;
+    }
+  // T = (reference to parent) . M . (reference to parent)^-1
+  vtkSmartPointer<vtkMatrix4x4> referenceToParent =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> parentToReference =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  if (!this->referenceToReference(reference, Parent, referenceToParent, node) ||
+      !this->referenceToReference(Parent, reference, parentToReference, node))
+    {
+    return false;
+    }
+  vtkSmartPointer<vtkMatrix4x4> parentToTransformed =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Multiply4x4(matrix, parentToReference, parentToTransformed);
+  vtkSmartPointer<vtkMatrix4x4> toParent = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Multiply4x4(referenceToParent, parentToTransformed, toParent);
+  linearNode->GetMatrixTransformToParent()->DeepCopy(toParent);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2CoordinateReferenceEngine::clearCache()
+{
+  Q_D(qSlicerLITTPlanV2CoordinateReferenceEngine);
+  foreach(vtkMRMLTransformNode* node, d->Entries.keys())
+    {
+    this->qvtkDisconnect(node, vtkMRMLTransformableNode::TransformModifiedEvent,
+                         this, SLOT(onTransformModified(vtkObject*)));
+    this->qvtkDisconnect(node, vtkCommand::DeleteEvent,
+                         this, SLOT(onNodeDeleted(vtkObject*)));
+    }
+  d->Entries.clear();
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerLITTPlanV2CoordinateReferenceEngine::numberOfCachedNodes()const
+{
+  Q_D(const qSlicerLITTPlanV2CoordinateReferenceEngine);
+  int count = 0;
+  foreach(const qSlicerLITTPlanV2CoordinateReferenceEnginePrivate::Entry& entry,
+          d->Entries)
+    {
+    count += entry.UpToDate ? 1 : 0;
+    }
+  return count;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2CoordinateReferenceEngine::onTransformModified(vtkObject* caller)
+{
+  Q_D(qSlicerLITTPlanV2CoordinateReferenceEngine);
+  QHash<vtkMRMLTransformNode*,
+        qSlicerLITTPlanV2CoordinateReferenceEnginePrivate::Entry>::iterator it =
+    d->Entries.find(vtkMRMLTransformNode::SafeDownCast(caller));
+  if (it != d->Entries.end())
+    {
+    it->UpToDate = false;
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2CoordinateReferenceEngine::onNodeDeleted(vtkObject* caller)
+{
+  Q_D(qSlicerLITTPlanV2CoordinateReferenceEngine);
+  // The node is being destroyed, SafeDownCast can't be used
+  d->Entries.remove(static_cast<vtkMRMLTransformNode*>(caller));
+}
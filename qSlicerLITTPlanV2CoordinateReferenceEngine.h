@@ -0,0 +1,116 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __qSlicerLITTPlanV2CoordinateReferenceEngine_h
+#define __qSlicerLITTPlanV2CoordinateReferenceEngine_h
+
+// Qt includes
+#include <QObject>
+
+// CTK includes
+#include <ctkVTKObject.h>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModuleExport.h"
+
+class qSlicerLITTPlanV2CoordinateReferenceEnginePrivate;
+class vtkMatrix4x4;
+class vtkMRMLTransformNode;
+class vtkObject;
+
+/// \ingroup Slicer_QtModules_LITTPlanV2
+/// Conversions of transforms between coordinate references.
+///
+/// The transform to world (and its inverse) of the transform nodes is
+/// cached per node and invalidated when the node or one of its ancestors
+/// is modified or reparented, so that a conversion is a couple of matrix
+/// products instead of a walk up the transform tree.
+///
+/// Besides RAS (World) and the parent of a transform (Parent), the
+/// stereotactic frame, the AC-PC coordinates and the tracker are available
+/// once the transform node placing them in RAS is set.
+class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT qSlicerLITTPlanV2CoordinateReferenceEngine
+  : public QObject
+{
+  Q_OBJECT
+  QVTK_OBJECT
+public:
+  typedef QObject Superclass;
+  qSlicerLITTPlanV2CoordinateReferenceEngine(QObject* parent = 0);
+  virtual ~qSlicerLITTPlanV2CoordinateReferenceEngine();
+
+  enum Reference
+    {
+    World = 0,
+    Parent,
+    StereotacticFrame,
+    ACPC,
+    Tracker,
+    NumberOfReferences
+    };
+
+  /// Set the transform node whose transform to world maps the coordinates
+  /// of the reference into RAS. Only for StereotacticFrame, ACPC and
+  /// Tracker.
+  void setReferenceNode(Reference reference, vtkMRMLTransformNode* node);
+  vtkMRMLTransformNode* referenceNode(Reference reference)const;
+  /// Return true if the reference can be used: World and Parent always,
+  /// the other references once their node is set.
+  bool isReferenceAvailable(Reference reference)const;
+
+  /// Transform from the parent of the node to RAS (identity for a top
+  /// level node). Returns false if the transform is not linear.
+  bool parentToWorld(vtkMRMLTransformNode* node, vtkMatrix4x4* matrix);
+  bool worldToParent(vtkMRMLTransformNode* node, vtkMatrix4x4* matrix);
+
+  /// Transform from the reference to RAS. node is used by Parent only.
+  bool referenceToWorld(Reference reference, vtkMatrix4x4* matrix,
+                        vtkMRMLTransformNode* node = 0);
+  bool worldToReference(Reference reference, vtkMatrix4x4* matrix,
+                        vtkMRMLTransformNode* node = 0);
+  /// Transform from the coordinates of one reference to another
+  bool referenceToReference(Reference from, Reference to,
+                            vtkMatrix4x4* matrix,
+                            vtkMRMLTransformNode* node = 0);
+
+  /// Matrix of the transform to parent of the node, expressed in the
+  /// reference: the motion the node applies, seen from the reference.
+  bool transformInReference(vtkMRMLTransformNode* node, Reference reference,
+                            vtkMatrix4x4* matrix);
+  /// Set the transform to parent of the node so that the motion it applies
+  /// is the matrix expressed in the reference.
+  bool setTransformInReference(vtkMRMLTransformNode* node, Reference reference,
+                               vtkMatrix4x4* matrix);
+
+  /// Drop all the cached matrices
+  void clearCache();
+  /// Number of nodes whose matrices are cached and up to date
+  int numberOfCachedNodes()const;
+
+protected slots:
+  void onTransformModified(vtkObject* caller);
+  void onNodeDeleted(vtkObject* caller);
+
+protected:
+  QScopedPointer<qSlicerLITTPlanV2CoordinateReferenceEnginePrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(qSlicerLITTPlanV2CoordinateReferenceEngine);
+  Q_DISABLE_COPY(qSlicerLITTPlanV2CoordinateReferenceEngine);
+};
+
+#endif
@@ -19,10 +19,14 @@
 ==============================================================================*/
 
 // Qt includes
+#include <QFileInfo>
 
 // SlicerQt includes
 #include "qSlicerLITTPlanV2IO.h"
 
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2TransformFileReader.h"
+
 // Logic includes
 #include "vtkSlicerTransformLogic.h"
 
@@ -93,6 +97,21 @@ bool qSlicerLITTPlanV2IO::load(const IOProperties& properties)
   Q_ASSERT(properties.contains("fileName"));
   QString fileName = properties["fileName"].toString();
 
+  // ITK text files of a single linear transform are parsed by the fast
+  // reader. The others (composite, non linear) are read by the logic.
+  QString suffix = QFileInfo(fileName).suffix().toLower();
+  if (suffix == "tfm" || suffix == "txt")
+    {
+    QString nodeID = qSlicerLITTPlanV2TransformFileReader::addTransformNode(
+      qSlicerLITTPlanV2TransformFileReader::readFile(fileName),
+      this->mrmlScene());
+    if (!nodeID.isEmpty())
+      {
+      this->setLoadedNodes(QStringList(nodeID));
+      return true;
+      }
+    }
+
   if (d->TransformLogic.GetPointer() == 0)
     {
     return false;
@@ -0,0 +1,477 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QFutureWatcher>
+#include <QHash>
+#include <QtConcurrentRun>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModelProxyManager.h"
+
+// MRML includes
+#include <vtkMRMLModelDisplayNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkMaskPolyData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataNormals.h>
+#include <vtkQuadricDecimation.h>
+#include <vtkSmartPointer.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+#include <vtkTriangleFilter.h>
+#include <vtkWeakPointer.h>
+
+namespace
+{
+//-----------------------------------------------------------------------------
+/// Decimate and release the input, run in a background thread.
+vtkPolyData* decimateCopy(vtkPolyData* input, double targetReduction)
+{
+  vtkPolyData* proxy =
+    qSlicerLITTPlanV2ModelProxyManager::decimate(input, targetReduction);
+  input->Delete();
+  return proxy;
+}
+
+//-----------------------------------------------------------------------------
+/// Set the polydata displayed by the model display nodes
+void setDisplayedPolyData(vtkMRMLModelNode* model, vtkPolyData* polyData)
+{
+  for (int i = 0; i < model->GetNumberOfDisplayNodes(); ++i)
+    {
+    vtkMRMLModelDisplayNode* displayNode =
+      vtkMRMLModelDisplayNode::SafeDownCast(model->GetNthDisplayNode(i));
+    if (displayNode)
+      {
+      displayNode->SetInputPolyData(polyData);
+      }
+    }
+}
+
+typedef QFutureWatcher<vtkPolyData*> ProxyWatcher;
+}
+
+//-----------------------------------------------------------------------------
+class qSlicerLITTPlanV2ModelProxyManagerPrivate
+{
+public:
+  struct Proxy
+  {
+    Proxy() : SourceMTime(0), Watcher(0), Swapped(false) {}
+    vtkWeakPointer<vtkMRMLModelNode> Model;
+    /// Full resolution polydata the proxy is computed from, not kept alive
+    vtkWeakPointer<vtkPolyData> Source;
+    unsigned long SourceMTime;
+    vtkSmartPointer<vtkPolyData> Decimated;
+    /// Transform of the decimated polydata, its output is displayed
+    vtkSmartPointer<vtkTransformPolyDataFilter> Displayed;
+    /// Computation in progress, if any
+    ProxyWatcher* Watcher;
+    /// Set while the proxy is displayed instead of the source
+    bool Swapped;
+  };
+  qSlicerLITTPlanV2ModelProxyManagerPrivate();
+
+  void collect(ProxyWatcher* watcher);
+
+  QHash<QString, Proxy> Proxies;
+  vtkWeakPointer<vtkMRMLScene> MRMLScene;
+  bool Interacting;
+  double TargetReduction;
+  int MinimumNumberOfPoints;
+};
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2ModelProxyManagerPrivate::qSlicerLITTPlanV2ModelProxyManagerPrivate()
+{
+  this->Interacting = false;
+  this->TargetReduction = 0.9;
+  this->MinimumNumberOfPoints = 50000;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManagerPrivate::collect(ProxyWatcher* watcher)
+{
+  if (watcher->property("collected").toBool())
+    {
+    return;
+    }
+  watcher->setProperty("collected", true);
+  watcher->deleteLater();
+  vtkSmartPointer<vtkPolyData> decimated;
+  decimated.TakeReference(watcher->result());
+
+  QString modelID = watcher->property("modelID").toString();
+  QHash<QString, Proxy>::iterator it = this->Proxies.find(modelID);
+  // Discard the results of outdated computations
+  if (it == this->Proxies.end() || it->Watcher != watcher)
+    {
+    return;
+    }
+  it->Watcher = 0;
+  it->Decimated = decimated;
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2ModelProxyManager::qSlicerLITTPlanV2ModelProxyManager(QObject* _parent)
+  : Superclass(_parent)
+  , d_ptr(new qSlicerLITTPlanV2ModelProxyManagerPrivate)
+{
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2ModelProxyManager::~qSlicerLITTPlanV2ModelProxyManager()
+{
+  this->endInteraction();
+  this->waitForProxies();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::setMRMLScene(vtkMRMLScene* scene)
+{
+  Q_D(qSlicerLITTPlanV2ModelProxyManager);
+  if (scene == d->MRMLScene)
+    {
+    return;
+    }
+  this->qvtkReconnect(d->MRMLScene, scene, vtkMRMLScene::NodeRemovedEvent,
+                      this, SLOT(onNodeRemoved(vtkObject*,vtkObject*)));
+  this->qvtkReconnect(d->MRMLScene, scene, vtkMRMLScene::EndCloseEvent,
+                      this, SLOT(onSceneEndClose()));
+  d->MRMLScene = scene;
+  // The models of the previous scene are gone
+  this->removeAllProxies();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::removeProxy(const QString& modelID)
+{
+  Q_D(qSlicerLITTPlanV2ModelProxyManager);
+  QHash<QString, qSlicerLITTPlanV2ModelProxyManagerPrivate::Proxy>::iterator it =
+    d->Proxies.find(modelID);
+  if (it == d->Proxies.end())
+    {
+    return;
+    }
+  if (it->Swapped && it->Model)
+    {
+    setDisplayedPolyData(it->Model, it->Model->GetPolyData());
+    }
+  // A computation in progress is collected and discarded when it finishes
+  d->Proxies.erase(it);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::removeAllProxies()
+{
+  Q_D(qSlicerLITTPlanV2ModelProxyManager);
+  foreach(const QString& modelID, d->Proxies.keys())
+    {
+    this->removeProxy(modelID);
+    }
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerLITTPlanV2ModelProxyManager::numberOfProxies()const
+{
+  Q_D(const qSlicerLITTPlanV2ModelProxyManager);
+  return d->Proxies.count();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::onNodeRemoved(vtkObject* scene,
+                                                       vtkObject* node)
+{
+  Q_UNUSED(scene);
+  vtkMRMLModelNode* model = vtkMRMLModelNode::SafeDownCast(node);
+  if (model && model->GetID())
+    {
+    this->removeProxy(model->GetID());
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::onSceneEndClose()
+{
+  this->removeAllProxies();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::setTargetReduction(double reduction)
+{
+  Q_D(qSlicerLITTPlanV2ModelProxyManager);
+  reduction = qBound(0., reduction, 0.999);
+  if (reduction == d->TargetReduction)
+    {
+    return;
+    }
+  d->TargetReduction = reduction;
+  // The cached proxies are out of date
+  QHash<QString, qSlicerLITTPlanV2ModelProxyManagerPrivate::Proxy>::iterator it;
+  for (it = d->Proxies.begin(); it != d->Proxies.end(); ++it)
+    {
+    it->SourceMTime = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+double qSlicerLITTPlanV2ModelProxyManager::targetReduction()const
+{
+  Q_D(const qSlicerLITTPlanV2ModelProxyManager);
+  return d->TargetReduction;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::setMinimumNumberOfPoints(int count)
+{
+  Q_D(qSlicerLITTPlanV2ModelProxyManager);
+  d->MinimumNumberOfPoints = count;
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerLITTPlanV2ModelProxyManager::minimumNumberOfPoints()const
+{
+  Q_D(const qSlicerLITTPlanV2ModelProxyManager);
+  return d->MinimumNumberOfPoints;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::prepareProxies(
+  const QList<vtkMRMLModelNode*>& models)
+{
+  Q_D(qSlicerLITTPlanV2ModelProxyManager);
+  foreach(vtkMRMLModelNode* model, models)
+    {
+    vtkPolyData* polyData = model ? model->GetPolyData() : 0;
+    if (!polyData || !model->GetID())
+      {
+      continue;
+      }
+    qSlicerLITTPlanV2ModelProxyManagerPrivate::Proxy& proxy =
+      d->Proxies[model->GetID()];
+    proxy.Model = model;
+    if (proxy.Swapped ||
+        polyData->GetNumberOfPoints() < d->MinimumNumberOfPoints)
+      {
+      continue;
+      }
+    if (proxy.Source == polyData && proxy.SourceMTime == polyData->GetMTime() &&
+        (proxy.Decimated || proxy.Watcher))
+      {
+      continue;
+      }
+    proxy.Source = polyData;
+    proxy.SourceMTime = polyData->GetMTime();
+    proxy.Decimated = 0;
+    // The background thread works on a deep copy: the arrays of the model
+    // can be edited in place (e.g. hardened) while it is decimated.
+    vtkPolyData* input = vtkPolyData::New();
+    input->DeepCopy(polyData);
+    proxy.Watcher = new ProxyWatcher(this);
+    proxy.Watcher->setProperty("modelID", QString(model->GetID()));
+    this->connect(proxy.Watcher, SIGNAL(finished()), SLOT(onProxyComputed()));
+    proxy.Watcher->setFuture(
+      QtConcurrent::run(decimateCopy, input, d->TargetReduction));
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ModelProxyManager::hasProxy(vtkMRMLModelNode* model)const
+{
+  Q_D(const qSlicerLITTPlanV2ModelProxyManager);
+  if (!model || !model->GetID() || !d->Proxies.contains(model->GetID()))
+    {
+    return false;
+    }
+  const qSlicerLITTPlanV2ModelProxyManagerPrivate::Proxy& proxy =
+    d->Proxies[model->GetID()];
+  if (!proxy.Decimated)
+    {
+    return false;
+    }
+  return proxy.Swapped ||
+    (proxy.Source == model->GetPolyData() &&
+     proxy.SourceMTime == model->GetPolyData()->GetMTime());
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::beginInteraction(
+  const QList<vtkMRMLModelNode*>& models)
+{
+  Q_D(qSlicerLITTPlanV2ModelProxyManager);
+  if (d->Interacting)
+    {
+    return;
+    }
+  this->prepareProxies(models);
+  d->Interacting = true;
+  foreach(vtkMRMLModelNode* model, models)
+    {
+    if (!this->hasProxy(model))
+      {
+      continue;
+      }
+    qSlicerLITTPlanV2ModelProxyManagerPrivate::Proxy& proxy =
+      d->Proxies[model->GetID()];
+    proxy.Swapped = true;
+    if (!proxy.Displayed)
+      {
+      proxy.Displayed = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+      proxy.Displayed->SetTransform(vtkSmartPointer<vtkTransform>::New());
+      }
+    vtkTransform::SafeDownCast(proxy.Displayed->GetTransform())->Identity();
+    proxy.Displayed->SetInput(proxy.Decimated);
+    proxy.Displayed->Update();
+    setDisplayedPolyData(model, proxy.Displayed->GetOutput());
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::endInteraction()
+{
+  Q_D(qSlicerLITTPlanV2ModelProxyManager);
+  if (!d->Interacting)
+    {
+    return;
+    }
+  d->Interacting = false;
+  QHash<QString, qSlicerLITTPlanV2ModelProxyManagerPrivate::Proxy>::iterator it;
+  for (it = d->Proxies.begin(); it != d->Proxies.end(); ++it)
+    {
+    if (!it->Swapped)
+      {
+      continue;
+      }
+    it->Swapped = false;
+    if (it->Model)
+      {
+      setDisplayedPolyData(it->Model, it->Model->GetPolyData());
+      }
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ModelProxyManager::isInteracting()const
+{
+  Q_D(const qSlicerLITTPlanV2ModelProxyManager);
+  return d->Interacting;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ModelProxyManager::isProxyDisplayed(
+  vtkMRMLModelNode* model)const
+{
+  Q_D(const qSlicerLITTPlanV2ModelProxyManager);
+  if (!d->Interacting || !model || !model->GetID() ||
+      !d->Proxies.contains(model->GetID()))
+    {
+    return false;
+    }
+  return d->Proxies[model->GetID()].Swapped;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::setProxyTransform(
+  vtkMRMLModelNode* model, vtkMatrix4x4* matrix)
+{
+  Q_D(qSlicerLITTPlanV2ModelProxyManager);
+  if (!matrix || !this->isProxyDisplayed(model))
+    {
+    return;
+    }
+  qSlicerLITTPlanV2ModelProxyManagerPrivate::Proxy& proxy =
+    d->Proxies[model->GetID()];
+  // The display pipeline updates the filter output at the next render
+  vtkTransform::SafeDownCast(proxy.Displayed->GetTransform())->SetMatrix(matrix);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::waitForProxies()
+{
+  Q_D(qSlicerLITTPlanV2ModelProxyManager);
+  // The watchers are children of the manager, including the ones of the
+  // proxies removed: their result is released by collect().
+  foreach(QFutureWatcherBase* watcherBase,
+          this->findChildren<QFutureWatcherBase*>())
+    {
+    ProxyWatcher* watcher = static_cast<ProxyWatcher*>(watcherBase);
+    watcher->waitForFinished();
+    d->collect(watcher);
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModelProxyManager::onProxyComputed()
+{
+  Q_D(qSlicerLITTPlanV2ModelProxyManager);
+  ProxyWatcher* watcher = static_cast<ProxyWatcher*>(this->sender());
+  if (!watcher || watcher->property("collected").toBool())
+    {
+    return;
+    }
+  d->collect(watcher);
+  emit proxyReady(watcher->property("modelID").toString());
+}
+
+//-----------------------------------------------------------------------------
+vtkPolyData* qSlicerLITTPlanV2ModelProxyManager::decimate(
+  vtkPolyData* polyData, double targetReduction)
+{
+  if (!polyData)
+    {
+    return 0;
+    }
+  vtkPolyData* proxy = 0;
+  if (polyData->GetNumberOfPolys() > 0 || polyData->GetNumberOfStrips() > 0)
+    {
+    vtkSmartPointer<vtkTriangleFilter> triangles =
+      vtkSmartPointer<vtkTriangleFilter>::New();
+    triangles->SetInput(polyData);
+    triangles->PassVertsOff();
+    triangles->PassLinesOff();
+    vtkSmartPointer<vtkQuadricDecimation> decimation =
+      vtkSmartPointer<vtkQuadricDecimation>::New();
+    decimation->SetInputConnection(triangles->GetOutputPort());
+    decimation->SetTargetReduction(targetReduction);
+    // Interpolate the point scalars (e.g. curvature, thickness) too
+    decimation->AttributeErrorMetricOn();
+    vtkSmartPointer<vtkPolyDataNormals> normals =
+      vtkSmartPointer<vtkPolyDataNormals>::New();
+    normals->SetInputConnection(decimation->GetOutputPort());
+    normals->SplittingOff();
+    normals->Update();
+    proxy = vtkPolyData::New();
+    proxy->ShallowCopy(normals->GetOutput());
+    }
+  else if (polyData->GetNumberOfLines() > 0)
+    {
+    // Tractography: keep one streamline every onRatio
+    vtkSmartPointer<vtkMaskPolyData> mask =
+      vtkSmartPointer<vtkMaskPolyData>::New();
+    mask->SetInput(polyData);
+    mask->SetOnRatio(qMax(1, qRound(1. / (1. - targetReduction))));
+    mask->Update();
+    proxy = vtkPolyData::New();
+    proxy->ShallowCopy(mask->GetOutput());
+    }
+  return proxy;
+}
@@ -0,0 +1,128 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __qSlicerLITTPlanV2ModelProxyManager_h
+#define __qSlicerLITTPlanV2ModelProxyManager_h
+
+// Qt includes
+#include <QList>
+#include <QObject>
+
+// CTK includes
+#include <ctkVTKObject.h>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModuleExport.h"
+
+class qSlicerLITTPlanV2ModelProxyManagerPrivate;
+class vtkMatrix4x4;
+class vtkMRMLModelNode;
+class vtkMRMLScene;
+class vtkObject;
+class vtkPolyData;
+
+/// \ingroup Slicer_QtModules_LITTPlanV2
+/// Level-of-detail proxies of models, displayed during interactions.
+///
+/// Decimated copies (proxies) of the models are computed in background
+/// threads and cached per model node until its polydata is modified.
+/// Surfaces are decimated with vtkQuadricDecimation, tractography (lines)
+/// by keeping a subset of the streamlines. The background threads decimate
+/// deep copies: the models can be edited meanwhile.
+/// beginInteraction() swaps the input of the model display nodes for the
+/// proxies, endInteraction() restores the full resolution polydata. The
+/// model nodes themselves are never modified: GetPolyData() keeps returning
+/// the full resolution polydata and its scalars.
+/// The cache doesn't keep the full resolution polydata alive, and the
+/// proxies of the models removed from the scene set with setMRMLScene() are
+/// dropped.
+class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT qSlicerLITTPlanV2ModelProxyManager
+  : public QObject
+{
+  Q_OBJECT
+  QVTK_OBJECT
+public:
+  typedef QObject Superclass;
+  qSlicerLITTPlanV2ModelProxyManager(QObject* parent = 0);
+  virtual ~qSlicerLITTPlanV2ModelProxyManager();
+
+  /// Observe the scene: the proxies of the models removed are dropped, all
+  /// the proxies are dropped when the scene is closed.
+  void setMRMLScene(vtkMRMLScene* scene);
+
+  /// Drop the proxy of the model. The full resolution polydata is displayed
+  /// again if the proxy was.
+  void removeProxy(const QString& modelID);
+  void removeAllProxies();
+  /// Number of models the manager holds a proxy entry for
+  int numberOfProxies()const;
+
+  /// Fraction of the triangles (or streamlines) removed. Default is 0.9.
+  void setTargetReduction(double reduction);
+  double targetReduction()const;
+
+  /// Models with fewer points are displayed at full resolution.
+  /// Default is 50000.
+  void setMinimumNumberOfPoints(int count);
+  int minimumNumberOfPoints()const;
+
+  /// Start computing, in background, the proxies missing or out of date.
+  void prepareProxies(const QList<vtkMRMLModelNode*>& models);
+
+  /// Return true if the proxy of the model is computed and up to date.
+  bool hasProxy(vtkMRMLModelNode* model)const;
+
+  /// Display the proxies of the models, if ready. The proxies of the models
+  /// not ready are prepared for the next interaction.
+  void beginInteraction(const QList<vtkMRMLModelNode*>& models);
+  /// Display the full resolution models again
+  void endInteraction();
+  bool isInteracting()const;
+
+  /// Return true if the proxy of the model is displayed instead of the
+  /// model polydata.
+  bool isProxyDisplayed(vtkMRMLModelNode* model)const;
+  /// Transform the proxy displayed for the model by the matrix (e.g. the
+  /// pending delta of a hardened model). Reset to identity at the end of
+  /// the interaction.
+  void setProxyTransform(vtkMRMLModelNode* model, vtkMatrix4x4* matrix);
+
+  /// Wait for the proxies being computed
+  void waitForProxies();
+
+  /// Return a decimated copy of the polydata, 0 if it can't be decimated.
+  /// Thread-safe.
+  static vtkPolyData* decimate(vtkPolyData* polyData, double targetReduction);
+
+signals:
+  /// Emitted in the main thread when the proxy of a model is computed
+  void proxyReady(const QString& modelID);
+
+protected slots:
+  void onProxyComputed();
+  void onNodeRemoved(vtkObject* scene, vtkObject* node);
+  void onSceneEndClose();
+
+protected:
+  QScopedPointer<qSlicerLITTPlanV2ModelProxyManagerPrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(qSlicerLITTPlanV2ModelProxyManager);
+  Q_DISABLE_COPY(qSlicerLITTPlanV2ModelProxyManager);
+};
+
+#endif
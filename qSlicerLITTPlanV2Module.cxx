@@ -19,6 +19,8 @@
 ==============================================================================*/
 
 // Qt includes
+#include <QDebug>
+#include <QHash>
 #include <QtPlugin>
 
 // SlicerQt includes
@@ -30,6 +32,19 @@
 #include "qSlicerLITTPlanV2IO.h"
 #include "qSlicerLITTPlanV2Module.h"
 #include "qSlicerLITTPlanV2ModuleWidget.h"
+#include "qSlicerLITTPlanV2ResultCache.h"
+#include "vtkLITTPlanV2TractDensityGrid.h"
+
+// MRML includes
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLTransformNode.h>
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
 
 //-----------------------------------------------------------------------------
 Q_EXPORT_PLUGIN2(qSlicerLITTPlanV2Module, qSlicerLITTPlanV2Module);
@@ -39,6 +54,9 @@ Q_EXPORT_PLUGIN2(qSlicerLITTPlanV2Module, qSlicerLITTPlanV2Module);
 class qSlicerLITTPlanV2ModulePrivate
 {
 public:
+  /// Tract density grids indexed by tractography model node ID
+  QHash<QString, vtkSmartPointer<vtkLITTPlanV2TractDensityGrid> > TractDensityGrids;
+  mutable qSlicerLITTPlanV2ResultCache ResultCache;
 };
 
 //-----------------------------------------------------------------------------
@@ -121,3 +139,122 @@ void qSlicerLITTPlanV2Module::setup()
     vtkSlicerTransformLogic::SafeDownCast(this->logic());
   app->coreIOManager()->registerIO(new qSlicerLITTPlanV2IO(transformLogic, this));
 }
+
+//-----------------------------------------------------------------------------
+vtkLITTPlanV2TractDensityGrid* qSlicerLITTPlanV2Module
+::tractDensityGrid(vtkMRMLModelNode* fiberModel)
+{
+  Q_D(qSlicerLITTPlanV2Module);
+  if (!fiberModel || !fiberModel->GetID() || !fiberModel->GetPolyData())
+    {
+    return 0;
+    }
+  vtkMRMLTransformNode* parentTransform = fiberModel->GetParentTransformNode();
+  if (parentTransform && !parentTransform->IsTransformToWorldLinear())
+    {
+    qWarning() << "qSlicerLITTPlanV2Module::tractDensityGrid:"
+               << fiberModel->GetID() << "is under a non linear transform";
+    return 0;
+    }
+  vtkSmartPointer<vtkLITTPlanV2TractDensityGrid> grid =
+    d->TractDensityGrids.value(fiberModel->GetID());
+  if (!grid)
+    {
+    grid = vtkSmartPointer<vtkLITTPlanV2TractDensityGrid>::New();
+    vtkSmartPointer<vtkMatrix4x4> inputToRAS =
+      vtkSmartPointer<vtkMatrix4x4>::New();
+    grid->SetInputToRASMatrix(inputToRAS);
+    d->TractDensityGrids[fiberModel->GetID()] = grid;
+    }
+  if (grid->GetInput() != fiberModel->GetPolyData())
+    {
+    grid->SetInput(fiberModel->GetPolyData());
+    }
+
+  // Only the registration changed: update the matrix, keep the grid.
+  vtkSmartPointer<vtkMatrix4x4> inputToRAS =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  if (parentTransform)
+    {
+    parentTransform->GetMatrixTransformToWorld(inputToRAS);
+    }
+  bool registrationChanged = false;
+  for (int i = 0; i < 4; ++i)
+    {
+    for (int j = 0; j < 4; ++j)
+      {
+      registrationChanged = registrationChanged ||
+        inputToRAS->GetElement(i, j) !=
+          grid->GetInputToRASMatrix()->GetElement(i, j);
+      }
+    }
+  if (registrationChanged)
+    {
+    grid->GetInputToRASMatrix()->DeepCopy(inputToRAS);
+    }
+  if (!grid->IsUpToDate())
+    {
+    // The grid is in the tractography coordinates: the registration is not
+    // part of the key.
+    QList<QByteArray> hashes;
+    hashes << qSlicerLITTPlanV2ResultCache::hashPolyData(grid->GetInput())
+           << QByteArray::number(grid->GetSpacing()[0], 'g', 17)
+           << QByteArray::number(grid->GetSpacing()[1], 'g', 17)
+           << QByteArray::number(grid->GetSpacing()[2], 'g', 17)
+           << QByteArray::number(grid->GetPadding(), 'g', 17);
+    QString key = qSlicerLITTPlanV2ResultCache::key(
+      "vtkLITTPlanV2TractDensityGrid",
+      vtkLITTPlanV2TractDensityGrid::GetAlgorithmVersion(), hashes);
+    vtkSmartPointer<vtkImageData> cachedGrid = d->ResultCache.load(key);
+    if (cachedGrid)
+      {
+      grid->SetOutput(cachedGrid);
+      }
+    else
+      {
+      grid->Update();
+      d->ResultCache.store(key, grid->GetOutput());
+      }
+    }
+  grid->Update();
+  return grid;
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2ResultCache* qSlicerLITTPlanV2Module::resultCache()const
+{
+  Q_D(const qSlicerLITTPlanV2Module);
+  return &d->ResultCache;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2Module::setMRMLScene(vtkMRMLScene* scene)
+{
+  Q_D(qSlicerLITTPlanV2Module);
+  this->qvtkReconnect(this->mrmlScene(), scene, vtkMRMLScene::NodeRemovedEvent,
+                      this, SLOT(onNodeRemoved(vtkObject*,vtkObject*)));
+  this->qvtkReconnect(this->mrmlScene(), scene, vtkMRMLScene::EndCloseEvent,
+                      this, SLOT(onSceneEndClose()));
+  // The grids reference the tractography of the previous scene
+  d->TractDensityGrids.clear();
+  this->Superclass::setMRMLScene(scene);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2Module::onNodeRemoved(vtkObject* scene, vtkObject* node)
+{
+  Q_D(qSlicerLITTPlanV2Module);
+  Q_UNUSED(scene);
+  vtkMRMLModelNode* model = vtkMRMLModelNode::SafeDownCast(node);
+  if (model && model->GetID())
+    {
+    d->TractDensityGrids.remove(model->GetID());
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2Module::onSceneEndClose()
+{
+  Q_D(qSlicerLITTPlanV2Module);
+  d->TractDensityGrids.clear();
+}
@@ -21,20 +21,29 @@
 #ifndef __qSlicerLITTPlanV2Module_h
 #define __qSlicerLITTPlanV2Module_h
 
+// CTK includes
+#include <ctkVTKObject.h>
+
 // SlicerQt includes
 #include "qSlicerLoadableModule.h"
 
 // LITTPlanV2 includes
 #include "qSlicerLITTPlanV2ModuleExport.h"
 
+class qSlicerLITTPlanV2ResultCache;
+class vtkLITTPlanV2TractDensityGrid;
 class vtkMatrix4x4;
+class vtkMRMLModelNode;
 class vtkMRMLNode;
+class vtkMRMLScene;
+class vtkObject;
 class qSlicerLITTPlanV2ModulePrivate;
 
 class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT qSlicerLITTPlanV2Module
   : public qSlicerLoadableModule
 {
   Q_OBJECT
+  QVTK_OBJECT
   Q_INTERFACES(qSlicerLoadableModule);
 public:
 
@@ -59,6 +68,24 @@ public:
   /// Contributors of the module
   virtual QStringList contributors()const;
 
+  /// Return the tract density grid of the tractography model.
+  /// The streamlines are voxelized the first time the grid is requested and
+  /// each time the polydata is modified. The registration (parent transform
+  /// to world) of the model is refreshed at each call but never triggers a
+  /// re-voxelization: queries are mapped through its inverse.
+  /// Only linear parent transforms are supported: 0 is returned under a non
+  /// linear transform.
+  /// Voxelized grids are stored in the result cache: the same streamlines
+  /// are not voxelized again, even in a later session. The grids of the
+  /// models removed from the scene, or of a closed scene, are released.
+  vtkLITTPlanV2TractDensityGrid* tractDensityGrid(vtkMRMLModelNode* fiberModel);
+
+  /// On-disk cache of the planning results, shared across sessions
+  qSlicerLITTPlanV2ResultCache* resultCache()const;
+
+  /// Reimplemented to release the tract density grids of the scene
+  virtual void setMRMLScene(vtkMRMLScene* scene);
+
 protected:
   /// Reimplemented to initialize the transforms IO
   virtual void setup();
@@ -69,6 +96,11 @@ protected:
   /// Create and return the logic associated to this module
   virtual vtkMRMLAbstractLogic* createLogic();
 
+protected slots:
+  void onNodeRemoved(vtkObject* scene, vtkObject* node);
+  void onSceneEndClose();
+
+protected:
   QScopedPointer<qSlicerLITTPlanV2ModulePrivate> d_ptr;
 private:
   Q_DECLARE_PRIVATE(qSlicerLITTPlanV2Module);
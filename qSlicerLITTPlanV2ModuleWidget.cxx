@@ -20,8 +20,10 @@
 
 // Qt includes
 #include <QFileDialog>
+#include <QTimer>
 
 // SlicerQt includes
+#include "qSlicerLITTPlanV2Module.h"
 #include "qSlicerLITTPlanV2ModuleWidget.h"
 #include "ui_qSlicerLITTPlanV2Module.h"
 //#include "qSlicerApplication.h"
@@ -30,15 +32,68 @@
 // vtkSlicerLogic includes
 #include "vtkSlicerTransformLogic.h"
 
-// MRMLWidgets includes
-#include <qMRMLUtils.h>
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2CoordinateReferenceEngine.h"
+#include "qSlicerLITTPlanV2ModelProxyManager.h"
+#include "qSlicerLITTPlanV2SessionLog.h"
+#include "qSlicerLITTPlanV2ThermometryStream.h"
+#include "vtkLITTPlanV2ModelHardener.h"
+#include "vtkLITTPlanV2TractDensityGrid.h"
+#include "vtkLITTPlanV2TrajectoryOptimizer.h"
 
 // MRML includes
+#include "vtkMRMLLabelMapVolumeDisplayNode.h"
 #include "vtkMRMLLinearTransformNode.h"
+#include "vtkMRMLModelNode.h"
+#include "vtkMRMLScalarVolumeNode.h"
+#include "vtkMRMLScene.h"
 
 // VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPointData.h>
+#include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
 #include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+#include <vtkWeakPointer.h>
+
+namespace
+{
+//-----------------------------------------------------------------------------
+/// Return the geometry of the model in RAS: the polydata transformed by the
+/// (linear) transforms the model is under. Returns 0 if the transform to
+/// world of the model is not linear.
+vtkSmartPointer<vtkPolyData> polyDataInRAS(vtkMRMLModelNode* model)
+{
+  vtkSmartPointer<vtkPolyData> polyData = model ? model->GetPolyData() : 0;
+  vtkMRMLTransformNode* parentTransform =
+    model ? model->GetParentTransformNode() : 0;
+  if (!polyData || !parentTransform)
+    {
+    return polyData;
+    }
+  if (!parentTransform->IsTransformToWorldLinear())
+    {
+    return 0;
+    }
+  vtkSmartPointer<vtkTransform> toWorld = vtkSmartPointer<vtkTransform>::New();
+  parentTransform->GetMatrixTransformToWorld(toWorld->GetMatrix());
+  vtkSmartPointer<vtkTransformPolyDataFilter> filter =
+    vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+  filter->SetInput(polyData);
+  filter->SetTransform(toWorld);
+  filter->Update();
+  return filter->GetOutput();
+}
+
+//-----------------------------------------------------------------------------
+QString nodeID(vtkMRMLNode* node)
+{
+  return node && node->GetID() ? node->GetID() : "";
+}
+}
 
 //-----------------------------------------------------------------------------
 class qSlicerLITTPlanV2ModuleWidgetPrivate: public Ui_qSlicerLITTPlanV2Module
@@ -49,8 +104,55 @@ protected:
 public:
   qSlicerLITTPlanV2ModuleWidgetPrivate(qSlicerLITTPlanV2ModuleWidget& object);
   vtkSlicerTransformLogic*      logic()const;
+  /// Models moved by the active transform: under it, directly or not, or
+  /// hardened with it or one of its descendants
+  QList<vtkMRMLModelNode*>      transformedModels()const;
+  /// Apply the pending delta of the models hardened with the transform
+  /// while the sliders are dragged: the proxies displayed are transformed,
+  /// the models without proxy are updated.
+  void                          updateHardenedProxies(
+                                  vtkMRMLTransformNode* transformNode);
   QButtonGroup*                 CoordinateReferenceButtonGroup;
   vtkMRMLLinearTransformNode*   MRMLTransformNode;
+  vtkSmartPointer<vtkLITTPlanV2ModelHardener> ModelHardener;
+  qSlicerLITTPlanV2ModelProxyManager* ModelProxyManager;
+  /// Single shot timer ending the interaction when the sliders are idle
+  QTimer*                       InteractionTimer;
+  /// Return the label map the thermal damage is displayed into, created
+  /// (or reused) on the geometry of the reference volume.
+  vtkMRMLScalarVolumeNode*      damageVolume(vtkMRMLScalarVolumeNode* reference);
+  qSlicerLITTPlanV2ThermometryStream* ThermometryStream;
+  /// Extend the range of the translation sliders to the translation they
+  /// display
+  void updateTranslationRange();
+  qSlicerLITTPlanV2CoordinateReferenceEngine* CoordinateReferenceEngine;
+  /// Engine reference of the coordinate reference selected: World for
+  /// Global, Parent for Local, or StereotacticFrame, ACPC or Tracker.
+  qSlicerLITTPlanV2CoordinateReferenceEngine::Reference engineReference()const;
+  /// Bind the sliders to the active transform expressed in the engine
+  /// reference selected, and update the reference node selector
+  void updateSlidersTransformNode();
+  /// Copy the active transform, expressed in the engine reference, into
+  /// ReferenceTransformNode. Returns false if it can't be expressed there.
+  bool updateReferenceTransform();
+  /// Matrix edited by the sliders, in every coordinate reference. Its edits
+  /// are applied to the active transform with setTransformInReference().
+  vtkSmartPointer<vtkMRMLLinearTransformNode> ReferenceTransformNode;
+  /// Node placing the engine reference selected, observed
+  vtkWeakPointer<vtkMRMLTransformNode> ReferenceNode;
+  /// Set while the active transform and ReferenceTransformNode are synced
+  bool                          SynchronizingReference;
+  qSlicerLITTPlanV2SessionLog   SessionLog;
+  /// State of the scene and of the trajectories optimized during the
+  /// session recorded or replayed
+  qSlicerLITTPlanV2SessionLog::State captureState()const;
+  /// Entry, direction and cost of the trajectories optimized during the
+  /// session recorded or replayed, per transform node
+  QMap<QString, QVector<double> > SessionTrajectories;
+  bool                          RecordingSession;
+  /// Set while a session is replayed: the sliders don't start interactions,
+  /// the interactions of the log do.
+  bool                          ReplayingSession;
 };
 
 //-----------------------------------------------------------------------------
@@ -59,6 +161,17 @@ qSlicerLITTPlanV2ModuleWidgetPrivate::qSlicerLITTPlanV2ModuleWidgetPrivate(qSlic
 {
   this->CoordinateReferenceButtonGroup = 0;
   this->MRMLTransformNode = 0;
+  this->ModelHardener = vtkSmartPointer<vtkLITTPlanV2ModelHardener>::New();
+  this->ModelProxyManager = 0;
+  this->InteractionTimer = 0;
+  this->ThermometryStream = 0;
+  this->CoordinateReferenceEngine = 0;
+  this->ReferenceTransformNode =
+    vtkSmartPointer<vtkMRMLLinearTransformNode>::New();
+  this->ReferenceNode = 0;
+  this->SynchronizingReference = false;
+  this->RecordingSession = false;
+  this->ReplayingSession = false;
 }
 //-----------------------------------------------------------------------------
 vtkSlicerTransformLogic* qSlicerLITTPlanV2ModuleWidgetPrivate::logic()const
@@ -67,6 +180,164 @@ vtkSlicerTransformLogic* qSlicerLITTPlanV2ModuleWidgetPrivate::logic()const
   return vtkSlicerTransformLogic::SafeDownCast(q->logic());
 }
 
+//-----------------------------------------------------------------------------
+QList<vtkMRMLModelNode*> qSlicerLITTPlanV2ModuleWidgetPrivate
+::transformedModels()const
+{
+  Q_Q(const qSlicerLITTPlanV2ModuleWidget);
+  QList<vtkMRMLModelNode*> models;
+  vtkMRMLScene* scene = q->mrmlScene();
+  if (!scene || !this->MRMLTransformNode)
+    {
+    return models;
+    }
+  vtkSmartPointer<vtkMatrix4x4> delta = vtkSmartPointer<vtkMatrix4x4>::New();
+  int numberOfModels = scene->GetNumberOfNodesByClass("vtkMRMLModelNode");
+  for (int i = 0; i < numberOfModels; ++i)
+    {
+    vtkMRMLModelNode* model = vtkMRMLModelNode::SafeDownCast(
+      scene->GetNthNodeByClass(i, "vtkMRMLModelNode"));
+    if (vtkLITTPlanV2ModelHardener::GetHardenedDelta(
+          model, this->MRMLTransformNode, delta))
+      {
+      models << model;
+      continue;
+      }
+    for (vtkMRMLTransformNode* parent = model ? model->GetParentTransformNode() : 0;
+         parent; parent = parent->GetParentTransformNode())
+      {
+      if (parent == this->MRMLTransformNode)
+        {
+        models << model;
+        break;
+        }
+      }
+    }
+  return models;
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2SessionLog::State qSlicerLITTPlanV2ModuleWidgetPrivate
+::captureState()const
+{
+  Q_Q(const qSlicerLITTPlanV2ModuleWidget);
+  qSlicerLITTPlanV2SessionLog::State state =
+    qSlicerLITTPlanV2SessionLog::captureState(q->mrmlScene());
+  state.Trajectories = this->SessionTrajectories;
+  return state;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidgetPrivate
+::updateHardenedProxies(vtkMRMLTransformNode* transformNode)
+{
+  Q_Q(qSlicerLITTPlanV2ModuleWidget);
+  vtkMRMLScene* scene = q->mrmlScene();
+  if (!scene)
+    {
+    return;
+    }
+  vtkSmartPointer<vtkMatrix4x4> delta = vtkSmartPointer<vtkMatrix4x4>::New();
+  int numberOfModels = scene->GetNumberOfNodesByClass("vtkMRMLModelNode");
+  for (int i = 0; i < numberOfModels; ++i)
+    {
+    vtkMRMLModelNode* model = vtkMRMLModelNode::SafeDownCast(
+      scene->GetNthNodeByClass(i, "vtkMRMLModelNode"));
+    if (!vtkLITTPlanV2ModelHardener::GetHardenedDelta(
+          model, transformNode, delta))
+      {
+      continue;
+      }
+    if (this->ModelProxyManager->isProxyDisplayed(model))
+      {
+      this->ModelProxyManager->setProxyTransform(model, delta);
+      }
+    else
+      {
+      this->ModelHardener->UpdateHardenedModel(model, transformNode);
+      }
+    }
+}
+
+//-----------------------------------------------------------------------------
+vtkMRMLScalarVolumeNode* qSlicerLITTPlanV2ModuleWidgetPrivate
+::damageVolume(vtkMRMLScalarVolumeNode* reference)
+{
+  Q_Q(qSlicerLITTPlanV2ModuleWidget);
+  vtkMRMLScene* scene = q->mrmlScene();
+  vtkImageData* referenceImage = reference ? reference->GetImageData() : 0;
+  if (!scene || !referenceImage)
+    {
+    return 0;
+    }
+  vtkSmartPointer<vtkMatrix4x4> ijkToRAS = vtkSmartPointer<vtkMatrix4x4>::New();
+  reference->GetIJKToRASMatrix(ijkToRAS);
+
+  vtkMRMLScalarVolumeNode* damageVolume =
+    this->ThermometryStream->damageVolumeNode();
+  vtkImageData* damageImage = damageVolume ? damageVolume->GetImageData() : 0;
+  if (!damageImage || !scene->IsNodePresent(damageVolume) ||
+      damageImage->GetDimensions()[0] != referenceImage->GetDimensions()[0] ||
+      damageImage->GetDimensions()[1] != referenceImage->GetDimensions()[1] ||
+      damageImage->GetDimensions()[2] != referenceImage->GetDimensions()[2])
+    {
+    vtkSmartPointer<vtkImageData> labelMap =
+      vtkSmartPointer<vtkImageData>::New();
+    labelMap->SetDimensions(referenceImage->GetDimensions());
+    labelMap->SetScalarTypeToUnsignedChar();
+    labelMap->SetNumberOfScalarComponents(1);
+    labelMap->AllocateScalars();
+
+    vtkSmartPointer<vtkMRMLLabelMapVolumeDisplayNode> displayNode =
+      vtkSmartPointer<vtkMRMLLabelMapVolumeDisplayNode>::New();
+    displayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeLabels");
+    scene->AddNode(displayNode);
+
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> newDamageVolume =
+      vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    newDamageVolume->SetName("ThermalDamage");
+    newDamageVolume->LabelMapOn();
+    newDamageVolume->SetAndObserveImageData(labelMap);
+    newDamageVolume->SetAndObserveDisplayNodeID(displayNode->GetID());
+    scene->AddNode(newDamageVolume);
+    damageVolume = newDamageVolume;
+    damageImage = labelMap;
+    }
+  damageImage->GetPointData()->GetScalars()->FillComponent(0, 0.);
+  damageImage->Modified();
+  damageVolume->SetIJKToRASMatrix(ijkToRAS);
+  damageVolume->SetAndObserveTransformNodeID(reference->GetTransformNodeID());
+  return damageVolume;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidgetPrivate::updateTranslationRange()
+{
+  Q_Q(qSlicerLITTPlanV2ModuleWidget);
+  if (!this->MRMLTransformNode)
+    {
+    return;
+    }
+  // The translation sliders display the active transform in the reference
+  vtkMatrix4x4* mat = this->ReferenceTransformNode->GetMatrixTransformToParent();
+
+  // The matrix can be changed externally. The min/max values shall be updated 
+  //accordingly to the new matrix if needed.
+  double min = 0.;
+  double max = 0.;
+  q->extractMinMaxTranslationValue(mat, min, max);
+  if (min < this->TranslationSliders->minimum())
+    {
+    min = min - 0.3 * fabs(min);
+    this->TranslationSliders->setMinimum(min);
+    }
+  if (max > this->TranslationSliders->maximum())
+    {
+    max = max + 0.3 * fabs(max);
+    this->TranslationSliders->setMaximum(max);
+    }
+}
+
 //-----------------------------------------------------------------------------
 qSlicerLITTPlanV2ModuleWidget::qSlicerLITTPlanV2ModuleWidget(QWidget* _parentWidget)
   : Superclass(_parentWidget)
@@ -79,12 +350,97 @@ qSlicerLITTPlanV2ModuleWidget::~qSlicerLITTPlanV2ModuleWidget()
 {
 }
 
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2CoordinateReferenceEngine::Reference
+qSlicerLITTPlanV2ModuleWidgetPrivate::engineReference()const
+{
+  Q_Q(const qSlicerLITTPlanV2ModuleWidget);
+  switch (q->coordinateReference())
+    {
+    case qMRMLTransformSliders::LOCAL:
+      return qSlicerLITTPlanV2CoordinateReferenceEngine::Parent;
+    case qSlicerLITTPlanV2CoordinateReferenceEngine::StereotacticFrame:
+      return qSlicerLITTPlanV2CoordinateReferenceEngine::StereotacticFrame;
+    case qSlicerLITTPlanV2CoordinateReferenceEngine::ACPC:
+      return qSlicerLITTPlanV2CoordinateReferenceEngine::ACPC;
+    case qSlicerLITTPlanV2CoordinateReferenceEngine::Tracker:
+      return qSlicerLITTPlanV2CoordinateReferenceEngine::Tracker;
+    case qMRMLTransformSliders::GLOBAL:
+    default:
+      return qSlicerLITTPlanV2CoordinateReferenceEngine::World;
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidgetPrivate::updateSlidersTransformNode()
+{
+  Q_Q(qSlicerLITTPlanV2ModuleWidget);
+  qSlicerLITTPlanV2CoordinateReferenceEngine::Reference reference =
+    this->engineReference();
+  // World and Parent are placed by the active transform itself
+  bool hasReferenceNode =
+    reference != qSlicerLITTPlanV2CoordinateReferenceEngine::World &&
+    reference != qSlicerLITTPlanV2CoordinateReferenceEngine::Parent;
+
+  vtkMRMLTransformNode* referenceNode = hasReferenceNode ?
+    this->CoordinateReferenceEngine->referenceNode(reference) : 0;
+  this->ReferenceNodeLabel->setEnabled(hasReferenceNode);
+  this->ReferenceNodeSelector->setEnabled(hasReferenceNode);
+  bool wasBlocking = this->ReferenceNodeSelector->blockSignals(true);
+  this->ReferenceNodeSelector->setCurrentNode(referenceNode);
+  this->ReferenceNodeSelector->blockSignals(wasBlocking);
+  // The motion seen from the reference changes when the reference moves
+  q->qvtkReconnect(this->ReferenceNode, referenceNode,
+    vtkMRMLTransformableNode::TransformModifiedEvent,
+    q, SLOT(onReferenceNodeModified()));
+  this->ReferenceNode = referenceNode;
+
+  // ReferenceTransformNode has no parent: the sliders edit it as is, and
+  // rotate around the global axes in Global only.
+  vtkMRMLNode* slidersNode = this->updateReferenceTransform() ?
+    this->ReferenceTransformNode.GetPointer() : 0;
+  qMRMLTransformSliders::CoordinateReferenceType slidersReference =
+    reference == qSlicerLITTPlanV2CoordinateReferenceEngine::World ?
+    qMRMLTransformSliders::GLOBAL : qMRMLTransformSliders::LOCAL;
+  this->TranslationSliders->setCoordinateReference(slidersReference);
+  this->RotationSliders->setCoordinateReference(slidersReference);
+  this->TranslationSliders->setMRMLTransformNode(slidersNode);
+  this->RotationSliders->setMRMLTransformNode(slidersNode);
+  this->updateTranslationRange();
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ModuleWidgetPrivate::updateReferenceTransform()
+{
+  if (!this->MRMLTransformNode)
+    {
+    return false;
+    }
+  if (this->SynchronizingReference)
+    {
+    return true;
+    }
+  vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (!this->CoordinateReferenceEngine->transformInReference(
+        this->MRMLTransformNode, this->engineReference(), matrix))
+    {
+    return false;
+    }
+  this->SynchronizingReference = true;
+  this->ReferenceTransformNode->GetMatrixTransformToParent()->DeepCopy(matrix);
+  this->SynchronizingReference = false;
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 void qSlicerLITTPlanV2ModuleWidget::setup()
 {
   Q_D(qSlicerLITTPlanV2ModuleWidget);
   d->setupUi(this);
 
+  d->CoordinateReferenceEngine =
+    new qSlicerLITTPlanV2CoordinateReferenceEngine(this);
+
   // Add coordinate reference button to a button group
   d->CoordinateReferenceButtonGroup =
     new QButtonGroup(d->CoordinateReferenceGroupBox);
@@ -92,6 +448,22 @@ void qSlicerLITTPlanV2ModuleWidget::setup()
     d->GlobalRadioButton, qMRMLTransformSliders::GLOBAL);
   d->CoordinateReferenceButtonGroup->addButton(
     d->LocalRadioButton, qMRMLTransformSliders::LOCAL);
+  // Every reference is converted by the engine (see engineReference()), the
+  // ID of the others is the engine reference
+  d->CoordinateReferenceButtonGroup->addButton(
+    d->StereotacticFrameRadioButton,
+    qSlicerLITTPlanV2CoordinateReferenceEngine::StereotacticFrame);
+  d->CoordinateReferenceButtonGroup->addButton(
+    d->ACPCRadioButton, qSlicerLITTPlanV2CoordinateReferenceEngine::ACPC);
+  d->CoordinateReferenceButtonGroup->addButton(
+    d->TrackerRadioButton, qSlicerLITTPlanV2CoordinateReferenceEngine::Tracker);
+  this->connect(d->ReferenceNodeSelector,
+                SIGNAL(currentNodeChanged(vtkMRMLNode*)),
+                SLOT(onReferenceNodeSelected(vtkMRMLNode*)));
+  // The sliders edit the transform in the engine reference
+  this->qvtkConnect(d->ReferenceTransformNode,
+                    vtkMRMLTransformableNode::TransformModifiedEvent,
+                    this, SLOT(onReferenceTransformModified()));
 
   // Connect button group
   this->connect(d->CoordinateReferenceButtonGroup,
@@ -122,11 +494,46 @@ void qSlicerLITTPlanV2ModuleWidget::setup()
   this->onTranslationRangeChanged(d->TranslationSliders->minimum(),
                                   d->TranslationSliders->maximum());
 
+  // Level of detail: the transformed models are displayed decimated while
+  // the sliders are dragged
+  d->ModelProxyManager = new qSlicerLITTPlanV2ModelProxyManager(this);
+  d->ModelProxyManager->setMRMLScene(this->mrmlScene());
+  d->InteractionTimer = new QTimer(this);
+  d->InteractionTimer->setSingleShot(true);
+  d->InteractionTimer->setInterval(250);
+  this->connect(d->InteractionTimer, SIGNAL(timeout()),
+                SLOT(onInteractionEnded()));
+  this->connect(d->TranslationSliders, SIGNAL(valuesChanged()),
+                SLOT(onSlidersValuesChanged()));
+  this->connect(d->RotationSliders, SIGNAL(valuesChanged()),
+                SLOT(onSlidersValuesChanged()));
+
   // Transform nodes connection
   this->connect(d->TransformToolButton, SIGNAL(clicked()),
                 SLOT(transformSelectedNodes()));
   this->connect(d->UntransformToolButton, SIGNAL(clicked()),
                 SLOT(untransformSelectedNodes()));
+  this->connect(d->HardenPushButton, SIGNAL(clicked()),
+                SLOT(hardenSelectedNodes()));
+
+  // Trajectory optimization
+  this->connect(d->OptimizeTrajectoryPushButton, SIGNAL(clicked()),
+                SLOT(optimizeTrajectory()));
+
+  // Session recording
+  this->connect(d->RecordSessionPushButton, SIGNAL(toggled(bool)),
+                SLOT(onRecordSessionToggled(bool)));
+
+  // Thermometry
+  d->ThermometryStream = new qSlicerLITTPlanV2ThermometryStream(this);
+  this->connect(d->ThermometryStream, SIGNAL(frameProcessed(int,double)),
+                SLOT(onThermometryFrameProcessed(int,double)));
+  this->connect(d->ThermometryStream, SIGNAL(finished()),
+                SLOT(onThermometryFinished()));
+  this->connect(d->ReplayThermometryPushButton, SIGNAL(clicked()),
+                SLOT(replayThermometry()));
+  this->connect(d->StopThermometryPushButton, SIGNAL(clicked()),
+                SLOT(stopThermometry()));
 
   // Icons
   QIcon rightIcon =
@@ -144,11 +551,47 @@ void qSlicerLITTPlanV2ModuleWidget::setup()
 void qSlicerLITTPlanV2ModuleWidget::onCoordinateReferenceButtonPressed(int id)
 {
   Q_D(qSlicerLITTPlanV2ModuleWidget);
-  
-  qMRMLTransformSliders::CoordinateReferenceType ref =
-    (id == qMRMLTransformSliders::GLOBAL) ? qMRMLTransformSliders::GLOBAL : qMRMLTransformSliders::LOCAL;
-  d->TranslationSliders->setCoordinateReference(ref);
-  d->RotationSliders->setCoordinateReference(ref);
+  Q_UNUSED(id);
+  d->updateSlidersTransformNode();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::onReferenceNodeSelected(vtkMRMLNode* node)
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  qSlicerLITTPlanV2CoordinateReferenceEngine::Reference reference =
+    d->engineReference();
+  if (reference == qSlicerLITTPlanV2CoordinateReferenceEngine::World ||
+      reference == qSlicerLITTPlanV2CoordinateReferenceEngine::Parent)
+    {
+    return;
+    }
+  d->CoordinateReferenceEngine->setReferenceNode(
+    reference, vtkMRMLTransformNode::SafeDownCast(node));
+  d->updateSlidersTransformNode();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::onReferenceNodeModified()
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  d->updateReferenceTransform();
+  d->updateTranslationRange();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::onReferenceTransformModified()
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  if (!d->MRMLTransformNode || d->SynchronizingReference)
+    {
+    return;
+    }
+  d->SynchronizingReference = true;
+  d->CoordinateReferenceEngine->setTransformInReference(
+    d->MRMLTransformNode, d->engineReference(),
+    d->ReferenceTransformNode->GetMatrixTransformToParent());
+  d->SynchronizingReference = false;
 }
 
 //-----------------------------------------------------------------------------
@@ -190,7 +633,18 @@ void qSlicerLITTPlanV2ModuleWidget::onNodeSelected(vtkMRMLNode* node)
     }
   d->TransformableTreeView->sortFilterProxyModel()
     ->setHiddenNodeIDs(hiddenNodeIDs);
+
+  // Interaction with the previous transform is over
+  this->onInteractionEnded();
   d->MRMLTransformNode = transformNode;
+  d->updateSlidersTransformNode();
+  if (d->RecordingSession)
+    {
+    d->SessionLog.appendSelectTransform(
+      transformNode ? transformNode->GetID() : "");
+    }
+  // Get the proxies ready before the sliders are dragged
+  d->ModelProxyManager->prepareProxies(d->transformedModels());
 }
 
 //-----------------------------------------------------------------------------
@@ -226,26 +680,26 @@ void qSlicerLITTPlanV2ModuleWidget::onMRMLTransformNodeModified(vtkObject* calle
   vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast(caller);
   if (!transformNode) { return; }
 
-  vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
-  qMRMLUtils::getTransformInCoordinateSystem(d->MRMLTransformNode,
-    this->coordinateReference() == qMRMLTransformSliders::GLOBAL, transform);
+  if (d->RecordingSession)
+    {
+    d->SessionLog.appendSetMatrix(transformNode->GetID(),
+                                  transformNode->GetMatrixTransformToParent());
+    }
 
-  // The matrix can be changed externally. The min/max values shall be updated 
-  //accordingly to the new matrix if needed.
-  vtkMatrix4x4 * mat = transform->GetMatrix();
-  double min = 0.;
-  double max = 0.;
-  this->extractMinMaxTranslationValue(mat, min, max);
-  if (min < d->TranslationSliders->minimum())
+  // Models hardened with the transform follow its edits: apply the delta.
+  // While the sliders are dragged, the delta moves their proxies and is
+  // baked into the full resolution models once on release.
+  if (!d->ModelProxyManager->isInteracting())
     {
-    min = min - 0.3 * fabs(min);
-    d->TranslationSliders->setMinimum(min);
+    d->ModelHardener->UpdateHardenedModels(this->mrmlScene(), transformNode);
     }
-  if (max > d->TranslationSliders->maximum())
+  else
     {
-    max = max + 0.3 * fabs(max);
-    d->TranslationSliders->setMaximum(max);
+    d->updateHardenedProxies(transformNode);
     }
+
+  d->updateReferenceTransform();
+  d->updateTranslationRange();
 }
 
 //-----------------------------------------------------------------------------
@@ -272,6 +726,14 @@ void qSlicerLITTPlanV2ModuleWidget::onTranslationRangeChanged(double newMin,
   d->MatrixWidget->setRange(newMin, newMax);
 }
 
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2CoordinateReferenceEngine* qSlicerLITTPlanV2ModuleWidget
+::coordinateReferenceEngine()const
+{
+  Q_D(const qSlicerLITTPlanV2ModuleWidget);
+  return d->CoordinateReferenceEngine;
+}
+
 //-----------------------------------------------------------------------------
 int qSlicerLITTPlanV2ModuleWidget::coordinateReference()const
 {
@@ -289,6 +751,11 @@ void qSlicerLITTPlanV2ModuleWidget::setMRMLScene(vtkMRMLScene* scene)
   // top-level, and this can only be done once the scene is set.
   d->TransformableTreeView->setRootIndex(
     d->TransformableTreeView->sortFilterProxyModel()->mrmlSceneIndex());
+  // The proxies of the models removed or of a closed scene are dropped
+  if (d->ModelProxyManager)
+    {
+    d->ModelProxyManager->setMRMLScene(scene);
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -298,14 +765,41 @@ void qSlicerLITTPlanV2ModuleWidget::transformSelectedNodes()
   QModelIndexList selectedIndexes =
     d->TransformableTreeView->selectionModel()->selectedRows();
   selectedIndexes = qMRMLTreeView::removeChildren(selectedIndexes);
+  QStringList nodeIDs;
   foreach(QModelIndex selectedIndex, selectedIndexes)
     {
     vtkMRMLTransformableNode* node = vtkMRMLTransformableNode::SafeDownCast(
     d->TransformableTreeView->sortFilterProxyModel()->
       mrmlNodeFromIndex( selectedIndex ));
     Q_ASSERT(node);
-    node->SetAndObserveTransformNodeID(d->MRMLTransformNode->GetID());
+    nodeIDs << node->GetID();
     }
+  this->transformNodes(nodeIDs);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::transformNodes(const QStringList& nodeIDs)
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  if (!d->MRMLTransformNode || !this->mrmlScene())
+    {
+    return;
+    }
+  foreach(const QString& nodeID, nodeIDs)
+    {
+    vtkMRMLTransformableNode* node = vtkMRMLTransformableNode::SafeDownCast(
+      this->mrmlScene()->GetNodeByID(nodeID.toLatin1()));
+    if (node)
+      {
+      node->SetAndObserveTransformNodeID(d->MRMLTransformNode->GetID());
+      }
+    }
+  if (d->RecordingSession)
+    {
+    d->SessionLog.appendEvent(qSlicerLITTPlanV2SessionLog::TransformNodes,
+                              nodeIDs);
+    }
+  d->ModelProxyManager->prepareProxies(d->transformedModels());
 }
 
 //-----------------------------------------------------------------------------
@@ -315,12 +809,552 @@ void qSlicerLITTPlanV2ModuleWidget::untransformSelectedNodes()
   QModelIndexList selectedIndexes =
     d->TransformedTreeView->selectionModel()->selectedRows();
   selectedIndexes = qMRMLTreeView::removeChildren(selectedIndexes);
+  QStringList nodeIDs;
   foreach(QModelIndex selectedIndex, selectedIndexes)
     {
     vtkMRMLTransformableNode* node = vtkMRMLTransformableNode::SafeDownCast(
     d->TransformedTreeView->sortFilterProxyModel()->
       mrmlNodeFromIndex( selectedIndex ));
     Q_ASSERT(node);
-    node->SetAndObserveTransformNodeID(0);
+    nodeIDs << node->GetID();
+    }
+  this->untransformNodes(nodeIDs);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::untransformNodes(const QStringList& nodeIDs)
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  if (!this->mrmlScene())
+    {
+    return;
+    }
+  foreach(const QString& nodeID, nodeIDs)
+    {
+    vtkMRMLTransformableNode* node = vtkMRMLTransformableNode::SafeDownCast(
+      this->mrmlScene()->GetNodeByID(nodeID.toLatin1()));
+    if (node)
+      {
+      node->SetAndObserveTransformNodeID(0);
+      }
+    }
+  if (d->RecordingSession)
+    {
+    d->SessionLog.appendEvent(qSlicerLITTPlanV2SessionLog::UntransformNodes,
+                              nodeIDs);
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ModuleWidget::optimizeTrajectory()
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  if (!d->MRMLTransformNode)
+    {
+    return false;
+    }
+  vtkMRMLModelNode* tumorModel = vtkMRMLModelNode::SafeDownCast(
+    d->TumorModelSelector->currentNode());
+  vtkMRMLModelNode* skullModel = vtkMRMLModelNode::SafeDownCast(
+    d->SkullModelSelector->currentNode());
+  if (!tumorModel || !tumorModel->GetPolyData() ||
+      !skullModel || !skullModel->GetPolyData())
+    {
+    d->TrajectoryStatusLabel->setText("Select a tumor and a skull model.");
+    return false;
+    }
+  // The pose found in RAS is written as a matrix to parent
+  vtkMRMLTransformNode* parentTransform =
+    d->MRMLTransformNode->GetParentTransformNode();
+  if (parentTransform && !parentTransform->IsTransformToWorldLinear())
+    {
+    d->TrajectoryStatusLabel->setText(
+      "The active transform is under a non linear transform.");
+    return false;
+    }
+  vtkSmartPointer<vtkPolyData> tumor = polyDataInRAS(tumorModel);
+  vtkSmartPointer<vtkPolyData> skull = polyDataInRAS(skullModel);
+  if (!tumor || !skull)
+    {
+    d->TrajectoryStatusLabel->setText(
+      "The tumor or the skull model is under a non linear transform.");
+    return false;
+    }
+
+  vtkSmartPointer<vtkLITTPlanV2TrajectoryOptimizer> optimizer =
+    vtkSmartPointer<vtkLITTPlanV2TrajectoryOptimizer>::New();
+  optimizer->SetTumor(tumor);
+  optimizer->SetSkull(skull);
+
+  vtkMRMLScalarVolumeNode* clearanceVolume =
+    vtkMRMLScalarVolumeNode::SafeDownCast(
+      d->ClearanceVolumeSelector->currentNode());
+  if (clearanceVolume && clearanceVolume->GetImageData())
+    {
+    vtkSmartPointer<vtkMatrix4x4> rasToIJK =
+      vtkSmartPointer<vtkMatrix4x4>::New();
+    clearanceVolume->GetRASToIJKMatrix(rasToIJK);
+    // The optimizer works in world RAS, like the tumor and the skull
+    vtkMRMLTransformNode* volumeTransform =
+      clearanceVolume->GetParentTransformNode();
+    if (volumeTransform && !volumeTransform->IsTransformToWorldLinear())
+      {
+      d->TrajectoryStatusLabel->setText(
+        "The clearance volume is under a non linear transform.");
+      return false;
+      }
+    if (volumeTransform)
+      {
+      vtkSmartPointer<vtkMatrix4x4> worldToVolume =
+        vtkSmartPointer<vtkMatrix4x4>::New();
+      volumeTransform->GetMatrixTransformToWorld(worldToVolume);
+      worldToVolume->Invert();
+      vtkSmartPointer<vtkMatrix4x4> volumeRASToIJK =
+        vtkSmartPointer<vtkMatrix4x4>::New();
+      volumeRASToIJK->DeepCopy(rasToIJK);
+      vtkMatrix4x4::Multiply4x4(volumeRASToIJK, worldToVolume, rasToIJK);
+      }
+    optimizer->SetClearanceMap(clearanceVolume->GetImageData(), rasToIJK);
+    }
+  qSlicerLITTPlanV2Module* littModule =
+    qobject_cast<qSlicerLITTPlanV2Module*>(this->module());
+  vtkMRMLModelNode* tractModel = vtkMRMLModelNode::SafeDownCast(
+    d->TractModelSelector->currentNode());
+  if (littModule && tractModel)
+    {
+    vtkMRMLTransformNode* tractTransform = tractModel->GetParentTransformNode();
+    if (tractTransform && !tractTransform->IsTransformToWorldLinear())
+      {
+      d->TrajectoryStatusLabel->setText(
+        "The tract model is under a non linear transform.");
+      return false;
+      }
+    optimizer->SetTractDensityGrid(littModule->tractDensityGrid(tractModel));
+    }
+
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  bool found = optimizer->Optimize();
+  QApplication::restoreOverrideCursor();
+  if (!found)
+    {
+    d->TrajectoryStatusLabel->setText("No trajectory reaches the skull.");
+    return false;
+    }
+
+  // The trajectory pose is in RAS, express it in the parent of the transform
+  vtkSmartPointer<vtkMatrix4x4> trajectoryToParent =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  optimizer->GetTrajectoryMatrix(trajectoryToParent);
+  if (parentTransform)
+    {
+    vtkSmartPointer<vtkMatrix4x4> worldToParent =
+      vtkSmartPointer<vtkMatrix4x4>::New();
+    parentTransform->GetMatrixTransformToWorld(worldToParent);
+    worldToParent->Invert();
+    vtkSmartPointer<vtkMatrix4x4> trajectoryToWorld =
+      vtkSmartPointer<vtkMatrix4x4>::New();
+    trajectoryToWorld->DeepCopy(trajectoryToParent);
+    vtkMatrix4x4::Multiply4x4(worldToParent, trajectoryToWorld,
+                              trajectoryToParent);
+    }
+  d->RotationSliders->resetUnactiveSliders();
+  // The optimization is logged instead of the matrix: the replay runs the
+  // optimizer again.
+  const bool recording = d->RecordingSession;
+  d->RecordingSession = false;
+  d->MRMLTransformNode->GetMatrixTransformToParent()->DeepCopy(
+    trajectoryToParent);
+  d->RecordingSession = recording;
+  if (d->RecordingSession || d->ReplayingSession)
+    {
+    QVector<double> trajectory;
+    trajectory << optimizer->GetEntry()[0] << optimizer->GetEntry()[1]
+               << optimizer->GetEntry()[2] << optimizer->GetDirection()[0]
+               << optimizer->GetDirection()[1] << optimizer->GetDirection()[2]
+               << optimizer->GetCost();
+    d->SessionTrajectories[d->MRMLTransformNode->GetID()] = trajectory;
+    }
+  if (d->RecordingSession)
+    {
+    qSlicerLITTPlanV2SessionLog::Event event;
+    event.Type = qSlicerLITTPlanV2SessionLog::OptimizeTrajectory;
+    event.TransformNodeID = d->MRMLTransformNode->GetID();
+    event.NodeIDs << nodeID(tumorModel) << nodeID(skullModel)
+                  << nodeID(clearanceVolume) << nodeID(tractModel);
+    d->SessionLog.append(event);
+    }
+
+  d->TrajectoryStatusLabel->setText(
+    QString("Cost %1, %2 after %3 iterations (%4 evaluations).\n"
+            "Coarse search: %5 s, refinement: %6 s")
+    .arg(optimizer->GetCost())
+    .arg(optimizer->GetConverged() ? "converged" : "not converged")
+    .arg(optimizer->GetNumberOfIterations())
+    .arg(optimizer->GetNumberOfEvaluations())
+    .arg(optimizer->GetCoarseSearchTime(), 0, 'f', 3)
+    .arg(optimizer->GetRefinementTime(), 0, 'f', 3));
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::hardenSelectedNodes()
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  QModelIndexList selectedIndexes =
+    d->TransformedTreeView->selectionModel()->selectedRows();
+  selectedIndexes = qMRMLTreeView::removeChildren(selectedIndexes);
+  // Harden the models only, the other nodes keep observing the transform
+  QStringList modelIDs;
+  foreach(QModelIndex selectedIndex, selectedIndexes)
+    {
+    vtkMRMLModelNode* model = vtkMRMLModelNode::SafeDownCast(
+      d->TransformedTreeView->sortFilterProxyModel()->
+        mrmlNodeFromIndex( selectedIndex ));
+    if (model)
+      {
+      modelIDs << model->GetID();
+      }
+    }
+  this->hardenNodes(modelIDs);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::hardenNodes(const QStringList& modelIDs)
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  if (!d->MRMLTransformNode || !this->mrmlScene())
+    {
+    return;
+    }
+  QApplication::setOverrideCursor(Qt::WaitCursor);
+  // Models refused because their transform to world is not linear
+  QStringList nonLinearModels;
+  foreach(const QString& modelID, modelIDs)
+    {
+    vtkMRMLModelNode* model = vtkMRMLModelNode::SafeDownCast(
+      this->mrmlScene()->GetNodeByID(modelID.toLatin1()));
+    if (!model)
+      {
+      continue;
+      }
+    if (vtkLITTPlanV2ModelHardener::CanHarden(model, d->MRMLTransformNode) ==
+        vtkLITTPlanV2ModelHardener::NonLinearTransform)
+      {
+      nonLinearModels << QString(model->GetName());
+      continue;
+      }
+    d->ModelHardener->Harden(model, d->MRMLTransformNode);
+    }
+  QApplication::restoreOverrideCursor();
+  d->HardenStatusLabel->setText(nonLinearModels.isEmpty() ? QString() :
+    QString("Not hardened, the transform to world is not linear: %1.")
+      .arg(nonLinearModels.join(", ")));
+  if (d->RecordingSession)
+    {
+    d->SessionLog.appendEvent(qSlicerLITTPlanV2SessionLog::HardenNodes,
+                              modelIDs);
+    }
+  // Hardened models keep following the transform through their proxies
+  d->ModelProxyManager->prepareProxies(d->transformedModels());
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::onSlidersValuesChanged()
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  if (!d->MRMLTransformNode || d->ReplayingSession)
+    {
+    return;
+    }
+  if (!d->ModelProxyManager->isInteracting())
+    {
+    d->ModelProxyManager->beginInteraction(d->transformedModels());
+    if (d->RecordingSession)
+      {
+      d->SessionLog.appendEvent(qSlicerLITTPlanV2SessionLog::BeginInteraction);
+      }
+    }
+  d->InteractionTimer->start();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::onInteractionEnded()
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  d->InteractionTimer->stop();
+  if (!d->ModelProxyManager->isInteracting())
+    {
+    return;
+    }
+  d->ModelProxyManager->endInteraction();
+  if (d->RecordingSession)
+    {
+    d->SessionLog.appendEvent(qSlicerLITTPlanV2SessionLog::EndInteraction);
+    }
+  if (d->MRMLTransformNode)
+    {
+    d->ModelHardener->UpdateHardenedModels(this->mrmlScene(),
+                                           d->MRMLTransformNode);
+    // The proxies of the updated models are out of date
+    d->ModelProxyManager->prepareProxies(d->transformedModels());
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::replayThermometry()
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  vtkMRMLScalarVolumeNode* reference = vtkMRMLScalarVolumeNode::SafeDownCast(
+    d->ThermometryReferenceVolumeSelector->currentNode());
+  if (!reference || !reference->GetImageData())
+    {
+    d->ThermometryStatusLabel->setText("Select the volume of the damage grid.");
+    return;
+    }
+  QString directory = QFileDialog::getExistingDirectory(
+    this, "Thermometry frames directory");
+  if (directory.isEmpty())
+    {
+    return;
+    }
+  d->ThermometryStream->stop();
+  d->ThermometryStream->setDamageVolumeNode(d->damageVolume(reference));
+  d->ThermometryStream->setTransformNode(d->MRMLTransformNode);
+  if (!d->ThermometryStream->replayDirectory(
+        directory, d->ThermometryFrameIntervalSpinBox->value()))
+    {
+    d->ThermometryStatusLabel->setText("No thermometry frame in the directory.");
+    return;
+    }
+  d->ThermometryStatusLabel->setText("Waiting for the first frame...");
+  d->ReplayThermometryPushButton->setEnabled(false);
+  d->StopThermometryPushButton->setEnabled(true);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::stopThermometry()
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  d->ThermometryStream->stop();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::onThermometryFrameProcessed(int frame,
+                                                                double time)
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  qSlicerLITTPlanV2ThermometryStream::Timings timings =
+    d->ThermometryStream->lastTimings();
+  d->ThermometryStatusLabel->setText(
+    QString("Frame %1 (%2 s), latency %3 ms.\n"
+            "Read: %4 ms, registration: %5 ms, accumulation: %6 ms, "
+            "display: %7 ms")
+    .arg(frame + 1)
+    .arg(time)
+    .arg(timings.Latency * 1000., 0, 'f', 1)
+    .arg(timings.Read * 1000., 0, 'f', 1)
+    .arg(timings.Registration * 1000., 0, 'f', 1)
+    .arg(timings.Accumulation * 1000., 0, 'f', 1)
+    .arg(timings.Display * 1000., 0, 'f', 1));
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::onThermometryFinished()
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  d->ReplayThermometryPushButton->setEnabled(true);
+  d->StopThermometryPushButton->setEnabled(false);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::startSessionRecording()
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  d->SessionLog.clear();
+  d->SessionLog.setSceneURL(
+    this->mrmlScene() && this->mrmlScene()->GetURL() ?
+    this->mrmlScene()->GetURL() : "");
+  // The scene may have been edited since it was saved: the replay checks it
+  // starts from the same state.
+  d->SessionTrajectories.clear();
+  d->SessionLog.setInitialState(d->captureState());
+  d->RecordingSession = true;
+  // The replay starts from the same active transform
+  d->SessionLog.appendSelectTransform(
+    d->MRMLTransformNode ? d->MRMLTransformNode->GetID() : "");
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ModuleWidget::stopSessionRecording(const QString& fileName)
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  if (!d->RecordingSession)
+    {
+    return false;
+    }
+  // Apply the edits deferred by a pending interaction before the capture
+  this->onInteractionEnded();
+  d->RecordingSession = false;
+  d->SessionLog.setFinalState(d->captureState());
+  if (!fileName.isEmpty() && !d->SessionLog.save(fileName))
+    {
+    // Don't lose the log: keep recording until it can be saved
+    d->RecordingSession = true;
+    return false;
+    }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ModuleWidget::isRecordingSession()const
+{
+  Q_D(const qSlicerLITTPlanV2ModuleWidget);
+  return d->RecordingSession;
+}
+
+//-----------------------------------------------------------------------------
+const qSlicerLITTPlanV2SessionLog& qSlicerLITTPlanV2ModuleWidget::sessionLog()const
+{
+  Q_D(const qSlicerLITTPlanV2ModuleWidget);
+  return d->SessionLog;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ModuleWidget::replaySession(
+  const qSlicerLITTPlanV2SessionLog& log, QVector<double>* latencies,
+  QStringList* differences)
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  vtkMRMLScene* scene = this->mrmlScene();
+  if (!scene)
+    {
+    return false;
+    }
+  // The events only reproduce the session on the state it was recorded on
+  QStringList initialDifferences = qSlicerLITTPlanV2SessionLog::compareStates(
+    log.initialState(), qSlicerLITTPlanV2SessionLog::captureState(scene));
+  if (!initialDifferences.isEmpty())
+    {
+    if (differences)
+      {
+      differences->clear();
+      foreach(const QString& difference, initialDifferences)
+        {
+        *differences << QString("Initial state: %1").arg(difference);
+        }
+      }
+    return false;
+    }
+  const bool recording = d->RecordingSession;
+  d->RecordingSession = false;
+  d->ReplayingSession = true;
+  d->SessionTrajectories.clear();
+  if (latencies)
+    {
+    latencies->clear();
+    latencies->reserve(log.events().count());
+    }
+  foreach(const qSlicerLITTPlanV2SessionLog::Event& event, log.events())
+    {
+    const double start = vtkTimerLog::GetUniversalTime();
+    switch (event.Type)
+      {
+      case qSlicerLITTPlanV2SessionLog::SelectTransform:
+        d->TransformNodeSelector->setCurrentNode(
+          scene->GetNodeByID(event.TransformNodeID.toLatin1()));
+        break;
+      case qSlicerLITTPlanV2SessionLog::SetMatrix:
+        {
+        vtkMRMLLinearTransformNode* transformNode =
+          vtkMRMLLinearTransformNode::SafeDownCast(
+            scene->GetNodeByID(event.TransformNodeID.toLatin1()));
+        if (transformNode)
+          {
+          transformNode->GetMatrixTransformToParent()->DeepCopy(event.Matrix);
+          }
+        }
+        break;
+      case qSlicerLITTPlanV2SessionLog::BeginInteraction:
+        if (d->MRMLTransformNode && !d->ModelProxyManager->isInteracting())
+          {
+          d->ModelProxyManager->beginInteraction(d->transformedModels());
+          }
+        break;
+      case qSlicerLITTPlanV2SessionLog::EndInteraction:
+        this->onInteractionEnded();
+        break;
+      case qSlicerLITTPlanV2SessionLog::TransformNodes:
+        this->transformNodes(event.NodeIDs);
+        break;
+      case qSlicerLITTPlanV2SessionLog::UntransformNodes:
+        this->untransformNodes(event.NodeIDs);
+        break;
+      case qSlicerLITTPlanV2SessionLog::HardenNodes:
+        this->hardenNodes(event.NodeIDs);
+        break;
+      case qSlicerLITTPlanV2SessionLog::OptimizeTrajectory:
+        d->TumorModelSelector->setCurrentNode(
+          scene->GetNodeByID(event.NodeIDs.value(0).toLatin1()));
+        d->SkullModelSelector->setCurrentNode(
+          scene->GetNodeByID(event.NodeIDs.value(1).toLatin1()));
+        d->ClearanceVolumeSelector->setCurrentNode(
+          scene->GetNodeByID(event.NodeIDs.value(2).toLatin1()));
+        d->TractModelSelector->setCurrentNode(
+          scene->GetNodeByID(event.NodeIDs.value(3).toLatin1()));
+        this->optimizeTrajectory();
+        break;
+      default:
+        break;
+      }
+    if (latencies)
+      {
+      *latencies << vtkTimerLog::GetUniversalTime() - start;
+      }
+    }
+  this->onInteractionEnded();
+  d->ReplayingSession = false;
+  d->RecordingSession = recording;
+
+  QStringList stateDifferences = qSlicerLITTPlanV2SessionLog::compareStates(
+    log.finalState(), d->captureState());
+  if (differences)
+    {
+    *differences = stateDifferences;
+    }
+  return stateDifferences.isEmpty();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ModuleWidget::onRecordSessionToggled(bool record)
+{
+  Q_D(qSlicerLITTPlanV2ModuleWidget);
+  if (record)
+    {
+    this->startSessionRecording();
+    d->SessionStatusLabel->setText("Recording...");
+    return;
+    }
+  QString fileName = QFileDialog::getSaveFileName(
+    this, "Save session log", QString(), "Session logs (*.lpl)");
+  QString error;
+  if (fileName.isEmpty())
+    {
+    error = "Not saved";
+    }
+  else if (!this->stopSessionRecording(fileName))
+    {
+    error = QString("Can't write %1").arg(fileName);
+    }
+  if (!error.isEmpty())
+    {
+    // Still recording: the log is saved when the recording is stopped again
+    bool wasBlocking = d->RecordSessionPushButton->blockSignals(true);
+    d->RecordSessionPushButton->setChecked(true);
+    d->RecordSessionPushButton->blockSignals(wasBlocking);
+    d->SessionStatusLabel->setText(
+      QString("%1, still recording...").arg(error));
+    return;
     }
+  d->SessionStatusLabel->setText(
+    QString("%1 events recorded").arg(d->SessionLog.events().count()));
 }
@@ -21,6 +21,10 @@
 #ifndef __qSlicerLITTPlanV2ModuleWidget_h
 #define __qSlicerLITTPlanV2ModuleWidget_h
 
+// Qt includes
+#include <QStringList>
+#include <QVector>
+
 // SlicerQt includes
 #include "qSlicerAbstractModuleWidget.h"
 
@@ -29,6 +33,8 @@
 
 class vtkMatrix4x4;
 class vtkMRMLNode;
+class qSlicerLITTPlanV2CoordinateReferenceEngine;
+class qSlicerLITTPlanV2SessionLog;
 class qSlicerLITTPlanV2ModuleWidgetPrivate;
 
 class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT qSlicerLITTPlanV2ModuleWidget :
@@ -45,6 +51,25 @@ public:
   /// Reimplemented for internal reasons
   void setMRMLScene(vtkMRMLScene* scene);
 
+  /// Conversions between the coordinate references. The nodes of the
+  /// stereotactic frame, AC-PC and tracker references are set there, or
+  /// with the reference node selector of the panel.
+  qSlicerLITTPlanV2CoordinateReferenceEngine* coordinateReferenceEngine()const;
+
+  /// Log of the session being (or last) recorded
+  const qSlicerLITTPlanV2SessionLog& sessionLog()const;
+  bool isRecordingSession()const;
+
+  /// Replay the events of a session log as fast as possible, on the scene
+  /// the session was recorded on. Nothing is replayed if the scene differs
+  /// from the initial state of the log. The latency (seconds) of each event
+  /// is appended to latencies. Returns true if the final state of the scene
+  /// and the trajectories optimized are bit-identical to the state recorded,
+  /// the differences otherwise.
+  bool replaySession(const qSlicerLITTPlanV2SessionLog& log,
+                     QVector<double>* latencies = 0,
+                     QStringList* differences = 0);
+
 public slots:
   /// Set the matrix to identity, the sliders are reset to the position 0
   void identity();
@@ -52,16 +77,54 @@ public slots:
   /// Invert the matrix. The sliders are reset to the position 0.
   void invert();
 
+  /// Search the best trajectory to the selected tumor and write its pose
+  /// into the active transform. Returns false if no trajectory is found.
+  /// \sa vtkLITTPlanV2TrajectoryOptimizer
+  bool optimizeTrajectory();
+
+  /// Transform the nodes with the active transform
+  void transformNodes(const QStringList& nodeIDs);
+  void untransformNodes(const QStringList& nodeIDs);
+  /// Bake the active transform into the models
+  void hardenNodes(const QStringList& modelIDs);
+
+  /// Record the edits and actions of the session into sessionLog(), from
+  /// the current state of the scene
+  void startSessionRecording();
+  /// Stop recording, capture the final state and save the log if a file
+  /// name is given. Returns false, and keeps recording, if the log can't be
+  /// saved.
+  bool stopSessionRecording(const QString& fileName = QString());
+
 protected:
   virtual void setup();
 
 protected slots:
   void onCoordinateReferenceButtonPressed(int id);
+  /// Set the node placing the engine reference selected
+  void onReferenceNodeSelected(vtkMRMLNode* node);
+  void onReferenceNodeModified();
+  /// Apply the edits of the sliders in an engine reference to the active
+  /// transform
+  void onReferenceTransformModified();
   void onNodeSelected(vtkMRMLNode* node);
   void onTranslationRangeChanged(double newMin, double newMax);
 
   void transformSelectedNodes();
   void untransformSelectedNodes();
+  /// Bake the active transform into the selected transformed models
+  void hardenSelectedNodes();
+  /// Display the decimated proxies of the transformed models while the
+  /// sliders are dragged
+  void onSlidersValuesChanged();
+  /// Restore the full resolution models once the sliders are idle
+  void onInteractionEnded();
+  /// Replay the thermometry frames of a directory chosen by the user
+  void replayThermometry();
+  void stopThermometry();
+  void onThermometryFrameProcessed(int frame, double time);
+  void onThermometryFinished();
+  void onRecordSessionToggled(bool record);
   /// 
   /// Triggered upon MRML transform node updates
   void onMRMLTransformNodeModified(vtkObject* caller);
@@ -75,7 +138,11 @@ protected:
   void extractMinMaxTranslationValue(vtkMatrix4x4 * mat, double& min, double& max);
 
   /// 
-  /// Convenient method to return the coordinate system currently selected
+  /// Convenient method to return the coordinate system currently selected:
+  /// qMRMLTransformSliders::GLOBAL or LOCAL, converted by the engine as the
+  /// World and Parent references, or the
+  /// qSlicerLITTPlanV2CoordinateReferenceEngine::Reference StereotacticFrame,
+  /// ACPC or Tracker.
   int coordinateReference()const;
 
 protected:
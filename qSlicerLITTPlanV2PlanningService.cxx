@@ -0,0 +1,589 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRegExp>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QVector>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2PlanningService.h"
+#include "qSlicerLITTPlanV2SharedAssetCache.h"
+
+// Logic includes
+#include "vtkSlicerTransformLogic.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkDataObject.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+
+namespace
+{
+//-----------------------------------------------------------------------------
+QStringList splitRequest(const QString& request)
+{
+  if (request.contains('\t'))
+    {
+    return request.split('\t', QString::SkipEmptyParts);
+    }
+  return request.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+}
+
+//-----------------------------------------------------------------------------
+struct Session
+{
+  vtkSmartPointer<vtkMRMLScene> Scene;
+  vtkSmartPointer<vtkSlicerTransformLogic> Logic;
+  QStringList Assets;
+  /// Serialize the requests on the session: a scene is not thread-safe.
+  QMutex Mutex;
+};
+typedef QSharedPointer<Session> SessionPointer;
+
+//-----------------------------------------------------------------------------
+/// Latency of a command. Percentiles are computed on the last
+/// MaximumNumberOfSamples requests.
+struct LatencyStatistics
+{
+  enum { MaximumNumberOfSamples = 1024 };
+  LatencyStatistics() : Count(0), Total(0.), Maximum(0.) {}
+
+  void add(double latency)
+  {
+    ++this->Count;
+    this->Total += latency;
+    this->Maximum = std::max(this->Maximum, latency);
+    if (this->Samples.size() < MaximumNumberOfSamples)
+      {
+      this->Samples.append(latency);
+      }
+    else
+      {
+      this->Samples[(this->Count - 1) % MaximumNumberOfSamples] = latency;
+      }
+  }
+
+  double percentile(double p)const
+  {
+    if (this->Samples.isEmpty())
+      {
+      return 0.;
+      }
+    QVector<double> sorted = this->Samples;
+    std::sort(sorted.begin(), sorted.end());
+    int index = static_cast<int>(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+  }
+
+  int Count;
+  double Total;
+  double Maximum;
+  QVector<double> Samples;
+};
+}
+
+//-----------------------------------------------------------------------------
+class qSlicerLITTPlanV2PlanningServicePrivate
+{
+  Q_DECLARE_PUBLIC(qSlicerLITTPlanV2PlanningService);
+protected:
+  qSlicerLITTPlanV2PlanningService* const q_ptr;
+public:
+  qSlicerLITTPlanV2PlanningServicePrivate(qSlicerLITTPlanV2PlanningService& object);
+
+  /// Execute the command (request without tag), thread-safe.
+  QString execute(const QStringList& arguments);
+  SessionPointer session(const QString& caseID)const;
+  /// Add a node viewing the acquired asset into the session scene.
+  /// Returns the node ID, empty if the asset is not an image or a polydata.
+  QString addAssetNode(const SessionPointer& session, const QString& fileName);
+  void recordLatency(const QString& command, qint64 nanoseconds);
+
+  QLocalServer*                 Server;
+  QThreadPool                   ThreadPool;
+  int                           MaximumPendingRequests;
+  int                           PendingRequests;
+  int                           LastConnectionID;
+  QHash<int, QLocalSocket*>     Connections;
+
+  mutable QMutex                SessionsMutex;
+  QHash<QString, SessionPointer> Sessions;
+
+  mutable QMutex                StatisticsMutex;
+  QMap<QString, LatencyStatistics> Statistics;
+
+  qSlicerLITTPlanV2SharedAssetCache SharedAssets;
+};
+
+//-----------------------------------------------------------------------------
+/// Request received on a connection, executed by the thread pool
+class qSlicerLITTPlanV2PlanningRequest : public QRunnable
+{
+public:
+  qSlicerLITTPlanV2PlanningRequest(qSlicerLITTPlanV2PlanningService* service,
+                                   qSlicerLITTPlanV2PlanningServicePrivate* d,
+                                   int connectionID, const QStringList& arguments)
+    : Service(service), D(d), ConnectionID(connectionID), Arguments(arguments)
+  {
+    // The latency includes the time spent in the queue.
+    this->Timer.start();
+  }
+
+  virtual void run()
+  {
+    QString tag = this->Arguments.takeFirst();
+    QString reply = this->D->execute(this->Arguments);
+    this->D->recordLatency(this->Arguments.value(0).toUpper(),
+                           this->Timer.nsecsElapsed());
+    QMetaObject::invokeMethod(this->Service, "onRequestDone",
+                              Qt::QueuedConnection,
+                              Q_ARG(int, this->ConnectionID),
+                              Q_ARG(QString, tag + " " + reply));
+  }
+
+protected:
+  qSlicerLITTPlanV2PlanningService* Service;
+  qSlicerLITTPlanV2PlanningServicePrivate* D;
+  int ConnectionID;
+  QStringList Arguments;
+  QElapsedTimer Timer;
+};
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2PlanningServicePrivate::qSlicerLITTPlanV2PlanningServicePrivate(
+  qSlicerLITTPlanV2PlanningService& object)
+  : q_ptr(&object)
+{
+  this->Server = 0;
+  this->MaximumPendingRequests = 256;
+  this->PendingRequests = 0;
+  this->LastConnectionID = 0;
+}
+
+//-----------------------------------------------------------------------------
+SessionPointer qSlicerLITTPlanV2PlanningServicePrivate::session(
+  const QString& caseID)const
+{
+  QMutexLocker locker(&this->SessionsMutex);
+  return this->Sessions.value(caseID);
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2PlanningServicePrivate::addAssetNode(
+  const SessionPointer& session, const QString& fileName)
+{
+  vtkSmartPointer<vtkDataObject> view;
+  view.TakeReference(this->SharedAssets.newView(fileName));
+  vtkSmartPointer<vtkMRMLNode> node;
+  if (vtkImageData* image = vtkImageData::SafeDownCast(view))
+    {
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> volumeNode =
+      vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    vtkSmartPointer<vtkMatrix4x4> ijkToRAS = vtkSmartPointer<vtkMatrix4x4>::New();
+    this->SharedAssets.ijkToRASMatrix(fileName, ijkToRAS);
+    volumeNode->SetIJKToRASMatrix(ijkToRAS);
+    volumeNode->SetAndObserveImageData(image);
+    node = volumeNode;
+    }
+  else if (vtkPolyData* polyData = vtkPolyData::SafeDownCast(view))
+    {
+    vtkSmartPointer<vtkMRMLModelNode> modelNode =
+      vtkSmartPointer<vtkMRMLModelNode>::New();
+    modelNode->SetAndObservePolyData(polyData);
+    node = modelNode;
+    }
+  if (!node)
+    {
+    return QString();
+    }
+  node->SetName(QFileInfo(fileName).completeBaseName().toLatin1());
+  // The data aliases the shared asset: mark it read-only
+  node->SetAttribute(qSlicerLITTPlanV2SharedAssetCache::sharedAssetAttributeName(),
+                     fileName.toLatin1());
+  session->Scene->AddNode(node);
+  return node->GetID();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningServicePrivate::recordLatency(
+  const QString& command, qint64 nanoseconds)
+{
+  QMutexLocker locker(&this->StatisticsMutex);
+  this->Statistics[command].add(nanoseconds / 1e6);
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2PlanningServicePrivate::execute(
+  const QStringList& arguments)
+{
+  Q_Q(qSlicerLITTPlanV2PlanningService);
+  const QString command = arguments.value(0).toUpper();
+  const QString caseID = arguments.value(1);
+
+  if (command == "CASES")
+    {
+    return QString("OK %1").arg(q->cases().join(" ")).trimmed();
+    }
+  if (command == "STATS")
+    {
+    return QString("OK %1").arg(q->statistics()).trimmed();
+    }
+  if (command == "OPEN")
+    {
+    if (caseID.isEmpty())
+      {
+      return "ERROR missing case";
+      }
+    SessionPointer session(new Session);
+    session->Scene = vtkSmartPointer<vtkMRMLScene>::New();
+    session->Logic = vtkSmartPointer<vtkSlicerTransformLogic>::New();
+    session->Logic->SetMRMLScene(session->Scene);
+    QMutexLocker locker(&this->SessionsMutex);
+    if (this->Sessions.contains(caseID))
+      {
+      return "ERROR case already opened";
+      }
+    this->Sessions[caseID] = session;
+    return "OK";
+    }
+  if (command == "CLOSE")
+    {
+    SessionPointer session;
+      {
+      QMutexLocker locker(&this->SessionsMutex);
+      session = this->Sessions.take(caseID);
+      }
+    if (!session)
+      {
+      return "ERROR unknown case";
+      }
+    // Wait for the requests being executed on the session
+    QMutexLocker sessionLocker(&session->Mutex);
+    // The nodes viewing the assets must be gone before the assets are
+    session->Scene->Clear(1);
+    foreach(const QString& asset, session->Assets)
+      {
+      this->SharedAssets.release(asset);
+      }
+    session->Assets.clear();
+    return "OK";
+    }
+
+  // Commands on a session
+  SessionPointer session = this->session(caseID);
+  if (!session)
+    {
+    return "ERROR unknown case";
+    }
+  QMutexLocker sessionLocker(&session->Mutex);
+  if (command == "ACQUIRE")
+    {
+    QString fileName = arguments.value(2);
+    vtkDataObject* asset = this->SharedAssets.acquire(fileName);
+    if (!asset)
+      {
+      return "ERROR can't read asset";
+      }
+    session->Assets << fileName;
+    QString nodeID = this->addAssetNode(session, fileName);
+    return QString("OK %1 %2").arg(asset->GetClassName()).arg(nodeID).trimmed();
+    }
+  if (command == "LOAD_TRANSFORM")
+    {
+    QString fileName = arguments.value(2);
+    vtkMRMLTransformNode* node = session->Logic->AddTransform(
+      fileName.toLatin1(), session->Scene);
+    if (!node)
+      {
+      return "ERROR can't read transform";
+      }
+    return QString("OK %1").arg(node->GetID());
+    }
+  if (command == "MATRIX")
+    {
+    vtkMRMLLinearTransformNode* node = vtkMRMLLinearTransformNode::SafeDownCast(
+      session->Scene->GetNodeByID(arguments.value(2).toLatin1()));
+    if (!node)
+      {
+      return "ERROR unknown linear transform";
+      }
+    vtkMatrix4x4* matrix = node->GetMatrixTransformToParent();
+    QStringList elements;
+    for (int i = 0; i < 4; ++i)
+      {
+      for (int j = 0; j < 4; ++j)
+        {
+        elements << QString::number(matrix->GetElement(i, j), 'g', 17);
+        }
+      }
+    return QString("OK %1").arg(elements.join(" "));
+    }
+  return QString("ERROR unknown command %1").arg(command);
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2PlanningService::qSlicerLITTPlanV2PlanningService(QObject* _parent)
+  : Superclass(_parent)
+  , d_ptr(new qSlicerLITTPlanV2PlanningServicePrivate(*this))
+{
+  Q_D(qSlicerLITTPlanV2PlanningService);
+  d->Server = new QLocalServer(this);
+  this->connect(d->Server, SIGNAL(newConnection()),
+                SLOT(onNewConnection()));
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2PlanningService::~qSlicerLITTPlanV2PlanningService()
+{
+  Q_D(qSlicerLITTPlanV2PlanningService);
+  this->close();
+  d->ThreadPool.waitForDone();
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2PlanningService::listen(const QString& name)
+{
+  Q_D(qSlicerLITTPlanV2PlanningService);
+  // Remove a socket left over by a crashed service
+  QLocalServer::removeServer(name);
+  if (!d->Server->listen(name))
+    {
+    qWarning() << "Planning service can't listen on" << name << ":"
+               << d->Server->errorString();
+    return false;
+    }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningService::close()
+{
+  Q_D(qSlicerLITTPlanV2PlanningService);
+  d->Server->close();
+  foreach(QLocalSocket* socket, d->Connections)
+    {
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+    }
+  d->Connections.clear();
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2PlanningService::isListening()const
+{
+  Q_D(const qSlicerLITTPlanV2PlanningService);
+  return d->Server->isListening();
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2PlanningService::serverName()const
+{
+  Q_D(const qSlicerLITTPlanV2PlanningService);
+  return d->Server->serverName();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningService::setMaximumThreadCount(int count)
+{
+  Q_D(qSlicerLITTPlanV2PlanningService);
+  d->ThreadPool.setMaxThreadCount(qMax(1, count));
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerLITTPlanV2PlanningService::maximumThreadCount()const
+{
+  Q_D(const qSlicerLITTPlanV2PlanningService);
+  return d->ThreadPool.maxThreadCount();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningService::setMaximumPendingRequests(int count)
+{
+  Q_D(qSlicerLITTPlanV2PlanningService);
+  d->MaximumPendingRequests = qMax(1, count);
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerLITTPlanV2PlanningService::maximumPendingRequests()const
+{
+  Q_D(const qSlicerLITTPlanV2PlanningService);
+  return d->MaximumPendingRequests;
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2SharedAssetCache* qSlicerLITTPlanV2PlanningService::sharedAssets()const
+{
+  Q_D(const qSlicerLITTPlanV2PlanningService);
+  return const_cast<qSlicerLITTPlanV2SharedAssetCache*>(&d->SharedAssets);
+}
+
+//-----------------------------------------------------------------------------
+QStringList qSlicerLITTPlanV2PlanningService::cases()const
+{
+  Q_D(const qSlicerLITTPlanV2PlanningService);
+  QMutexLocker locker(&d->SessionsMutex);
+  QStringList caseIDs = d->Sessions.keys();
+  caseIDs.sort();
+  return caseIDs;
+}
+
+//-----------------------------------------------------------------------------
+vtkMRMLScene* qSlicerLITTPlanV2PlanningService::scene(const QString& caseID)const
+{
+  Q_D(const qSlicerLITTPlanV2PlanningService);
+  SessionPointer session = d->session(caseID);
+  return session ? session->Scene.GetPointer() : 0;
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2PlanningService::execute(const QString& request)
+{
+  Q_D(qSlicerLITTPlanV2PlanningService);
+  QElapsedTimer timer;
+  timer.start();
+  QStringList arguments = splitRequest(request);
+  QString reply = d->execute(arguments);
+  d->recordLatency(arguments.value(0).toUpper(), timer.nsecsElapsed());
+  return reply;
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2PlanningService::statistics()const
+{
+  Q_D(const qSlicerLITTPlanV2PlanningService);
+  QMutexLocker locker(&d->StatisticsMutex);
+  QStringList commands;
+  QMap<QString, LatencyStatistics>::const_iterator it;
+  for (it = d->Statistics.constBegin(); it != d->Statistics.constEnd(); ++it)
+    {
+    const LatencyStatistics& stats = it.value();
+    commands << QString("%1 count=%2 mean=%3 p50=%4 p95=%5 max=%6")
+      .arg(it.key()).arg(stats.Count)
+      .arg(stats.Count ? stats.Total / stats.Count : 0.)
+      .arg(stats.percentile(0.5)).arg(stats.percentile(0.95))
+      .arg(stats.Maximum);
+    }
+  return commands.join("\t");
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningService::waitForDone()
+{
+  Q_D(qSlicerLITTPlanV2PlanningService);
+  d->ThreadPool.waitForDone();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningService::onNewConnection()
+{
+  Q_D(qSlicerLITTPlanV2PlanningService);
+  while (d->Server->hasPendingConnections())
+    {
+    QLocalSocket* socket = d->Server->nextPendingConnection();
+    int connectionID = ++d->LastConnectionID;
+    socket->setProperty("connectionID", connectionID);
+    d->Connections[connectionID] = socket;
+    this->connect(socket, SIGNAL(readyRead()), SLOT(onReadyRead()));
+    this->connect(socket, SIGNAL(disconnected()), SLOT(onDisconnected()));
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningService::onReadyRead()
+{
+  Q_D(qSlicerLITTPlanV2PlanningService);
+  QLocalSocket* socket = qobject_cast<QLocalSocket*>(this->sender());
+  if (!socket)
+    {
+    return;
+    }
+  int connectionID = socket->property("connectionID").toInt();
+  while (socket->canReadLine())
+    {
+    QString line = QString::fromUtf8(socket->readLine()).trimmed();
+    QStringList arguments = splitRequest(line);
+    if (arguments.isEmpty())
+      {
+      continue;
+      }
+    if (arguments.count() < 2)
+      {
+      socket->write(QString("%1 ERROR missing command\n")
+                    .arg(arguments[0]).toUtf8());
+      continue;
+      }
+    if (d->PendingRequests >= d->MaximumPendingRequests)
+      {
+      socket->write(QString("%1 ERROR busy\n").arg(arguments[0]).toUtf8());
+      continue;
+      }
+    ++d->PendingRequests;
+    d->ThreadPool.start(new qSlicerLITTPlanV2PlanningRequest(
+      this, d, connectionID, arguments));
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningService::onDisconnected()
+{
+  Q_D(qSlicerLITTPlanV2PlanningService);
+  QLocalSocket* socket = qobject_cast<QLocalSocket*>(this->sender());
+  if (!socket)
+    {
+    return;
+    }
+  d->Connections.remove(socket->property("connectionID").toInt());
+  socket->deleteLater();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2PlanningService::onRequestDone(int connectionID,
+                                                    const QString& reply)
+{
+  Q_D(qSlicerLITTPlanV2PlanningService);
+  --d->PendingRequests;
+  // The client may have disconnected in the meantime
+  QLocalSocket* socket = d->Connections.value(connectionID);
+  if (socket)
+    {
+    socket->write((reply + "\n").toUtf8());
+    }
+}
@@ -0,0 +1,120 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __qSlicerLITTPlanV2PlanningService_h
+#define __qSlicerLITTPlanV2PlanningService_h
+
+// Qt includes
+#include <QObject>
+#include <QStringList>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModuleExport.h"
+
+class qSlicerLITTPlanV2PlanningServicePrivate;
+class qSlicerLITTPlanV2SharedAssetCache;
+class vtkMRMLScene;
+
+/// \ingroup Slicer_QtModules_LITTPlanV2
+/// Planning service serving several cases at once on a local socket.
+///
+/// Each case (session) owns an isolated MRML scene and its own transform
+/// logic. Read-only assets are loaded once in a shared asset cache and
+/// reference counted by the sessions using them.
+/// Requests are executed on a bounded thread pool: requests on different
+/// cases run concurrently, requests on the same case are serialized.
+///
+/// The protocol is line based. Each request line is
+///   <tag> <command> [arguments...]
+/// and is answered, possibly out of order, by a single line
+///   <tag> OK [results...]  or  <tag> ERROR <message>
+/// Arguments are separated by tabs if they contain spaces, by spaces
+/// otherwise. Commands:
+///   OPEN <case>                    create a session
+///   CLOSE <case>                   delete a session and release its assets
+///   ACQUIRE <case> <file>          share a read-only asset with the session,
+///                                  returns its class and the ID of the
+///                                  volume or model node viewing it in the
+///                                  case scene
+///   LOAD_TRANSFORM <case> <file>   read a transform, returns the node ID
+///   MATRIX <case> <nodeID>         returns the 16 elements of the matrix to
+///                                  parent of a linear transform node
+///   CASES                          returns the opened cases
+///   STATS                          returns, per command, the number of
+///                                  requests and the mean/50th/95th/max
+///                                  latencies in ms
+class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT qSlicerLITTPlanV2PlanningService
+  : public QObject
+{
+  Q_OBJECT
+public:
+  typedef QObject Superclass;
+  qSlicerLITTPlanV2PlanningService(QObject* parent = 0);
+  virtual ~qSlicerLITTPlanV2PlanningService();
+
+  /// Start listening on the local socket (named pipe on Windows).
+  /// Returns false if the server can't listen.
+  bool listen(const QString& serverName);
+  void close();
+  bool isListening()const;
+  QString serverName()const;
+
+  /// Maximum number of requests executed at the same time. Default is the
+  /// ideal thread count.
+  void setMaximumThreadCount(int count);
+  int maximumThreadCount()const;
+
+  /// Maximum number of requests waiting for, or being executed. Requests
+  /// received beyond are rejected with "ERROR busy". Default is 256.
+  void setMaximumPendingRequests(int count);
+  int maximumPendingRequests()const;
+
+  /// Read-only data shared by the sessions
+  qSlicerLITTPlanV2SharedAssetCache* sharedAssets()const;
+
+  /// Opened cases
+  QStringList cases()const;
+
+  /// Scene of the case, 0 if the case is not opened. The scene must only be
+  /// accessed when no request is being executed for the case.
+  vtkMRMLScene* scene(const QString& caseID)const;
+
+  /// Execute a request line synchronously, in the calling thread, and return
+  /// the reply line without the tag. Used by the socket connections.
+  QString execute(const QString& request);
+
+  /// Latency statistics as returned by the STATS command
+  QString statistics()const;
+
+  /// Wait for all the pending requests to be executed
+  void waitForDone();
+
+protected slots:
+  void onNewConnection();
+  void onReadyRead();
+  void onDisconnected();
+  void onRequestDone(int connectionID, const QString& reply);
+
+protected:
+  QScopedPointer<qSlicerLITTPlanV2PlanningServicePrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(qSlicerLITTPlanV2PlanningService);
+  Q_DISABLE_COPY(qSlicerLITTPlanV2PlanningService);
+};
+
+#endif
@@ -0,0 +1,696 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ResultCache.h"
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkIdTypeArray.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+// STD includes
+#include <cstring>
+#ifdef Q_OS_WIN
+# include <sys/utime.h>
+#else
+# include <utime.h>
+#endif
+
+namespace
+{
+const char Magic[8] = {'L', 'I', 'T', 'T', 'R', 'E', 'S', '1'};
+const quint32 ByteOrderMark = 0x01020304;
+const qint64 Alignment = 64;
+const char* Suffix = ".lpc";
+
+//-----------------------------------------------------------------------------
+/// Layout of the beginning of the files, followed by NumberOfArrays
+/// ArrayHeader. Only files written on a machine with the same byte order
+/// are read.
+struct FileHeader
+{
+  char Magic[8];
+  quint32 ByteOrder;
+  quint32 NumberOfArrays;
+  qint32 Extent[6];
+  double Origin[3];
+  double Spacing[3];
+};
+
+//-----------------------------------------------------------------------------
+struct ArrayHeader
+{
+  char Name[64];
+  qint32 DataType;
+  qint32 NumberOfComponents;
+  qint64 NumberOfTuples;
+  /// Offset of the values from the beginning of the file, multiple of
+  /// Alignment
+  qint64 Offset;
+  quint32 Scalars;
+  quint32 Padding;
+};
+
+//-----------------------------------------------------------------------------
+qint64 align(qint64 offset)
+{
+  return (offset + Alignment - 1) / Alignment * Alignment;
+}
+
+//-----------------------------------------------------------------------------
+void addData(QCryptographicHash& hash, const void* data, qint64 size)
+{
+  const char* bytes = static_cast<const char*>(data);
+  const qint64 chunkSize = 1 << 30;
+  for (qint64 start = 0; start < size; start += chunkSize)
+    {
+    hash.addData(bytes + start, static_cast<int>(qMin(chunkSize, size - start)));
+    }
+}
+
+//-----------------------------------------------------------------------------
+void addCellArray(QCryptographicHash& hash, vtkCellArray* cells)
+{
+  vtkIdTypeArray* data = cells ? cells->GetData() : 0;
+  qint64 size = data ? data->GetNumberOfTuples() : 0;
+  hash.addData(reinterpret_cast<const char*>(&size), sizeof(size));
+  if (size > 0)
+    {
+    addData(hash, data->GetVoidPointer(0), size * sizeof(vtkIdType));
+    }
+}
+
+//-----------------------------------------------------------------------------
+/// File shared by the memory mapped arrays of a result, closed (and
+/// unmapped) when the last array is deleted.
+struct MappedFile
+{
+  MappedFile(const QString& fileName) : File(fileName), References(0) {}
+  QFile File;
+  QAtomicInt References;
+};
+
+//-----------------------------------------------------------------------------
+void onMappedArrayDeleted(vtkObject* vtkNotUsed(caller),
+                          unsigned long vtkNotUsed(eventId),
+                          void* clientData, void* vtkNotUsed(callData))
+{
+  MappedFile* mappedFile = static_cast<MappedFile*>(clientData);
+  if (!mappedFile->References.deref())
+    {
+    delete mappedFile;
+    }
+}
+
+//-----------------------------------------------------------------------------
+/// Mark the file as recently used
+void touch(const QString& fileName)
+{
+  utime(QFile::encodeName(fileName).constData(), 0);
+}
+}
+
+//-----------------------------------------------------------------------------
+class qSlicerLITTPlanV2ResultCachePrivate
+{
+public:
+  qSlicerLITTPlanV2ResultCachePrivate();
+
+  QString filePath(const QString& key)const;
+  /// Compute Size from the files on disk if unknown
+  void updateSize();
+  /// Remove the least recently used results, but the one stored under
+  /// keep, until the cache fits into MaximumSize
+  void evict(const QString& keep = QString());
+  /// Remove the result file, e.g. because it is corrupted
+  void remove(const QString& fileName);
+
+  QString Directory;
+  qint64 MaximumSize;
+  /// -1 until the directory is scanned
+  qint64 Size;
+  int Hits;
+  int Misses;
+  mutable QMutex Mutex;
+};
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2ResultCachePrivate::qSlicerLITTPlanV2ResultCachePrivate()
+{
+  this->MaximumSize = Q_INT64_C(4) << 30;
+  this->Size = -1;
+  this->Hits = 0;
+  this->Misses = 0;
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2ResultCachePrivate::filePath(const QString& key)const
+{
+  return QDir(this->Directory).filePath(key + Suffix);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ResultCachePrivate::updateSize()
+{
+  if (this->Size >= 0)
+    {
+    return;
+    }
+  this->Size = 0;
+  foreach(const QFileInfo& fileInfo, QDir(this->Directory).entryInfoList(
+            QStringList() << QString("*") + Suffix, QDir::Files))
+    {
+    this->Size += fileInfo.size();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ResultCachePrivate::evict(const QString& keep)
+{
+  this->updateSize();
+  if (this->Size <= this->MaximumSize)
+    {
+    return;
+    }
+  QFileInfoList results = QDir(this->Directory).entryInfoList(
+    QStringList() << QString("*") + Suffix, QDir::Files, QDir::Time | QDir::Reversed);
+  foreach(const QFileInfo& fileInfo, results)
+    {
+    if (this->Size <= this->MaximumSize)
+      {
+      break;
+      }
+    if (fileInfo.completeBaseName() == keep)
+      {
+      continue;
+      }
+    // A mapped file can't be removed on Windows, it will be next time.
+    if (QFile::remove(fileInfo.absoluteFilePath()))
+      {
+      this->Size -= fileInfo.size();
+      }
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ResultCachePrivate::remove(const QString& fileName)
+{
+  const qint64 size = QFileInfo(fileName).size();
+  if (QFile::remove(fileName) && this->Size >= 0)
+    {
+    this->Size -= size;
+    }
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2ResultCache::qSlicerLITTPlanV2ResultCache(const QString& directory)
+  : d_ptr(new qSlicerLITTPlanV2ResultCachePrivate)
+{
+  Q_D(qSlicerLITTPlanV2ResultCache);
+  d->Directory = directory;
+  if (d->Directory.isEmpty())
+    {
+    QString cacheLocation =
+      QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+    if (cacheLocation.isEmpty())
+      {
+      cacheLocation = QDir::tempPath();
+      }
+    d->Directory = QDir(cacheLocation).filePath("LITTPlanV2");
+    }
+  QDir().mkpath(d->Directory);
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2ResultCache::~qSlicerLITTPlanV2ResultCache()
+{
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2ResultCache::directory()const
+{
+  Q_D(const qSlicerLITTPlanV2ResultCache);
+  return d->Directory;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ResultCache::setMaximumSize(qint64 size)
+{
+  Q_D(qSlicerLITTPlanV2ResultCache);
+  QMutexLocker locker(&d->Mutex);
+  d->MaximumSize = size;
+  d->evict();
+}
+
+//-----------------------------------------------------------------------------
+qint64 qSlicerLITTPlanV2ResultCache::maximumSize()const
+{
+  Q_D(const qSlicerLITTPlanV2ResultCache);
+  QMutexLocker locker(&d->Mutex);
+  return d->MaximumSize;
+}
+
+//-----------------------------------------------------------------------------
+qint64 qSlicerLITTPlanV2ResultCache::size()const
+{
+  Q_D(const qSlicerLITTPlanV2ResultCache);
+  QMutexLocker locker(&d->Mutex);
+  const_cast<qSlicerLITTPlanV2ResultCachePrivate*>(d)->updateSize();
+  return d->Size;
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2ResultCache::key(const QString& algorithm, int version,
+                                          const QList<QByteArray>& hashes)
+{
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  hash.addData(algorithm.toUtf8());
+  hash.addData(QByteArray::number(version));
+  foreach(const QByteArray& inputHash, hashes)
+    {
+    // Prefix the hashes with their size so that the key is not ambiguous
+    hash.addData(QByteArray::number(inputHash.size()) + ':');
+    hash.addData(inputHash);
+    }
+  return QString(hash.result().toHex());
+}
+
+//-----------------------------------------------------------------------------
+QByteArray qSlicerLITTPlanV2ResultCache::hashFile(const QString& fileName)
+{
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly))
+    {
+    return QByteArray();
+    }
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  uchar* data = file.size() > 0 ? file.map(0, file.size()) : 0;
+  if (data)
+    {
+    addData(hash, data, file.size());
+    file.unmap(data);
+    }
+  else
+    {
+    while (!file.atEnd())
+      {
+      hash.addData(file.read(1 << 20));
+      }
+    }
+  return hash.result();
+}
+
+//-----------------------------------------------------------------------------
+QByteArray qSlicerLITTPlanV2ResultCache::hashMatrix(vtkMatrix4x4* matrix)
+{
+  if (!matrix)
+    {
+    return QByteArray();
+    }
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  addData(hash, matrix->Element, sizeof(matrix->Element));
+  return hash.result();
+}
+
+//-----------------------------------------------------------------------------
+QByteArray qSlicerLITTPlanV2ResultCache::hashDataArray(vtkDataArray* array)
+{
+  if (!array)
+    {
+    return QByteArray();
+    }
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  qint64 description[3] = {array->GetDataType(),
+                           array->GetNumberOfComponents(),
+                           array->GetNumberOfTuples()};
+  addData(hash, description, sizeof(description));
+  if (array->GetNumberOfTuples() > 0)
+    {
+    addData(hash, array->GetVoidPointer(0),
+            static_cast<qint64>(array->GetNumberOfTuples()) *
+            array->GetNumberOfComponents() * array->GetDataTypeSize());
+    }
+  return hash.result();
+}
+
+//-----------------------------------------------------------------------------
+QByteArray qSlicerLITTPlanV2ResultCache::hashPolyData(vtkPolyData* polyData)
+{
+  if (!polyData)
+    {
+    return QByteArray();
+    }
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  hash.addData(hashDataArray(
+    polyData->GetPoints() ? polyData->GetPoints()->GetData() : 0));
+  addCellArray(hash, polyData->GetVerts());
+  addCellArray(hash, polyData->GetLines());
+  addCellArray(hash, polyData->GetPolys());
+  addCellArray(hash, polyData->GetStrips());
+  return hash.result();
+}
+
+//-----------------------------------------------------------------------------
+QByteArray qSlicerLITTPlanV2ResultCache::hashImageData(vtkImageData* image)
+{
+  if (!image)
+    {
+    return QByteArray();
+    }
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  addData(hash, image->GetExtent(), 6 * sizeof(int));
+  addData(hash, image->GetOrigin(), 3 * sizeof(double));
+  addData(hash, image->GetSpacing(), 3 * sizeof(double));
+  vtkPointData* pointData = image->GetPointData();
+  for (int i = 0; i < pointData->GetNumberOfArrays(); ++i)
+    {
+    vtkDataArray* array = pointData->GetArray(i);
+    if (array)
+      {
+      hash.addData(array->GetName() ? array->GetName() : "");
+      hash.addData(hashDataArray(array));
+      }
+    }
+  return hash.result();
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ResultCache::contains(const QString& key)const
+{
+  Q_D(const qSlicerLITTPlanV2ResultCache);
+  return QFile::exists(d->filePath(key));
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ResultCache::store(const QString& key, vtkImageData* image)
+{
+  Q_D(qSlicerLITTPlanV2ResultCache);
+  if (key.isEmpty() || !image)
+    {
+    return false;
+    }
+  const QString fileName = d->filePath(key);
+  if (QFile::exists(fileName))
+    {
+    // Content addressed: the result is already there.
+    touch(fileName);
+    return true;
+    }
+
+  FileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.Magic, Magic, sizeof(Magic));
+  header.ByteOrder = ByteOrderMark;
+  int* extent = image->GetExtent();
+  double* origin = image->GetOrigin();
+  double* spacing = image->GetSpacing();
+  for (int i = 0; i < 3; ++i)
+    {
+    header.Extent[2 * i] = extent[2 * i];
+    header.Extent[2 * i + 1] = extent[2 * i + 1];
+    header.Origin[i] = origin[i];
+    header.Spacing[i] = spacing[i];
+    }
+
+  vtkPointData* pointData = image->GetPointData();
+  QList<vtkDataArray*> arrays;
+  QList<ArrayHeader> arrayHeaders;
+  for (int i = 0; i < pointData->GetNumberOfArrays(); ++i)
+    {
+    vtkDataArray* array = pointData->GetArray(i);
+    if (!array)
+      {
+      continue;
+      }
+    if (array->GetName() && strlen(array->GetName()) >= sizeof(ArrayHeader().Name))
+      {
+      qWarning() << "Can't cache array with a name that long:" << array->GetName();
+      return false;
+      }
+    ArrayHeader arrayHeader;
+    memset(&arrayHeader, 0, sizeof(arrayHeader));
+    if (array->GetName())
+      {
+      strcpy(arrayHeader.Name, array->GetName());
+      }
+    arrayHeader.DataType = array->GetDataType();
+    arrayHeader.NumberOfComponents = array->GetNumberOfComponents();
+    arrayHeader.NumberOfTuples = array->GetNumberOfTuples();
+    arrayHeader.Scalars = (array == pointData->GetScalars());
+    arrays << array;
+    arrayHeaders << arrayHeader;
+    }
+  header.NumberOfArrays = arrays.count();
+
+  qint64 offset = align(sizeof(FileHeader) + arrays.count() * sizeof(ArrayHeader));
+  for (int i = 0; i < arrays.count(); ++i)
+    {
+    arrayHeaders[i].Offset = offset;
+    offset = align(offset + arrayHeaders[i].NumberOfTuples *
+      arrayHeaders[i].NumberOfComponents * arrays[i]->GetDataTypeSize());
+    }
+
+  // Write a temporary file renamed once complete: a partially written
+  // result is never read, even by another process.
+  const QString temporaryFileName = fileName + QString(".%1.%2.tmp")
+    .arg(QCoreApplication::applicationPid())
+    .arg(reinterpret_cast<quintptr>(QThread::currentThreadId()));
+  QFile file(temporaryFileName);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+    qWarning() << "Can't write result cache file" << temporaryFileName;
+    return false;
+    }
+  bool written =
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == sizeof(header);
+  foreach(const ArrayHeader& arrayHeader, arrayHeaders)
+    {
+    written = written && file.write(reinterpret_cast<const char*>(&arrayHeader),
+                                    sizeof(arrayHeader)) == sizeof(arrayHeader);
+    }
+  for (int i = 0; i < arrays.count() && written; ++i)
+    {
+    written = file.seek(arrayHeaders[i].Offset);
+    const qint64 size = arrayHeaders[i].NumberOfTuples *
+      arrayHeaders[i].NumberOfComponents * arrays[i]->GetDataTypeSize();
+    const char* data = static_cast<const char*>(arrays[i]->GetVoidPointer(0));
+    for (qint64 start = 0; start < size && written; start += 1 << 30)
+      {
+      const qint64 count = qMin(size - start, qint64(1) << 30);
+      written = file.write(data + start, count) == count;
+      }
+    }
+  // Pad the end of the file so that the last array can be mapped by pages
+  written = written && file.resize(offset);
+  file.close();
+  if (!written || !QFile::rename(temporaryFileName, fileName))
+    {
+    // Renaming fails if the same result has just been stored concurrently
+    QFile::remove(temporaryFileName);
+    return QFile::exists(fileName);
+    }
+
+  QMutexLocker locker(&d->Mutex);
+  d->updateSize();
+  d->Size += offset;
+  d->evict(key);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+vtkSmartPointer<vtkImageData> qSlicerLITTPlanV2ResultCache::load(const QString& key)
+{
+  Q_D(qSlicerLITTPlanV2ResultCache);
+  const QString fileName = d->filePath(key);
+  MappedFile* mappedFile = new MappedFile(fileName);
+  FileHeader header;
+  const bool opened = mappedFile->File.open(QIODevice::ReadOnly);
+  const qint64 fileSize = mappedFile->File.size();
+  bool valid = opened &&
+    mappedFile->File.read(reinterpret_cast<char*>(&header), sizeof(header)) ==
+      sizeof(header) &&
+    memcmp(header.Magic, Magic, sizeof(Magic)) == 0 &&
+    header.ByteOrder == ByteOrderMark &&
+    static_cast<qint64>(sizeof(FileHeader)) +
+      static_cast<qint64>(header.NumberOfArrays) * sizeof(ArrayHeader) <= fileSize;
+  // Computed in double not to overflow on a corrupted extent
+  double numberOfPoints = 1.;
+  for (int i = 0; valid && i < 3; ++i)
+    {
+    const double dimension =
+      static_cast<double>(header.Extent[2 * i + 1]) - header.Extent[2 * i] + 1.;
+    valid = dimension >= 0.;
+    numberOfPoints *= dimension;
+    }
+  QList<ArrayHeader> arrayHeaders;
+  for (quint32 i = 0; valid && i < header.NumberOfArrays; ++i)
+    {
+    ArrayHeader arrayHeader;
+    valid = mappedFile->File.read(reinterpret_cast<char*>(&arrayHeader),
+      sizeof(arrayHeader)) == sizeof(arrayHeader) &&
+      arrayHeader.NumberOfComponents > 0 &&
+      arrayHeader.NumberOfTuples >= 0 &&
+      arrayHeader.NumberOfTuples <= fileSize &&
+      static_cast<double>(arrayHeader.NumberOfTuples) == numberOfPoints &&
+      arrayHeader.Offset >= 0 && arrayHeader.Offset <= fileSize;
+    arrayHeader.Name[sizeof(arrayHeader.Name) - 1] = '\0';
+    arrayHeaders << arrayHeader;
+    }
+  if (!valid)
+    {
+    delete mappedFile;
+    QMutexLocker locker(&d->Mutex);
+    ++d->Misses;
+    // A result that can't be read is corrupted, don't try it again
+    if (opened)
+      {
+      d->remove(fileName);
+      }
+    return 0;
+    }
+
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetExtent(header.Extent);
+  image->SetOrigin(header.Origin);
+  image->SetSpacing(header.Spacing);
+  vtkSmartPointer<vtkCallbackCommand> unmapCallback =
+    vtkSmartPointer<vtkCallbackCommand>::New();
+  unmapCallback->SetCallback(onMappedArrayDeleted);
+  unmapCallback->SetClientData(mappedFile);
+  // Keep the file alive while the arrays are created
+  mappedFile->References.ref();
+  foreach(const ArrayHeader& arrayHeader, arrayHeaders)
+    {
+    vtkSmartPointer<vtkDataArray> array;
+    array.TakeReference(vtkDataArray::CreateDataArray(arrayHeader.DataType));
+    if (!array)
+      {
+      valid = false;
+      break;
+      }
+    // The values must fit in the file
+    const qint64 dataTypeSize = array->GetDataTypeSize();
+    if (dataTypeSize <= 0 || (arrayHeader.NumberOfTuples > 0 &&
+        arrayHeader.NumberOfComponents > (fileSize - arrayHeader.Offset) /
+          dataTypeSize / arrayHeader.NumberOfTuples))
+      {
+      valid = false;
+      break;
+      }
+    array->SetName(arrayHeader.Name[0] ? arrayHeader.Name : 0);
+    array->SetNumberOfComponents(arrayHeader.NumberOfComponents);
+    const qint64 numberOfValues =
+      arrayHeader.NumberOfTuples * arrayHeader.NumberOfComponents;
+    const qint64 size = numberOfValues * array->GetDataTypeSize();
+    uchar* data = size > 0 ?
+      mappedFile->File.map(arrayHeader.Offset, size) : 0;
+    if (data)
+      {
+      // save = 1: the memory belongs to the mapping, not to the array
+      array->SetVoidArray(data, numberOfValues, 1);
+      mappedFile->References.ref();
+      array->AddObserver(vtkCommand::DeleteEvent, unmapCallback);
+      }
+    else
+      {
+      // Mapping not supported: read the values
+      array->SetNumberOfTuples(arrayHeader.NumberOfTuples);
+      valid = mappedFile->File.seek(arrayHeader.Offset) &&
+        mappedFile->File.read(static_cast<char*>(array->GetVoidPointer(0)),
+                              size) == size;
+      }
+    if (arrayHeader.Scalars)
+      {
+      image->SetScalarType(arrayHeader.DataType);
+      image->SetNumberOfScalarComponents(arrayHeader.NumberOfComponents);
+      image->GetPointData()->SetScalars(array);
+      }
+    else
+      {
+      image->GetPointData()->AddArray(array);
+      }
+    }
+  onMappedArrayDeleted(0, vtkCommand::DeleteEvent, mappedFile, 0);
+
+  valid = valid && image->GetPointData()->GetNumberOfArrays() ==
+    static_cast<int>(arrayHeaders.count());
+  if (!valid)
+    {
+    // Unmap the arrays before removing the file
+    image = 0;
+    }
+  QMutexLocker locker(&d->Mutex);
+  if (!valid)
+    {
+    ++d->Misses;
+    d->remove(fileName);
+    return 0;
+    }
+  ++d->Hits;
+  touch(fileName);
+  return image;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ResultCache::clear()
+{
+  Q_D(qSlicerLITTPlanV2ResultCache);
+  QMutexLocker locker(&d->Mutex);
+  foreach(const QFileInfo& fileInfo, QDir(d->Directory).entryInfoList(
+            QStringList() << QString("*") + Suffix, QDir::Files))
+    {
+    QFile::remove(fileInfo.absoluteFilePath());
+    }
+  d->Size = -1;
+  d->updateSize();
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerLITTPlanV2ResultCache::hits()const
+{
+  Q_D(const qSlicerLITTPlanV2ResultCache);
+  QMutexLocker locker(&d->Mutex);
+  return d->Hits;
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerLITTPlanV2ResultCache::misses()const
+{
+  Q_D(const qSlicerLITTPlanV2ResultCache);
+  QMutexLocker locker(&d->Mutex);
+  return d->Misses;
+}
@@ -0,0 +1,112 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __qSlicerLITTPlanV2ResultCache_h
+#define __qSlicerLITTPlanV2ResultCache_h
+
+// Qt includes
+#include <QByteArray>
+#include <QList>
+#include <QScopedPointer>
+#include <QString>
+
+// VTK includes
+#include <vtkSmartPointer.h>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModuleExport.h"
+
+class qSlicerLITTPlanV2ResultCachePrivate;
+class vtkDataArray;
+class vtkImageData;
+class vtkMatrix4x4;
+class vtkPolyData;
+
+/// \ingroup Slicer_QtModules_LITTPlanV2
+/// On-disk, content-addressed cache of planning results (distance maps,
+/// tract density grids...) shared across sessions.
+///
+/// Results are stored under a key computed with key() from the hashes of
+/// everything they depend on: the input data, the transform matrices and
+/// the version of the algorithm. Identical inputs reopened later, in any
+/// session, give the same key and the result is read back instead of being
+/// recomputed.
+///
+/// Each result is one file: a fixed size header followed by the raw arrays
+/// of the image, aligned on 64 bytes. Reading maps the file in memory: the
+/// arrays of the returned image point into the mapping and MUST NOT be
+/// modified. When the total size of the cache exceeds maximumSize(), the
+/// least recently used results are removed.
+/// All the methods are thread-safe.
+class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT qSlicerLITTPlanV2ResultCache
+{
+public:
+  /// If directory is empty, the cache location of the user is used.
+  qSlicerLITTPlanV2ResultCache(const QString& directory = QString());
+  virtual ~qSlicerLITTPlanV2ResultCache();
+
+  QString directory()const;
+
+  /// Maximum size of the cache in bytes. Default is 4GB.
+  void setMaximumSize(qint64 size);
+  qint64 maximumSize()const;
+
+  /// Total size in bytes of the results on disk
+  qint64 size()const;
+
+  /// Combine the hashes of the inputs of a computation and the name and
+  /// version of the algorithm into a key.
+  static QString key(const QString& algorithm, int version,
+                     const QList<QByteArray>& hashes);
+
+  /// Hashes of the inputs
+  static QByteArray hashFile(const QString& fileName);
+  static QByteArray hashMatrix(vtkMatrix4x4* matrix);
+  static QByteArray hashDataArray(vtkDataArray* array);
+  /// Hash of the points and cells of the polydata
+  static QByteArray hashPolyData(vtkPolyData* polyData);
+  /// Hash of the geometry and point data arrays of the image
+  static QByteArray hashImageData(vtkImageData* image);
+
+  /// Return true if a result is stored under the key
+  bool contains(const QString& key)const;
+
+  /// Write the geometry and the point data arrays of the image under the
+  /// key. Returns false if the image can't be written.
+  bool store(const QString& key, vtkImageData* image);
+
+  /// Return the image stored under the key, 0 if there is none. A result
+  /// whose headers don't match its extent or its file size is a miss and is
+  /// removed from the cache.
+  vtkSmartPointer<vtkImageData> load(const QString& key);
+
+  /// Remove all the results
+  void clear();
+
+  /// Number of load() that found, and did not find, a result
+  int hits()const;
+  int misses()const;
+
+protected:
+  QScopedPointer<qSlicerLITTPlanV2ResultCachePrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(qSlicerLITTPlanV2ResultCache);
+  Q_DISABLE_COPY(qSlicerLITTPlanV2ResultCache);
+};
+
+#endif
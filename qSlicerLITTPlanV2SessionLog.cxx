@@ -0,0 +1,735 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QDataStream>
+#include <QFile>
+#include <QHash>
+#include <QTextStream>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ResultCache.h"
+#include "qSlicerLITTPlanV2SessionLog.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkTimerLog.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+const quint32 Magic = 0x4c50534c; // "LPSL"
+const quint16 Version = 2;
+/// Entry, direction and cost
+const int TrajectorySize = 7;
+
+//-----------------------------------------------------------------------------
+/// Node IDs of a log, stored once
+class StringTable
+{
+public:
+  StringTable() { this->index(QString()); }
+  quint32 index(const QString& string)
+  {
+    QHash<QString, quint32>::const_iterator it = this->Indexes.find(string);
+    if (it != this->Indexes.end())
+      {
+      return it.value();
+      }
+    quint32 newIndex = this->Strings.count();
+    this->Indexes.insert(string, newIndex);
+    this->Strings << string;
+    return newIndex;
+  }
+  QStringList Strings;
+  QHash<QString, quint32> Indexes;
+};
+
+//-----------------------------------------------------------------------------
+bool isAffine(const double matrix[16])
+{
+  return matrix[12] == 0. && matrix[13] == 0. && matrix[14] == 0. &&
+    matrix[15] == 1.;
+}
+
+//-----------------------------------------------------------------------------
+void writeMatrix(QDataStream& stream, const double matrix[16])
+{
+  const bool affine = isAffine(matrix);
+  stream << quint8(affine);
+  for (int i = 0; i < (affine ? 12 : 16); ++i)
+    {
+    stream << matrix[i];
+    }
+}
+
+//-----------------------------------------------------------------------------
+void readMatrix(QDataStream& stream, double matrix[16])
+{
+  quint8 affine = 0;
+  stream >> affine;
+  const int count = affine ? 12 : 16;
+  for (int i = 0; i < count; ++i)
+    {
+    stream >> matrix[i];
+    }
+  if (affine)
+    {
+    matrix[12] = matrix[13] = matrix[14] = 0.;
+    matrix[15] = 1.;
+    }
+}
+
+//-----------------------------------------------------------------------------
+/// String of the table, empty if the index is out of range
+QString stringAt(const QStringList& strings, quint32 index)
+{
+  return index < quint32(strings.count()) ? strings[index] : QString();
+}
+
+//-----------------------------------------------------------------------------
+void indexState(StringTable& strings,
+                const qSlicerLITTPlanV2SessionLog::State& state)
+{
+  foreach(const QString& nodeID, state.Matrices.keys())
+    {
+    strings.index(nodeID);
+    }
+  QMap<QString, QString>::const_iterator parentIt;
+  for (parentIt = state.ParentTransforms.begin();
+       parentIt != state.ParentTransforms.end(); ++parentIt)
+    {
+    strings.index(parentIt.key());
+    strings.index(parentIt.value());
+    }
+  foreach(const QString& nodeID, state.Geometries.keys())
+    {
+    strings.index(nodeID);
+    }
+  foreach(const QString& nodeID, state.Images.keys())
+    {
+    strings.index(nodeID);
+    }
+  foreach(const QString& nodeID, state.Trajectories.keys())
+    {
+    strings.index(nodeID);
+    }
+}
+
+//-----------------------------------------------------------------------------
+void writeHashes(QDataStream& stream, StringTable& strings,
+                 const QMap<QString, QByteArray>& hashes)
+{
+  stream << quint32(hashes.count());
+  QMap<QString, QByteArray>::const_iterator it;
+  for (it = hashes.begin(); it != hashes.end(); ++it)
+    {
+    stream << strings.index(it.key()) << it.value();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void readHashes(QDataStream& stream, const QStringList& strings,
+                QMap<QString, QByteArray>& hashes)
+{
+  quint32 count = 0;
+  stream >> count;
+  for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+    {
+    quint32 index = 0;
+    QByteArray hash;
+    stream >> index >> hash;
+    hashes[stringAt(strings, index)] = hash;
+    }
+}
+
+//-----------------------------------------------------------------------------
+void writeState(QDataStream& stream, StringTable& strings,
+                const qSlicerLITTPlanV2SessionLog::State& state)
+{
+  stream << quint32(state.Matrices.count());
+  QMap<QString, QVector<double> >::const_iterator matrixIt;
+  for (matrixIt = state.Matrices.begin();
+       matrixIt != state.Matrices.end(); ++matrixIt)
+    {
+    stream << strings.index(matrixIt.key());
+    writeMatrix(stream, matrixIt.value().constData());
+    }
+  stream << quint32(state.ParentTransforms.count());
+  QMap<QString, QString>::const_iterator parentIt;
+  for (parentIt = state.ParentTransforms.begin();
+       parentIt != state.ParentTransforms.end(); ++parentIt)
+    {
+    stream << strings.index(parentIt.key()) << strings.index(parentIt.value());
+    }
+  writeHashes(stream, strings, state.Geometries);
+  writeHashes(stream, strings, state.Images);
+  stream << quint32(state.Trajectories.count());
+  QMap<QString, QVector<double> >::const_iterator trajectoryIt;
+  for (trajectoryIt = state.Trajectories.begin();
+       trajectoryIt != state.Trajectories.end(); ++trajectoryIt)
+    {
+    stream << strings.index(trajectoryIt.key());
+    for (int i = 0; i < TrajectorySize; ++i)
+      {
+      stream << trajectoryIt.value().value(i);
+      }
+    }
+}
+
+//-----------------------------------------------------------------------------
+void readState(QDataStream& stream, const QStringList& strings,
+               qSlicerLITTPlanV2SessionLog::State& state)
+{
+  quint32 count = 0;
+  stream >> count;
+  for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+    {
+    quint32 index = 0;
+    QVector<double> matrix(16);
+    stream >> index;
+    readMatrix(stream, matrix.data());
+    state.Matrices[stringAt(strings, index)] = matrix;
+    }
+  stream >> count;
+  for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+    {
+    quint32 index = 0;
+    quint32 parentIndex = 0;
+    stream >> index >> parentIndex;
+    state.ParentTransforms[stringAt(strings, index)] =
+      stringAt(strings, parentIndex);
+    }
+  readHashes(stream, strings, state.Geometries);
+  readHashes(stream, strings, state.Images);
+  stream >> count;
+  for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+    {
+    quint32 index = 0;
+    QVector<double> trajectory(TrajectorySize);
+    stream >> index;
+    for (int j = 0; j < TrajectorySize; ++j)
+      {
+      stream >> trajectory[j];
+      }
+    state.Trajectories[stringAt(strings, index)] = trajectory;
+    }
+}
+
+//-----------------------------------------------------------------------------
+/// Append a difference for each expected hash missing or different
+void compareHashes(const QString& what,
+                   const QMap<QString, QByteArray>& expected,
+                   const QMap<QString, QByteArray>& actual,
+                   QStringList& differences)
+{
+  QMap<QString, QByteArray>::const_iterator it;
+  for (it = expected.begin(); it != expected.end(); ++it)
+    {
+    if (actual.value(it.key()) != it.value())
+      {
+      differences << QString("%1 of %2 differs").arg(what).arg(it.key());
+      }
+    }
+}
+
+//-----------------------------------------------------------------------------
+/// Nearest rank percentile of sorted values
+double percentile(const QVector<double>& sorted, double p)
+{
+  int rank = static_cast<int>(ceil(p / 100. * sorted.count()));
+  return sorted[qBound(0, rank - 1, sorted.count() - 1)];
+}
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2SessionLog::Event::Event()
+  : Type(qSlicerLITTPlanV2SessionLog::SelectTransform)
+  , Time(0.)
+{
+  for (int i = 0; i < 16; ++i)
+    {
+    this->Matrix[i] = (i % 5 == 0) ? 1. : 0.;
+    }
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2SessionLog::qSlicerLITTPlanV2SessionLog()
+{
+  this->clear();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2SessionLog::clear()
+{
+  this->Events.clear();
+  this->LastSetMatrixEvents.clear();
+  this->InitialState = State();
+  this->FinalState = State();
+  this->StartTime = vtkTimerLog::GetUniversalTime();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2SessionLog::setSceneURL(const QString& url)
+{
+  this->SceneURL = url;
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2SessionLog::sceneURL()const
+{
+  return this->SceneURL;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2SessionLog::append(const Event& event)
+{
+  Event newEvent = event;
+  newEvent.Time = vtkTimerLog::GetUniversalTime() - this->StartTime;
+  if (newEvent.Type == SetMatrix)
+    {
+    this->LastSetMatrixEvents[newEvent.TransformNodeID] = this->Events.count();
+    }
+  else if (newEvent.Type == OptimizeTrajectory)
+    {
+    // The matrix set by the optimizer is not logged: the next edit of the
+    // node must be, even if it restores the previous matrix.
+    this->LastSetMatrixEvents.remove(newEvent.TransformNodeID);
+    }
+  this->Events << newEvent;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2SessionLog::appendSelectTransform(const QString& transformNodeID)
+{
+  Event event;
+  event.Type = SelectTransform;
+  event.TransformNodeID = transformNodeID;
+  this->append(event);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2SessionLog::appendSetMatrix(const QString& transformNodeID,
+                                                  vtkMatrix4x4* matrix)
+{
+  if (!matrix)
+    {
+    return;
+    }
+  Event event;
+  event.Type = SetMatrix;
+  event.TransformNodeID = transformNodeID;
+  memcpy(event.Matrix, matrix->Element, sizeof(event.Matrix));
+  QMap<QString, int>::const_iterator last =
+    this->LastSetMatrixEvents.find(transformNodeID);
+  if (last != this->LastSetMatrixEvents.end() &&
+      memcmp(this->Events[last.value()].Matrix, event.Matrix,
+             sizeof(event.Matrix)) == 0)
+    {
+    return;
+    }
+  this->append(event);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2SessionLog::appendEvent(EventType type,
+                                              const QStringList& nodeIDs)
+{
+  Event event;
+  event.Type = type;
+  event.NodeIDs = nodeIDs;
+  this->append(event);
+}
+
+//-----------------------------------------------------------------------------
+const QList<qSlicerLITTPlanV2SessionLog::Event>& qSlicerLITTPlanV2SessionLog::events()const
+{
+  return this->Events;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2SessionLog::setInitialState(const State& state)
+{
+  this->InitialState = state;
+}
+
+//-----------------------------------------------------------------------------
+const qSlicerLITTPlanV2SessionLog::State& qSlicerLITTPlanV2SessionLog::initialState()const
+{
+  return this->InitialState;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2SessionLog::setFinalState(const State& state)
+{
+  this->FinalState = state;
+}
+
+//-----------------------------------------------------------------------------
+const qSlicerLITTPlanV2SessionLog::State& qSlicerLITTPlanV2SessionLog::finalState()const
+{
+  return this->FinalState;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2SessionLog::save(const QString& fileName)const
+{
+  StringTable strings;
+  foreach(const Event& event, this->Events)
+    {
+    strings.index(event.TransformNodeID);
+    foreach(const QString& nodeID, event.NodeIDs)
+      {
+      strings.index(nodeID);
+      }
+    }
+  indexState(strings, this->InitialState);
+  indexState(strings, this->FinalState);
+
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly))
+    {
+    return false;
+    }
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_4_6);
+  stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+  stream << Magic << Version << this->SceneURL << strings.Strings;
+
+  stream << quint32(this->Events.count());
+  double previousTime = 0.;
+  foreach(const Event& event, this->Events)
+    {
+    stream << quint8(event.Type)
+           << quint32(qMax(0., (event.Time - previousTime) * 1000.) + 0.5);
+    previousTime = event.Time;
+    switch (event.Type)
+      {
+      case SelectTransform:
+        stream << strings.index(event.TransformNodeID);
+        break;
+      case SetMatrix:
+        stream << strings.index(event.TransformNodeID);
+        writeMatrix(stream, event.Matrix);
+        break;
+      case BeginInteraction:
+      case EndInteraction:
+        break;
+      case OptimizeTrajectory:
+        stream << strings.index(event.TransformNodeID);
+        // fall through
+      default:
+        stream << quint32(event.NodeIDs.count());
+        foreach(const QString& nodeID, event.NodeIDs)
+          {
+          stream << strings.index(nodeID);
+          }
+        break;
+      }
+    }
+
+  writeState(stream, strings, this->InitialState);
+  writeState(stream, strings, this->FinalState);
+  return stream.status() == QDataStream::Ok;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2SessionLog::load(const QString& fileName,
+                                       QString* errorString)
+{
+  this->clear();
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly))
+    {
+    if (errorString)
+      {
+      *errorString = file.errorString();
+      }
+    return false;
+    }
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_4_6);
+  stream.setFloatingPointPrecision(QDataStream::DoublePrecision);
+  quint32 magic = 0;
+  quint16 version = 0;
+  stream >> magic >> version;
+  if (magic != Magic)
+    {
+    if (errorString)
+      {
+      *errorString = QString("%1 is not a session log").arg(fileName);
+      }
+    return false;
+    }
+  // Logs without initial state can't be replayed safely
+  if (version != Version)
+    {
+    if (errorString)
+      {
+      *errorString = QString("%1 has an unsupported version (%2)")
+        .arg(fileName).arg(version);
+      }
+    return false;
+    }
+  QStringList strings;
+  stream >> this->SceneURL >> strings;
+
+  quint32 count = 0;
+  stream >> count;
+  double time = 0.;
+  for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+    {
+    quint8 type = 0;
+    quint32 delta = 0;
+    quint32 index = 0;
+    stream >> type >> delta;
+    Event event;
+    event.Type = static_cast<EventType>(
+      qMin(type, quint8(NumberOfEventTypes - 1)));
+    time += delta / 1000.;
+    event.Time = time;
+    switch (event.Type)
+      {
+      case SelectTransform:
+        stream >> index;
+        event.TransformNodeID = stringAt(strings, index);
+        break;
+      case SetMatrix:
+        stream >> index;
+        event.TransformNodeID = stringAt(strings, index);
+        readMatrix(stream, event.Matrix);
+        this->LastSetMatrixEvents[event.TransformNodeID] = this->Events.count();
+        break;
+      case BeginInteraction:
+      case EndInteraction:
+        break;
+      case OptimizeTrajectory:
+        stream >> index;
+        event.TransformNodeID = stringAt(strings, index);
+        // fall through
+      default:
+        {
+        quint32 nodeCount = 0;
+        stream >> nodeCount;
+        for (quint32 j = 0; j < nodeCount && stream.status() == QDataStream::Ok; ++j)
+          {
+          stream >> index;
+          event.NodeIDs << stringAt(strings, index);
+          }
+        }
+        break;
+      }
+    this->Events << event;
+    }
+
+  readState(stream, strings, this->InitialState);
+  readState(stream, strings, this->FinalState);
+
+  if (stream.status() != QDataStream::Ok)
+    {
+    if (errorString)
+      {
+      *errorString = QString("%1 is truncated").arg(fileName);
+      }
+    return false;
+    }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2SessionLog::eventTypeName(EventType type)
+{
+  switch (type)
+    {
+    case SelectTransform: return "SelectTransform";
+    case SetMatrix: return "SetMatrix";
+    case BeginInteraction: return "BeginInteraction";
+    case EndInteraction: return "EndInteraction";
+    case TransformNodes: return "TransformNodes";
+    case UntransformNodes: return "UntransformNodes";
+    case HardenNodes: return "HardenNodes";
+    case OptimizeTrajectory: return "OptimizeTrajectory";
+    default: break;
+    }
+  return QString();
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2SessionLog::State qSlicerLITTPlanV2SessionLog
+::captureState(vtkMRMLScene* scene)
+{
+  State state;
+  if (!scene)
+    {
+    return state;
+    }
+  int numberOfNodes = scene->GetNumberOfNodes();
+  for (int i = 0; i < numberOfNodes; ++i)
+    {
+    vtkMRMLTransformableNode* node =
+      vtkMRMLTransformableNode::SafeDownCast(scene->GetNthNode(i));
+    if (!node || !node->GetID())
+      {
+      continue;
+      }
+    QString nodeID(node->GetID());
+    state.ParentTransforms[nodeID] =
+      node->GetTransformNodeID() ? node->GetTransformNodeID() : "";
+    vtkMRMLLinearTransformNode* transformNode =
+      vtkMRMLLinearTransformNode::SafeDownCast(node);
+    if (transformNode && transformNode->GetMatrixTransformToParent())
+      {
+      QVector<double> matrix(16);
+      memcpy(matrix.data(), transformNode->GetMatrixTransformToParent()->Element,
+             16 * sizeof(double));
+      state.Matrices[nodeID] = matrix;
+      }
+    vtkMRMLModelNode* modelNode = vtkMRMLModelNode::SafeDownCast(node);
+    if (modelNode && modelNode->GetPolyData())
+      {
+      state.Geometries[nodeID] =
+        qSlicerLITTPlanV2ResultCache::hashPolyData(modelNode->GetPolyData());
+      }
+    vtkMRMLScalarVolumeNode* volumeNode =
+      vtkMRMLScalarVolumeNode::SafeDownCast(node);
+    if (volumeNode && volumeNode->GetImageData())
+      {
+      state.Images[nodeID] =
+        qSlicerLITTPlanV2ResultCache::hashImageData(volumeNode->GetImageData());
+      }
+    }
+  return state;
+}
+
+//-----------------------------------------------------------------------------
+QStringList qSlicerLITTPlanV2SessionLog::compareStates(const State& expected,
+                                                       const State& actual)
+{
+  QStringList differences;
+  // Bit comparison: -0. differs from 0.
+  QMap<QString, QVector<double> >::const_iterator matrixIt;
+  for (matrixIt = expected.Matrices.begin();
+       matrixIt != expected.Matrices.end(); ++matrixIt)
+    {
+    QMap<QString, QVector<double> >::const_iterator other =
+      actual.Matrices.find(matrixIt.key());
+    if (other == actual.Matrices.end())
+      {
+      differences << QString("Transform %1 is missing").arg(matrixIt.key());
+      }
+    else if (memcmp(other.value().constData(), matrixIt.value().constData(),
+                    16 * sizeof(double)) != 0)
+      {
+      differences << QString("Matrix of %1 differs").arg(matrixIt.key());
+      }
+    }
+  QMap<QString, QString>::const_iterator parentIt;
+  for (parentIt = expected.ParentTransforms.begin();
+       parentIt != expected.ParentTransforms.end(); ++parentIt)
+    {
+    if (!actual.ParentTransforms.contains(parentIt.key()))
+      {
+      differences << QString("Node %1 is missing").arg(parentIt.key());
+      }
+    else if (actual.ParentTransforms[parentIt.key()] != parentIt.value())
+      {
+      differences << QString("Node %1 is under %2 instead of %3")
+        .arg(parentIt.key()).arg(actual.ParentTransforms[parentIt.key()])
+        .arg(parentIt.value());
+      }
+    }
+  compareHashes("Geometry", expected.Geometries, actual.Geometries,
+                differences);
+  compareHashes("Image", expected.Images, actual.Images, differences);
+  QMap<QString, QVector<double> >::const_iterator trajectoryIt;
+  for (trajectoryIt = expected.Trajectories.begin();
+       trajectoryIt != expected.Trajectories.end(); ++trajectoryIt)
+    {
+    QMap<QString, QVector<double> >::const_iterator other =
+      actual.Trajectories.find(trajectoryIt.key());
+    if (other == actual.Trajectories.end())
+      {
+      differences << QString("Trajectory of %1 is missing")
+        .arg(trajectoryIt.key());
+      }
+    else if (other.value().count() != trajectoryIt.value().count() ||
+             memcmp(other.value().constData(), trajectoryIt.value().constData(),
+                    trajectoryIt.value().count() * sizeof(double)) != 0)
+      {
+      differences << QString("Trajectory of %1 differs")
+        .arg(trajectoryIt.key());
+      }
+    }
+  foreach(const QString& nodeID, actual.Trajectories.keys())
+    {
+    if (!expected.Trajectories.contains(nodeID))
+      {
+      differences << QString("Trajectory of %1 is unexpected").arg(nodeID);
+      }
+    }
+  // Nodes created by the replay only
+  foreach(const QString& nodeID, actual.ParentTransforms.keys())
+    {
+    if (!expected.ParentTransforms.contains(nodeID))
+      {
+      differences << QString("Node %1 is unexpected").arg(nodeID);
+      }
+    }
+  return differences;
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2SessionLog::latencyReport(
+  const QList<Event>& events, const QVector<double>& latencies)
+{
+  QVector<QVector<double> > latenciesPerType(NumberOfEventTypes + 1);
+  for (int i = 0; i < qMin(events.count(), latencies.count()); ++i)
+    {
+    latenciesPerType[events[i].Type] << latencies[i];
+    latenciesPerType[NumberOfEventTypes] << latencies[i];
+    }
+  QString report;
+  QTextStream stream(&report);
+  for (int type = 0; type <= NumberOfEventTypes; ++type)
+    {
+    QVector<double>& sorted = latenciesPerType[type];
+    if (sorted.isEmpty())
+      {
+      continue;
+      }
+    std::sort(sorted.begin(), sorted.end());
+    stream << (type < NumberOfEventTypes ?
+               eventTypeName(static_cast<EventType>(type)) : QString("All"))
+           << ": " << sorted.count() << " events, latency (ms)"
+           << " p50 " << QString::number(percentile(sorted, 50.) * 1000., 'f', 3)
+           << " p90 " << QString::number(percentile(sorted, 90.) * 1000., 'f', 3)
+           << " p99 " << QString::number(percentile(sorted, 99.) * 1000., 'f', 3)
+           << " max " << QString::number(sorted.last() * 1000., 'f', 3)
+           << "\n";
+    }
+  return report;
+}
@@ -0,0 +1,155 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __qSlicerLITTPlanV2SessionLog_h
+#define __qSlicerLITTPlanV2SessionLog_h
+
+// Qt includes
+#include <QByteArray>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModuleExport.h"
+
+class vtkMatrix4x4;
+class vtkMRMLScene;
+
+/// \ingroup Slicer_QtModules_LITTPlanV2
+/// Event log of a planning session, for deterministic replays.
+///
+/// The module widget appends the selections of the active transform, the
+/// edits of its matrix, the slider interactions, the transform, untransform
+/// and harden actions and the inputs of the trajectory optimizations while a
+/// session is recorded (qSlicerLITTPlanV2ModuleWidget::startSessionRecording()).
+/// The optimizations are replayed by running the optimizer again, their
+/// result is not logged.
+/// The state of the scene at the start and at the end of the recording
+/// (matrices, transform hierarchy, model geometry, volumes) and the plan
+/// computed (trajectories) are stored with the events: a replay
+/// (qSlicerLITTPlanV2ModuleWidget::replaySession()) is refused on a scene
+/// that differs from the initial state, and its result is checked bit for
+/// bit.
+///
+/// The file format is binary: node IDs are stored once in a string table
+/// and referenced by index, times are deltas in milliseconds and affine
+/// matrices are stored without their last row.
+class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT qSlicerLITTPlanV2SessionLog
+{
+public:
+  enum EventType
+    {
+    SelectTransform = 0,
+    SetMatrix,
+    /// Start and end of the dragging of the sliders
+    BeginInteraction,
+    EndInteraction,
+    TransformNodes,
+    UntransformNodes,
+    HardenNodes,
+    OptimizeTrajectory,
+    NumberOfEventTypes
+    };
+
+  struct Event
+  {
+    Event();
+    EventType Type;
+    /// Seconds since the recording started
+    double Time;
+    /// SelectTransform, SetMatrix, OptimizeTrajectory: the transform node,
+    /// empty for none
+    QString TransformNodeID;
+    /// TransformNodes, UntransformNodes, HardenNodes. OptimizeTrajectory:
+    /// the tumor, skull, clearance volume and tract nodes, empty for none.
+    QStringList NodeIDs;
+    /// SetMatrix: matrix to parent, row major
+    double Matrix[16];
+  };
+
+  /// Bit exact state of the plan
+  struct State
+  {
+    /// Matrix to parent (row major) of the linear transform nodes
+    QMap<QString, QVector<double> > Matrices;
+    /// Parent transform node ID of the transformable nodes
+    QMap<QString, QString> ParentTransforms;
+    /// Hash of the polydata of the models
+    QMap<QString, QByteArray> Geometries;
+    /// Hash of the image data of the volumes (thermal damage included)
+    QMap<QString, QByteArray> Images;
+    /// Entry (RAS), direction and cost of the last trajectory optimized for
+    /// each transform node during the session
+    QMap<QString, QVector<double> > Trajectories;
+  };
+
+  qSlicerLITTPlanV2SessionLog();
+
+  /// Remove the events and the states, restart the clock
+  void clear();
+
+  /// Scene the session was recorded on
+  void setSceneURL(const QString& url);
+  QString sceneURL()const;
+
+  /// Append an event. Time is set to the time since clear().
+  void append(const Event& event);
+  void appendSelectTransform(const QString& transformNodeID);
+  /// Not appended if the matrix is the one of the previous edit of the node
+  void appendSetMatrix(const QString& transformNodeID, vtkMatrix4x4* matrix);
+  /// Append an interaction or a transform, untransform or harden action
+  void appendEvent(EventType type, const QStringList& nodeIDs = QStringList());
+  const QList<Event>& events()const;
+
+  /// State of the scene when the recording started
+  void setInitialState(const State& state);
+  const State& initialState()const;
+
+  void setFinalState(const State& state);
+  const State& finalState()const;
+
+  bool save(const QString& fileName)const;
+  bool load(const QString& fileName, QString* errorString = 0);
+
+  static QString eventTypeName(EventType type);
+
+  /// State of the plan in the scene. The trajectories are not in the scene,
+  /// they are left empty.
+  static State captureState(vtkMRMLScene* scene);
+  /// Return the differences between the states, empty if they are
+  /// bit-identical.
+  static QStringList compareStates(const State& expected, const State& actual);
+
+  /// Percentiles 50, 90, 99 and the maximum of the latencies (in seconds)
+  /// of the events, per event type.
+  static QString latencyReport(const QList<Event>& events,
+                               const QVector<double>& latencies);
+
+private:
+  QString SceneURL;
+  QList<Event> Events;
+  /// Index of the last SetMatrix event of each transform node
+  QMap<QString, int> LastSetMatrixEvents;
+  State InitialState;
+  State FinalState;
+  double StartTime;
+};
+
+#endif
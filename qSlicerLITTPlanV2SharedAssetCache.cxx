@@ -0,0 +1,377 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QDebug>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2SharedAssetCache.h"
+
+// Teem includes
+#include <vtkNRRDReader.h>
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkCellData.h>
+#include <vtkDataObject.h>
+#include <vtkErrorCode.h>
+#include <vtkGenericDataObjectReader.h>
+#include <vtkIdTypeArray.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkXMLGenericDataObjectReader.h>
+
+namespace
+{
+//-----------------------------------------------------------------------------
+/// A failing reader may still produce an (empty) output
+bool readSucceeded(vtkAlgorithm* reader, vtkDataObject* output)
+{
+  if (reader->GetErrorCode() != vtkErrorCode::NoError || !output)
+    {
+    return false;
+    }
+  vtkDataSet* dataSet = vtkDataSet::SafeDownCast(output);
+  if (dataSet && dataSet->GetNumberOfPoints() == 0)
+    {
+    return false;
+    }
+  vtkImageData* image = vtkImageData::SafeDownCast(output);
+  return !image || image->GetPointData()->GetScalars() != 0;
+}
+
+//-----------------------------------------------------------------------------
+/// Copy of the reader output owned by the cache. The geometry of images is
+/// moved into ijkToRAS.
+vtkDataObject* newAsset(vtkDataObject* output, vtkMatrix4x4* ijkToRAS)
+{
+  vtkDataObject* data = output->NewInstance();
+  data->ShallowCopy(output);
+  vtkImageData* image = vtkImageData::SafeDownCast(data);
+  if (image)
+    {
+    ijkToRAS->Identity();
+    for (int i = 0; i < 3; ++i)
+      {
+      ijkToRAS->SetElement(i, i, image->GetSpacing()[i]);
+      ijkToRAS->SetElement(i, 3, image->GetOrigin()[i]);
+      }
+    image->SetOrigin(0., 0., 0.);
+    image->SetSpacing(1., 1., 1.);
+    }
+  return data;
+}
+
+//-----------------------------------------------------------------------------
+vtkDataArray* newArrayView(vtkDataArray* array)
+{
+  vtkDataArray* view = array->NewInstance();
+  view->SetNumberOfComponents(array->GetNumberOfComponents());
+  view->SetName(array->GetName());
+  // save = 1: the view never frees the memory of the asset
+  view->SetVoidArray(array->GetVoidPointer(0),
+    array->GetNumberOfTuples() * array->GetNumberOfComponents(), 1);
+  return view;
+}
+
+//-----------------------------------------------------------------------------
+vtkCellArray* newCellArrayView(vtkCellArray* cells)
+{
+  vtkCellArray* view = vtkCellArray::New();
+  vtkSmartPointer<vtkIdTypeArray> ids = vtkSmartPointer<vtkIdTypeArray>::New();
+  ids->SetArray(cells->GetPointer(), cells->GetNumberOfConnectivityEntries(), 1);
+  view->SetCells(cells->GetNumberOfCells(), ids);
+  return view;
+}
+
+//-----------------------------------------------------------------------------
+/// Add a view of each array of data into views, with the same attributes
+/// (scalars, normals, texture coordinates...)
+void setDataViews(vtkDataSetAttributes* data, vtkDataSetAttributes* views)
+{
+  for (int i = 0; i < data->GetNumberOfArrays(); ++i)
+    {
+    vtkDataArray* array = data->GetArray(i);
+    if (!array)
+      {
+      continue;
+      }
+    vtkDataArray* view = newArrayView(array);
+    int index = views->AddArray(view);
+    view->Delete();
+    for (int attribute = 0; attribute < vtkDataSetAttributes::NUM_ATTRIBUTES;
+         ++attribute)
+      {
+      if (data->GetAttribute(attribute) == array)
+        {
+        views->SetActiveAttribute(index, attribute);
+        }
+      }
+    }
+}
+}
+
+//-----------------------------------------------------------------------------
+class qSlicerLITTPlanV2SharedAssetCachePrivate
+{
+public:
+  struct Asset
+  {
+    Asset() : UseCount(0), Loading(false) {}
+    vtkSmartPointer<vtkDataObject> Data;
+    vtkSmartPointer<vtkMatrix4x4> IJKToRAS;
+    int UseCount;
+    bool Loading;
+  };
+  QString key(const QString& fileName)const;
+
+  mutable QMutex Mutex;
+  QWaitCondition Loaded;
+  QHash<QString, Asset> Assets;
+};
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2SharedAssetCachePrivate::key(const QString& fileName)const
+{
+  QFileInfo fileInfo(fileName);
+  QString canonicalPath = fileInfo.canonicalFilePath();
+  return canonicalPath.isEmpty() ? fileInfo.absoluteFilePath() : canonicalPath;
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2SharedAssetCache::qSlicerLITTPlanV2SharedAssetCache()
+  : d_ptr(new qSlicerLITTPlanV2SharedAssetCachePrivate)
+{
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2SharedAssetCache::~qSlicerLITTPlanV2SharedAssetCache()
+{
+}
+
+//-----------------------------------------------------------------------------
+vtkDataObject* qSlicerLITTPlanV2SharedAssetCache::acquire(const QString& fileName)
+{
+  Q_D(qSlicerLITTPlanV2SharedAssetCache);
+  const QString key = d->key(fileName);
+
+  QMutexLocker locker(&d->Mutex);
+  // Another session may be reading the same file, wait for it instead of
+  // reading it twice.
+  while (d->Assets.contains(key) && d->Assets[key].Loading)
+    {
+    d->Loaded.wait(&d->Mutex);
+    }
+  if (d->Assets.contains(key))
+    {
+    qSlicerLITTPlanV2SharedAssetCachePrivate::Asset& asset = d->Assets[key];
+    ++asset.UseCount;
+    return asset.Data;
+    }
+
+  d->Assets[key].Loading = true;
+  locker.unlock();
+  // Reading is done without the lock: other assets can be acquired meanwhile.
+  vtkSmartPointer<vtkMatrix4x4> ijkToRAS = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkDataObject> data;
+  data.TakeReference(this->read(key, ijkToRAS));
+  locker.relock();
+
+  qSlicerLITTPlanV2SharedAssetCachePrivate::Asset& asset = d->Assets[key];
+  asset.Loading = false;
+  d->Loaded.wakeAll();
+  if (!data)
+    {
+    qWarning() << "Failed to read shared asset" << fileName;
+    d->Assets.remove(key);
+    return 0;
+    }
+  asset.Data = data;
+  asset.IJKToRAS = ijkToRAS;
+  asset.UseCount = 1;
+  return data;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2SharedAssetCache::release(const QString& fileName)
+{
+  Q_D(qSlicerLITTPlanV2SharedAssetCache);
+  const QString key = d->key(fileName);
+  QMutexLocker locker(&d->Mutex);
+  if (!d->Assets.contains(key) || d->Assets[key].Loading)
+    {
+    return;
+    }
+  if (--d->Assets[key].UseCount <= 0)
+    {
+    d->Assets.remove(key);
+    }
+}
+
+//-----------------------------------------------------------------------------
+vtkDataObject* qSlicerLITTPlanV2SharedAssetCache::asset(const QString& fileName)const
+{
+  Q_D(const qSlicerLITTPlanV2SharedAssetCache);
+  const QString key = d->key(fileName);
+  QMutexLocker locker(&d->Mutex);
+  return d->Assets.value(key).Data;
+}
+
+//-----------------------------------------------------------------------------
+const char* qSlicerLITTPlanV2SharedAssetCache::sharedAssetAttributeName()
+{
+  return "LITTPlanV2.SharedAsset";
+}
+
+//-----------------------------------------------------------------------------
+vtkDataObject* qSlicerLITTPlanV2SharedAssetCache::newView(const QString& fileName)const
+{
+  Q_D(const qSlicerLITTPlanV2SharedAssetCache);
+  const QString key = d->key(fileName);
+  // The lock also serializes the (read-only) accesses to the asset
+  QMutexLocker locker(&d->Mutex);
+  vtkDataObject* data = d->Assets.value(key).Data;
+  if (vtkImageData* image = vtkImageData::SafeDownCast(data))
+    {
+    vtkImageData* view = vtkImageData::New();
+    view->SetExtent(image->GetExtent());
+    view->SetWholeExtent(image->GetExtent());
+    view->SetScalarType(image->GetScalarType());
+    view->SetNumberOfScalarComponents(image->GetNumberOfScalarComponents());
+    setDataViews(image->GetPointData(), view->GetPointData());
+    setDataViews(image->GetCellData(), view->GetCellData());
+    return view;
+    }
+  if (vtkPolyData* polyData = vtkPolyData::SafeDownCast(data))
+    {
+    vtkPolyData* view = vtkPolyData::New();
+    vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+    vtkDataArray* coordinates = newArrayView(polyData->GetPoints()->GetData());
+    points->SetData(coordinates);
+    coordinates->Delete();
+    view->SetPoints(points);
+    vtkCellArray* cells = newCellArrayView(polyData->GetVerts());
+    view->SetVerts(cells);
+    cells->Delete();
+    cells = newCellArrayView(polyData->GetLines());
+    view->SetLines(cells);
+    cells->Delete();
+    cells = newCellArrayView(polyData->GetPolys());
+    view->SetPolys(cells);
+    cells->Delete();
+    cells = newCellArrayView(polyData->GetStrips());
+    view->SetStrips(cells);
+    cells->Delete();
+    setDataViews(polyData->GetPointData(), view->GetPointData());
+    setDataViews(polyData->GetCellData(), view->GetCellData());
+    return view;
+    }
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2SharedAssetCache::ijkToRASMatrix(
+  const QString& fileName, vtkMatrix4x4* matrix)const
+{
+  Q_D(const qSlicerLITTPlanV2SharedAssetCache);
+  const QString key = d->key(fileName);
+  QMutexLocker locker(&d->Mutex);
+  vtkMatrix4x4* ijkToRAS = d->Assets.value(key).IJKToRAS;
+  if (!ijkToRAS || !matrix)
+    {
+    return false;
+    }
+  matrix->DeepCopy(ijkToRAS);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerLITTPlanV2SharedAssetCache::useCount(const QString& fileName)const
+{
+  Q_D(const qSlicerLITTPlanV2SharedAssetCache);
+  const QString key = d->key(fileName);
+  QMutexLocker locker(&d->Mutex);
+  return d->Assets.value(key).UseCount;
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerLITTPlanV2SharedAssetCache::count()const
+{
+  Q_D(const qSlicerLITTPlanV2SharedAssetCache);
+  QMutexLocker locker(&d->Mutex);
+  return d->Assets.count();
+}
+
+//-----------------------------------------------------------------------------
+vtkDataObject* qSlicerLITTPlanV2SharedAssetCache::read(const QString& fileName,
+                                                       vtkMatrix4x4* ijkToRAS)const
+{
+  QFileInfo fileInfo(fileName);
+  if (!fileInfo.isReadable())
+    {
+    return 0;
+    }
+  QString suffix = fileInfo.suffix().toLower();
+  if (suffix == "nrrd" || suffix == "nhdr")
+    {
+    vtkSmartPointer<vtkNRRDReader> reader = vtkSmartPointer<vtkNRRDReader>::New();
+    if (!reader->CanReadFile(fileName.toLatin1()))
+      {
+      return 0;
+      }
+    reader->SetFileName(fileName.toLatin1());
+    reader->Update();
+    if (!readSucceeded(reader, reader->GetOutput()))
+      {
+      return 0;
+      }
+    vtkDataObject* data = newAsset(reader->GetOutput(), ijkToRAS);
+    // The orientation is only in the RAS to IJK matrix of the reader
+    vtkMatrix4x4::Invert(reader->GetRasToIjkMatrix(), ijkToRAS);
+    return data;
+    }
+  if (suffix == "vtk")
+    {
+    vtkSmartPointer<vtkGenericDataObjectReader> reader =
+      vtkSmartPointer<vtkGenericDataObjectReader>::New();
+    reader->SetFileName(fileName.toLatin1());
+    reader->Update();
+    if (!readSucceeded(reader, reader->GetOutput()))
+      {
+      return 0;
+      }
+    return newAsset(reader->GetOutput(), ijkToRAS);
+    }
+  vtkSmartPointer<vtkXMLGenericDataObjectReader> reader =
+    vtkSmartPointer<vtkXMLGenericDataObjectReader>::New();
+  reader->SetFileName(fileName.toLatin1());
+  reader->Update();
+  if (!readSucceeded(reader, reader->GetOutput()))
+    {
+    return 0;
+    }
+  return newAsset(reader->GetOutput(), ijkToRAS);
+}
@@ -0,0 +1,100 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __qSlicerLITTPlanV2SharedAssetCache_h
+#define __qSlicerLITTPlanV2SharedAssetCache_h
+
+// Qt includes
+#include <QScopedPointer>
+#include <QString>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModuleExport.h"
+
+class qSlicerLITTPlanV2SharedAssetCachePrivate;
+class vtkDataObject;
+class vtkMatrix4x4;
+
+/// \ingroup Slicer_QtModules_LITTPlanV2
+/// Thread-safe cache of read-only data (atlases, templates, distance maps...)
+/// shared between planning sessions.
+///
+/// An asset is read from disk by the first acquire() and released from
+/// memory when the last user calls release(). The returned data objects
+/// MUST NOT be modified: they are used concurrently by several sessions.
+/// Supported formats are NRRD (*.nrrd, *.nhdr), legacy VTK (*.vtk) and
+/// VTK XML files (*.vti, *.vtp...).
+///
+/// Sessions use an asset through a view (newView()): a new data object
+/// pointing to the memory of the asset without referencing its arrays.
+/// Views can be put into a session scene and deleted by any thread, the
+/// reference counts of the shared asset are never touched.
+/// The arrays of a view alias the memory of the asset (they don't own it):
+/// views are read-only too, writing their values modifies the asset for
+/// every session. Copy (DeepCopy()) a view before modifying it. The MRML
+/// nodes displaying a view are marked with sharedAssetAttributeName().
+class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT qSlicerLITTPlanV2SharedAssetCache
+{
+public:
+  qSlicerLITTPlanV2SharedAssetCache();
+  virtual ~qSlicerLITTPlanV2SharedAssetCache();
+
+  /// Load the asset if it is not in the cache yet and increment its use
+  /// count. Returns 0 if the file can't be read.
+  vtkDataObject* acquire(const QString& fileName);
+
+  /// Decrement the use count of the asset, free it when it reaches 0.
+  void release(const QString& fileName);
+
+  /// Return the asset if loaded, 0 otherwise. Does not change the use count.
+  vtkDataObject* asset(const QString& fileName)const;
+
+  /// Return a new data object (to be deleted by the caller) sharing the
+  /// memory of the image or polydata asset, 0 if the asset is not loaded or
+  /// is of another type. All the point and cell data arrays are shared,
+  /// with their attributes. The view is valid until the asset is released
+  /// and must not be modified.
+  /// The images have an origin of 0 and a spacing of 1, see ijkToRASMatrix().
+  vtkDataObject* newView(const QString& fileName)const;
+
+  /// Attribute of the MRML nodes whose data is a view, set to the file name
+  /// of the asset: the data of the node is read-only.
+  static const char* sharedAssetAttributeName();
+
+  /// Geometry of an image asset. Returns false if the asset is not loaded.
+  bool ijkToRASMatrix(const QString& fileName, vtkMatrix4x4* matrix)const;
+
+  /// Number of acquire() not yet balanced by a release()
+  int useCount(const QString& fileName)const;
+
+  /// Number of assets currently in memory
+  int count()const;
+
+protected:
+  /// Read the file. Reimplement to support more formats.
+  /// Images are returned with an origin of 0 and a spacing of 1, their
+  /// geometry is set into ijkToRAS. Returns 0 if the file can't be read.
+  virtual vtkDataObject* read(const QString& fileName, vtkMatrix4x4* ijkToRAS)const;
+
+  QScopedPointer<qSlicerLITTPlanV2SharedAssetCachePrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(qSlicerLITTPlanV2SharedAssetCache);
+  Q_DISABLE_COPY(qSlicerLITTPlanV2SharedAssetCache);
+};
+
+#endif
@@ -0,0 +1,720 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
+#include <QtConcurrentRun>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ThermometryStream.h"
+#include "vtkLITTPlanV2ThermalDoseAccumulator.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLTransformNode.h>
+
+// Teem includes
+#include <vtkNRRDReader.h>
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
+#include <vtkWeakPointer.h>
+#include <vtkXMLImageDataReader.h>
+
+// STD includes
+#include <cstring>
+
+namespace
+{
+//-----------------------------------------------------------------------------
+/// Copy the scalars of source into target, reusing the scalars of target
+/// when they have the same type.
+void copyImage(vtkImageData* source, vtkImageData* target)
+{
+  vtkDataArray* sourceScalars = source->GetPointData()->GetScalars();
+  vtkSmartPointer<vtkDataArray> targetScalars =
+    target->GetPointData()->GetScalars();
+  if (!targetScalars ||
+      targetScalars->GetDataType() != sourceScalars->GetDataType() ||
+      targetScalars->GetNumberOfComponents() !=
+        sourceScalars->GetNumberOfComponents())
+    {
+    targetScalars.TakeReference(sourceScalars->NewInstance());
+    targetScalars->SetNumberOfComponents(
+      sourceScalars->GetNumberOfComponents());
+    }
+  // Only grows the allocation
+  targetScalars->SetNumberOfTuples(sourceScalars->GetNumberOfTuples());
+  memcpy(targetScalars->GetVoidPointer(0), sourceScalars->GetVoidPointer(0),
+         sourceScalars->GetNumberOfTuples() *
+         sourceScalars->GetNumberOfComponents() *
+         sourceScalars->GetDataTypeSize());
+  target->SetDimensions(source->GetDimensions());
+  target->SetScalarType(sourceScalars->GetDataType());
+  target->SetNumberOfScalarComponents(sourceScalars->GetNumberOfComponents());
+  target->GetPointData()->SetScalars(targetScalars);
+  targetScalars->Modified();
+}
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2ThermometryStream::Timings::Timings()
+  : Read(0.)
+  , Registration(0.)
+  , Accumulation(0.)
+  , Display(0.)
+  , Latency(0.)
+{
+}
+
+//-----------------------------------------------------------------------------
+class qSlicerLITTPlanV2ThermometryStreamPrivate
+{
+  Q_DECLARE_PUBLIC(qSlicerLITTPlanV2ThermometryStream);
+protected:
+  qSlicerLITTPlanV2ThermometryStream* const q_ptr;
+public:
+  struct Frame
+  {
+    Frame() : Time(0.), Arrival(0.), ReadTime(0.) {}
+    vtkSmartPointer<vtkImageData> Image;
+    vtkSmartPointer<vtkMatrix4x4> IJKToRAS;
+    double Time;
+    /// Universal time the frame arrived at
+    double Arrival;
+    double ReadTime;
+  };
+  qSlicerLITTPlanV2ThermometryStreamPrivate(qSlicerLITTPlanV2ThermometryStream& object);
+
+  /// Copy the frame into a buffer of the pool and queue it, wait for a free
+  /// slot if the queue is full. Returns false if the stream is stopped.
+  bool enqueue(vtkImageData* image, vtkMatrix4x4* ijkToRAS, double time,
+               double arrival, double readTime);
+  /// Background thread: register and accumulate the queued frames
+  void process();
+  /// Background thread: read the files and queue them on schedule
+  void replay(const QStringList& files, double frameInterval, double speed);
+
+  vtkWeakPointer<vtkMRMLScalarVolumeNode> DamageVolumeNode;
+  vtkWeakPointer<vtkMRMLTransformNode> TransformNode;
+  vtkSmartPointer<vtkLITTPlanV2ThermalDoseAccumulator> Accumulator;
+  /// Protects the outputs of the accumulator
+  QMutex AccumulatorMutex;
+
+  /// Protects the members below
+  mutable QMutex Mutex;
+  QWaitCondition FrameQueued;
+  /// Woken when a pending frame is taken by the worker, or is processed
+  QWaitCondition SlotFree;
+  QWaitCondition StopRequested;
+  QQueue<Frame> PendingFrames;
+  QList<Frame> FreeFrames;
+  int MaximumNumberOfPendingFrames;
+  /// Frames being copied by enqueue(), counted as pending
+  int EnqueuingFrames;
+  /// Set while the worker accumulates a frame
+  bool Processing;
+  int NumberOfFrameBuffers;
+  /// Snapshots of the MRML geometry, taken in the main thread
+  vtkSmartPointer<vtkMatrix4x4> GridIJKToRAS;
+  vtkSmartPointer<vtkMatrix4x4> FrameToRAS;
+  bool Running;
+  bool Stopping;
+  /// Set when the replay is over: the worker stops once the queue is empty
+  bool Draining;
+  /// Set while a display of the accumulated frame is queued
+  bool DisplayPending;
+  /// Last frame accumulated, not displayed yet
+  double AccumulatedTime;
+  double AccumulatedArrival;
+  qSlicerLITTPlanV2ThermometryStream::Timings AccumulatedTimings;
+
+  QFuture<void> Worker;
+  QFutureWatcher<void>* ReplayWatcher;
+  int NumberOfFrames;
+  qSlicerLITTPlanV2ThermometryStream::Timings LastTimings;
+};
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2ThermometryStreamPrivate
+::qSlicerLITTPlanV2ThermometryStreamPrivate(qSlicerLITTPlanV2ThermometryStream& object)
+  : q_ptr(&object)
+{
+  this->Accumulator = vtkSmartPointer<vtkLITTPlanV2ThermalDoseAccumulator>::New();
+  this->MaximumNumberOfPendingFrames = 2;
+  this->EnqueuingFrames = 0;
+  this->Processing = false;
+  this->NumberOfFrameBuffers = 0;
+  this->GridIJKToRAS = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->FrameToRAS = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->Running = false;
+  this->Stopping = false;
+  this->Draining = false;
+  this->DisplayPending = false;
+  this->AccumulatedTime = 0.;
+  this->AccumulatedArrival = 0.;
+  this->ReplayWatcher = 0;
+  this->NumberOfFrames = 0;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ThermometryStreamPrivate::enqueue(
+  vtkImageData* image, vtkMatrix4x4* ijkToRAS, double time,
+  double arrival, double readTime)
+{
+  Frame frame;
+  {
+  QMutexLocker locker(&this->Mutex);
+  // Back-pressure: never drop a frame, its heat would be missing from the
+  // damage integral.
+  while (this->Running && !this->Stopping &&
+         this->PendingFrames.count() + this->EnqueuingFrames >=
+           this->MaximumNumberOfPendingFrames)
+    {
+    this->SlotFree.wait(&this->Mutex);
+    }
+  if (!this->Running || this->Stopping)
+    {
+    return false;
+    }
+  ++this->EnqueuingFrames;
+  if (!this->FreeFrames.isEmpty())
+    {
+    frame = this->FreeFrames.takeLast();
+    }
+  else
+    {
+    ++this->NumberOfFrameBuffers;
+    }
+  }
+  if (!frame.Image)
+    {
+    frame.Image = vtkSmartPointer<vtkImageData>::New();
+    frame.IJKToRAS = vtkSmartPointer<vtkMatrix4x4>::New();
+    }
+  // Copy outside of the lock, the worker keeps running
+  copyImage(image, frame.Image);
+  frame.IJKToRAS->DeepCopy(ijkToRAS);
+  frame.Time = time;
+  frame.Arrival = arrival;
+  frame.ReadTime = readTime;
+
+  QMutexLocker locker(&this->Mutex);
+  --this->EnqueuingFrames;
+  if (this->Stopping)
+    {
+    this->FreeFrames << frame;
+    this->SlotFree.wakeAll();
+    return false;
+    }
+  this->PendingFrames.enqueue(frame);
+  this->FrameQueued.wakeAll();
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ThermometryStreamPrivate::process()
+{
+  Q_Q(qSlicerLITTPlanV2ThermometryStream);
+  vtkSmartPointer<vtkMatrix4x4> gridIJKToFrameIJK =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> rasToFrameIJK =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> frameRASToIJK =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> rasToFrame =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSmartPointer<vtkMatrix4x4> gridIJKToRAS =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  forever
+    {
+    Frame frame;
+    {
+    QMutexLocker locker(&this->Mutex);
+    while (this->PendingFrames.isEmpty() &&
+           !this->Stopping && !this->Draining)
+      {
+      this->FrameQueued.wait(&this->Mutex);
+      }
+    if (this->Stopping || this->PendingFrames.isEmpty())
+      {
+      return;
+      }
+    frame = this->PendingFrames.dequeue();
+    this->Processing = true;
+    this->SlotFree.wakeAll();
+    gridIJKToRAS->DeepCopy(this->GridIJKToRAS);
+    vtkMatrix4x4::Invert(this->FrameToRAS, rasToFrame);
+    }
+
+    // Damage grid IJK -> RAS -> frame RAS (before registration) -> frame IJK
+    vtkMatrix4x4::Invert(frame.IJKToRAS, frameRASToIJK);
+    vtkMatrix4x4::Multiply4x4(frameRASToIJK, rasToFrame, rasToFrameIJK);
+    vtkMatrix4x4::Multiply4x4(rasToFrameIJK, gridIJKToRAS, gridIJKToFrameIJK);
+
+    bool accumulated = false;
+    qSlicerLITTPlanV2ThermometryStream::Timings timings;
+    {
+    QMutexLocker accumulatorLocker(&this->AccumulatorMutex);
+    accumulated = this->Accumulator->AddFrame(
+      frame.Image, gridIJKToFrameIJK, frame.Time);
+    timings.Read = frame.ReadTime;
+    timings.Registration = this->Accumulator->GetResampleTime();
+    timings.Accumulation = this->Accumulator->GetAccumulationTime();
+    }
+
+    QMutexLocker locker(&this->Mutex);
+    this->FreeFrames << frame;
+    this->Processing = false;
+    this->SlotFree.wakeAll();
+    if (!accumulated)
+      {
+      qWarning() << "qSlicerLITTPlanV2ThermometryStream: frame at"
+                 << frame.Time << "s can't be accumulated";
+      continue;
+      }
+    this->AccumulatedTime = frame.Time;
+    this->AccumulatedArrival = frame.Arrival;
+    this->AccumulatedTimings = timings;
+    if (!this->DisplayPending)
+      {
+      this->DisplayPending = true;
+      QMetaObject::invokeMethod(q, "onFrameAccumulated", Qt::QueuedConnection);
+      }
+    }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ThermometryStreamPrivate::replay(
+  const QStringList& files, double frameInterval, double speed)
+{
+  vtkSmartPointer<vtkNRRDReader> nrrdReader =
+    vtkSmartPointer<vtkNRRDReader>::New();
+  vtkSmartPointer<vtkXMLImageDataReader> xmlReader =
+    vtkSmartPointer<vtkXMLImageDataReader>::New();
+  vtkSmartPointer<vtkMatrix4x4> ijkToRAS = vtkSmartPointer<vtkMatrix4x4>::New();
+  const double replayStart = vtkTimerLog::GetUniversalTime();
+  for (int i = 0; i < files.count(); ++i)
+    {
+    const double time = i * frameInterval;
+    // Wait for the acquisition time of the frame
+    if (speed > 0.)
+      {
+      QMutexLocker locker(&this->Mutex);
+      forever
+        {
+        double delay = replayStart + time / speed -
+          vtkTimerLog::GetUniversalTime();
+        if (this->Stopping || delay <= 0.)
+          {
+          break;
+          }
+        this->StopRequested.wait(&this->Mutex,
+                                 static_cast<unsigned long>(delay * 1000.) + 1);
+        }
+      }
+    {
+    QMutexLocker locker(&this->Mutex);
+    if (this->Stopping)
+      {
+      return;
+      }
+    }
+
+    const double arrival = vtkTimerLog::GetUniversalTime();
+    const QByteArray fileName = files[i].toLocal8Bit();
+    vtkImageData* image = 0;
+    if (files[i].endsWith(".vti", Qt::CaseInsensitive))
+      {
+      xmlReader->SetFileName(fileName.constData());
+      xmlReader->Update();
+      image = xmlReader->GetOutput();
+      // The geometry of the image is in RAS
+      ijkToRAS->Identity();
+      for (int j = 0; j < 3; ++j)
+        {
+        ijkToRAS->SetElement(j, j, image->GetSpacing()[j]);
+        ijkToRAS->SetElement(j, 3, image->GetOrigin()[j]);
+        }
+      }
+    else
+      {
+      nrrdReader->SetFileName(fileName.constData());
+      nrrdReader->Update();
+      image = nrrdReader->GetOutput();
+      vtkMatrix4x4::Invert(nrrdReader->GetRasToIjkMatrix(), ijkToRAS);
+      }
+    if (!image || !image->GetPointData()->GetScalars())
+      {
+      qWarning() << "Can't read thermometry frame" << files[i];
+      continue;
+      }
+    // Blocks while the worker is behind
+    if (!this->enqueue(image, ijkToRAS, time, arrival,
+                       vtkTimerLog::GetUniversalTime() - arrival))
+      {
+      return;
+      }
+    }
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2ThermometryStream::qSlicerLITTPlanV2ThermometryStream(QObject* _parent)
+  : Superclass(_parent)
+  , d_ptr(new qSlicerLITTPlanV2ThermometryStreamPrivate(*this))
+{
+  Q_D(qSlicerLITTPlanV2ThermometryStream);
+  d->ReplayWatcher = new QFutureWatcher<void>(this);
+  this->connect(d->ReplayWatcher, SIGNAL(finished()),
+                SLOT(onReplayFinished()));
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2ThermometryStream::~qSlicerLITTPlanV2ThermometryStream()
+{
+  this->stop();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ThermometryStream::setDamageVolumeNode(vtkMRMLScalarVolumeNode* node)
+{
+  Q_D(qSlicerLITTPlanV2ThermometryStream);
+  if (node == d->DamageVolumeNode)
+    {
+    return;
+    }
+  this->stop();
+  d->DamageVolumeNode = node;
+}
+
+//-----------------------------------------------------------------------------
+vtkMRMLScalarVolumeNode* qSlicerLITTPlanV2ThermometryStream::damageVolumeNode()const
+{
+  Q_D(const qSlicerLITTPlanV2ThermometryStream);
+  return d->DamageVolumeNode;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ThermometryStream::setTransformNode(vtkMRMLTransformNode* node)
+{
+  Q_D(qSlicerLITTPlanV2ThermometryStream);
+  this->qvtkReconnect(d->TransformNode, node,
+    vtkMRMLTransformableNode::TransformModifiedEvent,
+    this, SLOT(onTransformModified()));
+  d->TransformNode = node;
+  this->onTransformModified();
+}
+
+//-----------------------------------------------------------------------------
+vtkMRMLTransformNode* qSlicerLITTPlanV2ThermometryStream::transformNode()const
+{
+  Q_D(const qSlicerLITTPlanV2ThermometryStream);
+  return d->TransformNode;
+}
+
+//-----------------------------------------------------------------------------
+vtkLITTPlanV2ThermalDoseAccumulator* qSlicerLITTPlanV2ThermometryStream::accumulator()const
+{
+  Q_D(const qSlicerLITTPlanV2ThermometryStream);
+  return d->Accumulator;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ThermometryStream::setMaximumNumberOfPendingFrames(int count)
+{
+  Q_D(qSlicerLITTPlanV2ThermometryStream);
+  QMutexLocker locker(&d->Mutex);
+  d->MaximumNumberOfPendingFrames = qMax(1, count);
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerLITTPlanV2ThermometryStream::maximumNumberOfPendingFrames()const
+{
+  Q_D(const qSlicerLITTPlanV2ThermometryStream);
+  QMutexLocker locker(&d->Mutex);
+  return d->MaximumNumberOfPendingFrames;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ThermometryStream::start()
+{
+  Q_D(qSlicerLITTPlanV2ThermometryStream);
+  this->stop();
+  vtkImageData* labelMap =
+    d->DamageVolumeNode ? d->DamageVolumeNode->GetImageData() : 0;
+  if (!labelMap || !labelMap->GetPointData()->GetScalars() ||
+      labelMap->GetScalarType() != VTK_UNSIGNED_CHAR)
+    {
+    qWarning() << "qSlicerLITTPlanV2ThermometryStream::start:"
+               << "the damage volume is not an allocated label map";
+    return false;
+    }
+  d->Accumulator->Initialize(labelMap->GetDimensions());
+
+  QMutexLocker locker(&d->Mutex);
+  vtkSmartPointer<vtkMatrix4x4> ijkToRAS = vtkSmartPointer<vtkMatrix4x4>::New();
+  d->DamageVolumeNode->GetIJKToRASMatrix(ijkToRAS);
+  d->GridIJKToRAS->DeepCopy(ijkToRAS);
+  vtkMRMLTransformNode* parentTransform =
+    d->DamageVolumeNode->GetParentTransformNode();
+  if (parentTransform && parentTransform->IsTransformToWorldLinear())
+    {
+    vtkSmartPointer<vtkMatrix4x4> toWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+    parentTransform->GetMatrixTransformToWorld(toWorld);
+    vtkMatrix4x4::Multiply4x4(toWorld, ijkToRAS, d->GridIJKToRAS);
+    }
+  d->Running = true;
+  d->Stopping = false;
+  d->Draining = false;
+  d->Processing = false;
+  d->DisplayPending = false;
+  d->NumberOfFrames = 0;
+  d->LastTimings = Timings();
+  d->Worker = QtConcurrent::run(
+    d, &qSlicerLITTPlanV2ThermometryStreamPrivate::process);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ThermometryStream::stop()
+{
+  Q_D(qSlicerLITTPlanV2ThermometryStream);
+  {
+  QMutexLocker locker(&d->Mutex);
+  if (!d->Running)
+    {
+    return;
+    }
+  d->Stopping = true;
+  d->FrameQueued.wakeAll();
+  d->SlotFree.wakeAll();
+  d->StopRequested.wakeAll();
+  }
+  d->ReplayWatcher->waitForFinished();
+  d->Worker.waitForFinished();
+  {
+  QMutexLocker locker(&d->Mutex);
+  while (!d->PendingFrames.isEmpty())
+    {
+    d->FreeFrames << d->PendingFrames.dequeue();
+    }
+  d->Running = false;
+  }
+  // Display the last frame accumulated
+  this->onFrameAccumulated();
+  emit finished();
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ThermometryStream::flush()
+{
+  Q_D(qSlicerLITTPlanV2ThermometryStream);
+  {
+  QMutexLocker locker(&d->Mutex);
+  while (d->Running && !d->Stopping &&
+         (!d->PendingFrames.isEmpty() || d->EnqueuingFrames > 0 ||
+          d->Processing))
+    {
+    d->SlotFree.wait(&d->Mutex);
+    }
+  }
+  this->onFrameAccumulated();
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ThermometryStream::isRunning()const
+{
+  Q_D(const qSlicerLITTPlanV2ThermometryStream);
+  QMutexLocker locker(&d->Mutex);
+  return d->Running;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ThermometryStream::pushFrame(
+  vtkImageData* frame, vtkMatrix4x4* ijkToRAS, double time)
+{
+  Q_D(qSlicerLITTPlanV2ThermometryStream);
+  if (!frame || !frame->GetPointData()->GetScalars() || !ijkToRAS)
+    {
+    qWarning() << "qSlicerLITTPlanV2ThermometryStream::pushFrame:"
+               << "invalid frame at" << time << "s";
+    return false;
+    }
+  if (!d->enqueue(frame, ijkToRAS, time, vtkTimerLog::GetUniversalTime(), 0.))
+    {
+    qWarning() << "qSlicerLITTPlanV2ThermometryStream::pushFrame:"
+               << "the stream is not running, frame at" << time
+               << "s not accumulated";
+    return false;
+    }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+QStringList qSlicerLITTPlanV2ThermometryStream::frameFiles(const QString& directory)
+{
+  QStringList nameFilters;
+  nameFilters << "*.nrrd" << "*.nhdr" << "*.vti";
+  QStringList files;
+  foreach(const QFileInfo& fileInfo, QDir(directory).entryInfoList(
+            nameFilters, QDir::Files, QDir::Name))
+    {
+    files << fileInfo.absoluteFilePath();
+    }
+  return files;
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2ThermometryStream::replayDirectory(
+  const QString& directory, double frameInterval, double speed)
+{
+  Q_D(qSlicerLITTPlanV2ThermometryStream);
+  QStringList files = qSlicerLITTPlanV2ThermometryStream::frameFiles(directory);
+  if (files.isEmpty() || frameInterval <= 0. || !this->start())
+    {
+    return false;
+    }
+  d->ReplayWatcher->setFuture(QtConcurrent::run(
+    d, &qSlicerLITTPlanV2ThermometryStreamPrivate::replay,
+    files, frameInterval, speed));
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerLITTPlanV2ThermometryStream::numberOfFrames()const
+{
+  Q_D(const qSlicerLITTPlanV2ThermometryStream);
+  return d->NumberOfFrames;
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerLITTPlanV2ThermometryStream::numberOfFrameBuffers()const
+{
+  Q_D(const qSlicerLITTPlanV2ThermometryStream);
+  QMutexLocker locker(&d->Mutex);
+  return d->NumberOfFrameBuffers;
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2ThermometryStream::Timings
+qSlicerLITTPlanV2ThermometryStream::lastTimings()const
+{
+  Q_D(const qSlicerLITTPlanV2ThermometryStream);
+  return d->LastTimings;
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ThermometryStream::onTransformModified()
+{
+  Q_D(qSlicerLITTPlanV2ThermometryStream);
+  vtkSmartPointer<vtkMatrix4x4> frameToRAS =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  if (d->TransformNode)
+    {
+    if (d->TransformNode->IsTransformToWorldLinear())
+      {
+      d->TransformNode->GetMatrixTransformToWorld(frameToRAS);
+      }
+    else
+      {
+      qWarning() << "qSlicerLITTPlanV2ThermometryStream:"
+                 << "non linear transforms are not supported";
+      }
+    }
+  QMutexLocker locker(&d->Mutex);
+  d->FrameToRAS->DeepCopy(frameToRAS);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ThermometryStream::onFrameAccumulated()
+{
+  Q_D(qSlicerLITTPlanV2ThermometryStream);
+  double time = 0.;
+  double arrival = 0.;
+  Timings timings;
+  {
+  QMutexLocker locker(&d->Mutex);
+  if (!d->DisplayPending)
+    {
+    return;
+    }
+  d->DisplayPending = false;
+  time = d->AccumulatedTime;
+  arrival = d->AccumulatedArrival;
+  timings = d->AccumulatedTimings;
+  }
+
+  const double displayStart = vtkTimerLog::GetUniversalTime();
+  vtkImageData* labelMap =
+    d->DamageVolumeNode ? d->DamageVolumeNode->GetImageData() : 0;
+  vtkDataArray* scalars =
+    labelMap ? labelMap->GetPointData()->GetScalars() : 0;
+  if (!scalars)
+    {
+    return;
+    }
+  {
+  QMutexLocker accumulatorLocker(&d->AccumulatorMutex);
+  vtkDataArray* damaged =
+    d->Accumulator->GetLabelMap()->GetPointData()->GetScalars();
+  if (!damaged ||
+      damaged->GetNumberOfTuples() != scalars->GetNumberOfTuples() ||
+      scalars->GetDataType() != VTK_UNSIGNED_CHAR)
+    {
+    return;
+    }
+  memcpy(scalars->GetVoidPointer(0), damaged->GetVoidPointer(0),
+         damaged->GetNumberOfTuples());
+  }
+  scalars->Modified();
+  labelMap->Modified();
+  const double displayEnd = vtkTimerLog::GetUniversalTime();
+  timings.Display = displayEnd - displayStart;
+  timings.Latency = displayEnd - arrival;
+  d->LastTimings = timings;
+  ++d->NumberOfFrames;
+  emit frameProcessed(d->NumberOfFrames - 1, time);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerLITTPlanV2ThermometryStream::onReplayFinished()
+{
+  Q_D(qSlicerLITTPlanV2ThermometryStream);
+  {
+  QMutexLocker locker(&d->Mutex);
+  if (!d->Running || d->Stopping)
+    {
+    return;
+    }
+  // Process the frames still queued, then stop
+  d->Draining = true;
+  d->FrameQueued.wakeAll();
+  }
+  d->Worker.waitForFinished();
+  this->stop();
+}
@@ -0,0 +1,146 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __qSlicerLITTPlanV2ThermometryStream_h
+#define __qSlicerLITTPlanV2ThermometryStream_h
+
+// Qt includes
+#include <QObject>
+#include <QStringList>
+
+// CTK includes
+#include <ctkVTKObject.h>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModuleExport.h"
+
+class qSlicerLITTPlanV2ThermometryStreamPrivate;
+class vtkImageData;
+class vtkLITTPlanV2ThermalDoseAccumulator;
+class vtkMatrix4x4;
+class vtkMRMLScalarVolumeNode;
+class vtkMRMLTransformNode;
+class vtkObject;
+
+/// \ingroup Slicer_QtModules_LITTPlanV2
+/// Live thermal damage from a stream of MR thermometry (PRF) frames.
+///
+/// The frames are pushed by an acquisition (pushFrame()) or replayed from
+/// the files of a directory (replayDirectory()). A background thread
+/// registers each frame into the damage volume through the transform node,
+/// accumulates the Arrhenius damage (vtkLITTPlanV2ThermalDoseAccumulator)
+/// and the label map of the damage volume is updated in the main thread.
+///
+/// The frames are copied into a small pool of reused buffers. No frame is
+/// ever dropped, the damage integral would be under-estimated: when the
+/// frames arrive faster than they are processed, pushFrame() and the replay
+/// block until a pending frame is processed (back-pressure).
+class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT qSlicerLITTPlanV2ThermometryStream
+  : public QObject
+{
+  Q_OBJECT
+  QVTK_OBJECT
+public:
+  typedef QObject Superclass;
+  qSlicerLITTPlanV2ThermometryStream(QObject* parent = 0);
+  virtual ~qSlicerLITTPlanV2ThermometryStream();
+
+  /// Time in seconds spent by each stage on the last frame displayed.
+  /// Latency is the time from the arrival of the frame (the start of its
+  /// reading when replayed) to its display.
+  struct Timings
+  {
+    Timings();
+    double Read;
+    double Registration;
+    double Accumulation;
+    double Display;
+    double Latency;
+  };
+
+  /// Label map volume updated with the damaged voxels. Its image data
+  /// defines the damage grid: it must be allocated (unsigned char) before
+  /// the stream starts.
+  void setDamageVolumeNode(vtkMRMLScalarVolumeNode* node);
+  vtkMRMLScalarVolumeNode* damageVolumeNode()const;
+
+  /// Transform placing the frames in RAS, 0 if they are already in RAS
+  void setTransformNode(vtkMRMLTransformNode* node);
+  vtkMRMLTransformNode* transformNode()const;
+
+  /// Damage model. Its parameters can be changed before the stream starts.
+  vtkLITTPlanV2ThermalDoseAccumulator* accumulator()const;
+
+  /// Maximum number of frames waiting to be processed. pushFrame() and the
+  /// replay block while that many frames are waiting. Default is 2.
+  void setMaximumNumberOfPendingFrames(int count);
+  int maximumNumberOfPendingFrames()const;
+
+  /// Start a stream: reset the damage. Returns false if the damage volume
+  /// is not set or not allocated.
+  bool start();
+  /// Stop the stream, wait for the frame being processed. The frames still
+  /// waiting are discarded, call flush() before to process them.
+  void stop();
+  /// Wait for the frames queued to be accumulated, and display the damage.
+  void flush();
+  bool isRunning()const;
+
+  /// Queue a frame acquired at time (seconds). ijkToRAS is the geometry of
+  /// the frame, the frame is copied: the caller keeps ownership.
+  /// Blocks while maximumNumberOfPendingFrames() frames are waiting.
+  /// Returns false, with a warning, if the frame is invalid or the stream
+  /// is not running (or is stopped while waiting): the frame is not
+  /// accumulated.
+  /// Thread-safe, can be called from the acquisition thread.
+  bool pushFrame(vtkImageData* frame, vtkMatrix4x4* ijkToRAS, double time);
+
+  /// Start a stream and replay the frames (*.nrrd, *.nhdr, *.vti) of the
+  /// directory, in file name order, acquired every frameInterval seconds.
+  /// speed is the replay rate relative to the acquisition: 0 to replay as
+  /// fast as possible.
+  bool replayDirectory(const QString& directory, double frameInterval,
+                       double speed = 1.);
+  /// Frame files of the directory, in replay order
+  static QStringList frameFiles(const QString& directory);
+
+  /// Number of frames displayed since the stream started
+  int numberOfFrames()const;
+  /// Number of frame buffers allocated in the pool since construction
+  int numberOfFrameBuffers()const;
+  Timings lastTimings()const;
+
+signals:
+  /// Emitted in the main thread when the damage of a frame is displayed
+  void frameProcessed(int frame, double time);
+  /// Emitted in the main thread when the stream stops or the replay ends
+  void finished();
+
+protected slots:
+  void onTransformModified();
+  void onFrameAccumulated();
+  void onReplayFinished();
+
+protected:
+  QScopedPointer<qSlicerLITTPlanV2ThermometryStreamPrivate> d_ptr;
+
+private:
+  Q_DECLARE_PRIVATE(qSlicerLITTPlanV2ThermometryStream);
+  Q_DISABLE_COPY(qSlicerLITTPlanV2ThermometryStream);
+};
+
+#endif
@@ -0,0 +1,703 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Qt includes
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QtConcurrentMap>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2TransformFileReader.h"
+
+// Logic includes
+#include "vtkSlicerTransformLogic.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLTransformStorageNode.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+/// Powers of 10 exactly representable as doubles
+const double ExactPowersOf10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+const int MaximumExactPowerOf10 = 22;
+/// Integers up to 2^53 are exactly representable as doubles
+const quint64 MaximumExactMantissa = Q_UINT64_C(1) << 53;
+/// More digits don't fit in the 64 bits mantissa
+const int MaximumNumberOfDigits = 19;
+
+//-----------------------------------------------------------------------------
+inline bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+//-----------------------------------------------------------------------------
+inline bool isBlank(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+//-----------------------------------------------------------------------------
+/// Return true if the 8 bytes are all ASCII digits (SWAR).
+inline bool areEightDigits(quint64 chunk)
+{
+  return (((chunk & Q_UINT64_C(0xF0F0F0F0F0F0F0F0)) |
+           (((chunk + Q_UINT64_C(0x0606060606060606)) &
+             Q_UINT64_C(0xF0F0F0F0F0F0F0F0)) >> 4)) ==
+          Q_UINT64_C(0x3333333333333333));
+}
+
+//-----------------------------------------------------------------------------
+/// Value of 8 ASCII digits, first digit in the lowest byte (SWAR).
+inline quint32 parseEightDigits(quint64 chunk)
+{
+  chunk = ((chunk & Q_UINT64_C(0x0F0F0F0F0F0F0F0F)) * 2561) >> 8;
+  chunk = ((chunk & Q_UINT64_C(0x00FF00FF00FF00FF)) * 6553601) >> 16;
+  return static_cast<quint32>(
+    ((chunk & Q_UINT64_C(0x0000FFFF0000FFFF)) * Q_UINT64_C(42949672960001)) >> 32);
+}
+#endif
+
+//-----------------------------------------------------------------------------
+/// Accumulate the digits at p into the mantissa. Digits beyond the
+/// capacity of the mantissa set overflow.
+inline const char* scanDigits(const char* p, const char* end,
+                              quint64& mantissa, int& numberOfDigits,
+                              bool& overflow)
+{
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+  while (end - p >= 8 && numberOfDigits + 8 <= MaximumNumberOfDigits)
+    {
+    quint64 chunk;
+    memcpy(&chunk, p, 8);
+    if (!areEightDigits(chunk))
+      {
+      break;
+      }
+    mantissa = mantissa * 100000000 + parseEightDigits(chunk);
+    numberOfDigits += 8;
+    p += 8;
+    }
+#endif
+  for (; p < end && isDigit(*p); ++p)
+    {
+    if (numberOfDigits < MaximumNumberOfDigits)
+      {
+      mantissa = mantissa * 10 + (*p - '0');
+      ++numberOfDigits;
+      }
+    else
+      {
+      overflow = true;
+      }
+    }
+  return p;
+}
+
+//-----------------------------------------------------------------------------
+/// Parse the token with strtod(), for the numbers that can't be computed
+/// exactly from their mantissa and exponent (and nan, inf...).
+const char* scanDoubleSlow(const char* p, const char* end, double& value)
+{
+  const char* tokenEnd = p;
+  while (tokenEnd < end && !isBlank(*tokenEnd))
+    {
+    ++tokenEnd;
+    }
+  char token[64];
+  const size_t length = tokenEnd - p;
+  if (length == 0 || length >= sizeof(token))
+    {
+    return 0;
+    }
+  memcpy(token, p, length);
+  token[length] = '\0';
+  char* parsedEnd = 0;
+  value = strtod(token, &parsedEnd);
+  return parsedEnd == token + length ? tokenEnd : 0;
+}
+
+//-----------------------------------------------------------------------------
+/// Parse the number at p, return the position after the number or 0 if
+/// there is no valid number.
+inline const char* scanDouble(const char* p, const char* end, double& value)
+{
+  const char* start = p;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    {
+    negative = (*p == '-');
+    ++p;
+    }
+  quint64 mantissa = 0;
+  int numberOfDigits = 0;
+  int exponent = 0;
+  bool overflow = false;
+
+  const char* integerStart = p;
+  // Leading zeros are not significant
+  while (p < end && *p == '0')
+    {
+    ++p;
+    }
+  const char* significantStart = p;
+  p = scanDigits(p, end, mantissa, numberOfDigits, overflow);
+  // Integer digits beyond the mantissa capacity are powers of 10
+  exponent += static_cast<int>(p - significantStart) - numberOfDigits;
+  bool hasDigits = p > integerStart;
+
+  if (p < end && *p == '.')
+    {
+    ++p;
+    const char* fractionStart = p;
+    if (numberOfDigits == 0)
+      {
+      while (p < end && *p == '0')
+        {
+        ++p;
+        }
+      }
+    const int digitsBefore = numberOfDigits;
+    const char* fractionDigitsStart = p;
+    p = scanDigits(p, end, mantissa, numberOfDigits, overflow);
+    // Only the digits accumulated in the mantissa shift the exponent
+    exponent -= static_cast<int>(fractionDigitsStart - fractionStart) +
+      (numberOfDigits - digitsBefore);
+    hasDigits = hasDigits || p > fractionStart;
+    }
+  if (!hasDigits)
+    {
+    return scanDoubleSlow(start, end, value);
+    }
+
+  if (p < end && (*p == 'e' || *p == 'E'))
+    {
+    const char* q = p + 1;
+    bool negativeExponent = false;
+    if (q < end && (*q == '-' || *q == '+'))
+      {
+      negativeExponent = (*q == '-');
+      ++q;
+      }
+    if (q >= end || !isDigit(*q))
+      {
+      return scanDoubleSlow(start, end, value);
+      }
+    int explicitExponent = 0;
+    for (; q < end && isDigit(*q); ++q)
+      {
+      if (explicitExponent < 100000)
+        {
+        explicitExponent = explicitExponent * 10 + (*q - '0');
+        }
+      }
+    exponent += negativeExponent ? -explicitExponent : explicitExponent;
+    p = q;
+    }
+
+  if (mantissa == 0 && !overflow)
+    {
+    value = negative ? -0. : 0.;
+    return p;
+    }
+  if (overflow || mantissa > MaximumExactMantissa ||
+      exponent < -MaximumExactPowerOf10 || exponent > MaximumExactPowerOf10)
+    {
+    return scanDoubleSlow(start, end, value);
+    }
+  // Exact: both operands are exactly representable, the result is
+  // correctly rounded.
+  value = static_cast<double>(mantissa);
+  value = exponent < 0 ? value / ExactPowersOf10[-exponent]
+                       : value * ExactPowersOf10[exponent];
+  if (negative)
+    {
+    value = -value;
+    }
+  return p;
+}
+
+//-----------------------------------------------------------------------------
+bool scanDoubles(const char* p, const char* end, QVector<double>& values)
+{
+  values.clear();
+  while (true)
+    {
+    while (p < end && isBlank(*p))
+      {
+      ++p;
+      }
+    if (p == end)
+      {
+      return true;
+      }
+    double value = 0.;
+    p = scanDouble(p, end, value);
+    if (!p || (p < end && !isBlank(*p)))
+      {
+      return false;
+      }
+    values.append(value);
+    }
+}
+
+//-----------------------------------------------------------------------------
+inline bool startsWith(const char* begin, const char* end, const char* prefix)
+{
+  const size_t length = strlen(prefix);
+  return static_cast<size_t>(end - begin) >= length &&
+    memcmp(begin, prefix, length) == 0;
+}
+
+//-----------------------------------------------------------------------------
+/// Rotation matrix of the versor (unit quaternion) vector part, as computed
+/// by itk::Versor
+void versorToMatrix(const double* versor, double matrix[3][3])
+{
+  const double x = versor[0];
+  const double y = versor[1];
+  const double z = versor[2];
+  const double w = sqrt(std::max(0., 1. - x * x - y * y - z * z));
+  matrix[0][0] = 1. - 2. * (y * y + z * z);
+  matrix[0][1] = 2. * (x * y - z * w);
+  matrix[0][2] = 2. * (x * z + y * w);
+  matrix[1][0] = 2. * (x * y + z * w);
+  matrix[1][1] = 1. - 2. * (x * x + z * z);
+  matrix[1][2] = 2. * (y * z - x * w);
+  matrix[2][0] = 2. * (x * z - y * w);
+  matrix[2][1] = 2. * (y * z + x * w);
+  matrix[2][2] = 1. - 2. * (x * x + y * y);
+}
+
+//-----------------------------------------------------------------------------
+void multiply3x3(const double a[3][3], const double b[3][3], double c[3][3])
+{
+  double result[3][3];
+  for (int i = 0; i < 3; ++i)
+    {
+    for (int j = 0; j < 3; ++j)
+      {
+      result[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j];
+      }
+    }
+  memcpy(c, result, sizeof(result));
+}
+
+//-----------------------------------------------------------------------------
+/// Rotation of itk::Euler3DTransform: Rz.Rx.Ry, or Rz.Ry.Rx if computeZYX
+void eulerToMatrix(const double* angles, bool computeZYX, double matrix[3][3])
+{
+  const double cx = cos(angles[0]), sx = sin(angles[0]);
+  const double cy = cos(angles[1]), sy = sin(angles[1]);
+  const double cz = cos(angles[2]), sz = sin(angles[2]);
+  const double rx[3][3] = {{1., 0., 0.}, {0., cx, -sx}, {0., sx, cx}};
+  const double ry[3][3] = {{cy, 0., sy}, {0., 1., 0.}, {-sy, 0., cy}};
+  const double rz[3][3] = {{cz, -sz, 0.}, {sz, cz, 0.}, {0., 0., 1.}};
+  if (computeZYX)
+    {
+    multiply3x3(rz, ry, matrix);
+    multiply3x3(matrix, rx, matrix);
+    }
+  else
+    {
+    multiply3x3(rz, rx, matrix);
+    multiply3x3(matrix, ry, matrix);
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool hasParameters(const qSlicerLITTPlanV2TransformFileReader::Transform& transform,
+                   int count)
+{
+  return transform.Parameters.size() == count &&
+    (transform.FixedParameters.isEmpty() ||
+     transform.FixedParameters.size() >= 3);
+}
+
+//-----------------------------------------------------------------------------
+/// Matrix and offset of the ITK transform (y = M.x + offset, LPS).
+bool itkMatrixOffset(const qSlicerLITTPlanV2TransformFileReader::Transform& transform,
+                     double matrix[3][3], double offset[3])
+{
+  const QByteArray& type = transform.Type;
+  if (!type.endsWith("_3_3"))
+    {
+    return false;
+    }
+  const QByteArray name = type.left(type.indexOf('_'));
+  const double* parameters = transform.Parameters.constData();
+  double translation[3] = {0., 0., 0.};
+  for (int i = 0; i < 3; ++i)
+    {
+    for (int j = 0; j < 3; ++j)
+      {
+      matrix[i][j] = (i == j ? 1. : 0.);
+      }
+    }
+  if (name == "AffineTransform" || name == "MatrixOffsetTransformBase" ||
+      name == "Rigid3DTransform")
+    {
+    if (!hasParameters(transform, 12))
+      {
+      return false;
+      }
+    memcpy(matrix, parameters, 9 * sizeof(double));
+    memcpy(translation, parameters + 9, 3 * sizeof(double));
+    }
+  else if (name == "Euler3DTransform")
+    {
+    if (!hasParameters(transform, 6))
+      {
+      return false;
+      }
+    bool computeZYX = transform.FixedParameters.size() >= 4 &&
+      transform.FixedParameters[3] != 0.;
+    eulerToMatrix(parameters, computeZYX, matrix);
+    memcpy(translation, parameters + 3, 3 * sizeof(double));
+    }
+  else if (name == "VersorRigid3DTransform")
+    {
+    if (!hasParameters(transform, 6))
+      {
+      return false;
+      }
+    versorToMatrix(parameters, matrix);
+    memcpy(translation, parameters + 3, 3 * sizeof(double));
+    }
+  else if (name == "Similarity3DTransform")
+    {
+    if (!hasParameters(transform, 7))
+      {
+      return false;
+      }
+    versorToMatrix(parameters, matrix);
+    for (int i = 0; i < 3; ++i)
+      {
+      for (int j = 0; j < 3; ++j)
+        {
+        matrix[i][j] *= parameters[6];
+        }
+      }
+    memcpy(translation, parameters + 3, 3 * sizeof(double));
+    }
+  else if (name == "TranslationTransform")
+    {
+    if (transform.Parameters.size() != 3)
+      {
+      return false;
+      }
+    memcpy(translation, parameters, 3 * sizeof(double));
+    }
+  else if (name != "IdentityTransform")
+    {
+    return false;
+    }
+
+  // offset = translation + center - M.center
+  double center[3] = {0., 0., 0.};
+  if (transform.FixedParameters.size() >= 3 && name != "TranslationTransform")
+    {
+    memcpy(center, transform.FixedParameters.constData(), 3 * sizeof(double));
+    }
+  for (int i = 0; i < 3; ++i)
+    {
+    offset[i] = translation[i] + center[i];
+    for (int j = 0; j < 3; ++j)
+      {
+      offset[i] -= matrix[i][j] * center[j];
+      }
+    }
+  return true;
+}
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2TransformFileReader::parse(const char* begin, const char* end,
+                                                 QList<Transform>& transforms,
+                                                 QString* errorString)
+{
+  transforms.clear();
+  bool hasHeader = false;
+  int lineNumber = 0;
+  for (const char* line = begin; line < end; )
+    {
+    const char* lineEnd =
+      static_cast<const char*>(memchr(line, '\n', end - line));
+    if (!lineEnd)
+      {
+      lineEnd = end;
+      }
+    const char* next = lineEnd < end ? lineEnd + 1 : end;
+    ++lineNumber;
+    while (line < lineEnd && isBlank(*line))
+      {
+      ++line;
+      }
+    if (line == lineEnd)
+      {
+      line = next;
+      continue;
+      }
+    if (!hasHeader)
+      {
+      if (!startsWith(line, lineEnd, "#Insight Transform File"))
+        {
+        if (errorString)
+          {
+          *errorString = "Not an Insight Transform File";
+          }
+        return false;
+        }
+      hasHeader = true;
+      line = next;
+      continue;
+      }
+    if (*line == '#')
+      {
+      line = next;
+      continue;
+      }
+    const char* colon = static_cast<const char*>(memchr(line, ':', lineEnd - line));
+    bool valid = (colon != 0);
+    if (valid && startsWith(line, colon, "Transform"))
+      {
+      const char* typeBegin = colon + 1;
+      const char* typeEnd = lineEnd;
+      while (typeBegin < typeEnd && isBlank(*typeBegin))
+        {
+        ++typeBegin;
+        }
+      while (typeEnd > typeBegin && isBlank(typeEnd[-1]))
+        {
+        --typeEnd;
+        }
+      transforms.append(Transform());
+      transforms.back().Type = QByteArray(typeBegin, typeEnd - typeBegin);
+      }
+    else if (valid && startsWith(line, colon, "Parameters"))
+      {
+      valid = !transforms.isEmpty() &&
+        scanDoubles(colon + 1, lineEnd, transforms.back().Parameters);
+      }
+    else if (valid && startsWith(line, colon, "FixedParameters"))
+      {
+      valid = !transforms.isEmpty() &&
+        scanDoubles(colon + 1, lineEnd, transforms.back().FixedParameters);
+      }
+    else
+      {
+      valid = false;
+      }
+    if (!valid)
+      {
+      if (errorString)
+        {
+        *errorString = QString("Invalid line %1").arg(lineNumber);
+        }
+      return false;
+      }
+    line = next;
+    }
+  if (transforms.isEmpty())
+    {
+    if (errorString)
+      {
+      *errorString = "No transform";
+      }
+    return false;
+    }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+qSlicerLITTPlanV2TransformFileReader::File
+qSlicerLITTPlanV2TransformFileReader::readFile(const QString& fileName)
+{
+  File result;
+  result.FileName = fileName;
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly))
+    {
+    result.ErrorString = file.errorString();
+    return result;
+    }
+  const qint64 size = file.size();
+  uchar* data = size > 0 ? file.map(0, size) : 0;
+  bool parsed = false;
+  if (data)
+    {
+    const char* text = reinterpret_cast<const char*>(data);
+    parsed = parse(text, text + size, result.Transforms, &result.ErrorString);
+    file.unmap(data);
+    }
+  else
+    {
+    // Files that can't be mapped (e.g. pipes) are read at once
+    const QByteArray text = file.readAll();
+    parsed = parse(text.constData(), text.constData() + text.size(),
+                   result.Transforms, &result.ErrorString);
+    }
+  if (!parsed)
+    {
+    result.ErrorString = fileName + ": " + result.ErrorString;
+    }
+  return result;
+}
+
+//-----------------------------------------------------------------------------
+QList<qSlicerLITTPlanV2TransformFileReader::File>
+qSlicerLITTPlanV2TransformFileReader::readFiles(const QStringList& fileNames)
+{
+  return QtConcurrent::blockingMapped<QList<File> >(
+    fileNames, &qSlicerLITTPlanV2TransformFileReader::readFile);
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2TransformFileReader::isLinear(const Transform& transform)
+{
+  double matrix[3][3];
+  double offset[3];
+  return itkMatrixOffset(transform, matrix, offset);
+}
+
+//-----------------------------------------------------------------------------
+bool qSlicerLITTPlanV2TransformFileReader::matrixTransformToParent(
+  const Transform& transform, vtkMatrix4x4* matrix)
+{
+  double itkMatrix[3][3];
+  double itkOffset[3];
+  if (!matrix || !itkMatrixOffset(transform, itkMatrix, itkOffset))
+    {
+    return false;
+    }
+  // LPS to RAS: lps2ras.M.ras2lps, with lps2ras = ras2lps = diag(-1,-1,1)
+  const double flip[3] = {-1., -1., 1.};
+  matrix->Identity();
+  for (int i = 0; i < 3; ++i)
+    {
+    for (int j = 0; j < 3; ++j)
+      {
+      matrix->SetElement(i, j, flip[i] * itkMatrix[i][j] * flip[j]);
+      }
+    matrix->SetElement(i, 3, flip[i] * itkOffset[i]);
+    }
+  // ITK resampling transform (from parent) to Slicer modeling transform
+  matrix->Invert();
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerLITTPlanV2TransformFileReader::addTransformNode(
+  const File& file, vtkMRMLScene* scene)
+{
+  vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (!scene || !file.ErrorString.isEmpty() || file.Transforms.count() != 1 ||
+      !matrixTransformToParent(file.Transforms[0], matrix))
+    {
+    return QString();
+    }
+  vtkSmartPointer<vtkMRMLLinearTransformNode> node =
+    vtkSmartPointer<vtkMRMLLinearTransformNode>::New();
+  const QByteArray baseName =
+    QFileInfo(file.FileName).completeBaseName().toLatin1();
+  node->SetName(scene->GetUniqueNameByString(baseName));
+  node->GetMatrixTransformToParent()->DeepCopy(matrix);
+  // The file can be saved back, as with vtkSlicerTransformLogic
+  vtkSmartPointer<vtkMRMLTransformStorageNode> storageNode =
+    vtkSmartPointer<vtkMRMLTransformStorageNode>::New();
+  storageNode->SetFileName(file.FileName.toLatin1());
+  scene->AddNode(storageNode);
+  node->SetAndObserveStorageNodeID(storageNode->GetID());
+  scene->AddNode(node);
+  return QString(node->GetID());
+}
+
+//-----------------------------------------------------------------------------
+QStringList qSlicerLITTPlanV2TransformFileReader::importFiles(
+  const QStringList& fileNames, vtkMRMLScene* scene, QStringList* errors)
+{
+  QStringList nodeIDs;
+  if (!scene)
+    {
+    return nodeIDs;
+    }
+  // Parsing is done in parallel, the scene is only modified in this thread
+  QList<File> files = readFiles(fileNames);
+  vtkSmartPointer<vtkSlicerTransformLogic> transformLogic;
+  scene->StartState(vtkMRMLScene::BatchProcessState);
+  foreach(const File& file, files)
+    {
+    QString nodeID = addTransformNode(file, scene);
+    if (nodeID.isEmpty() && file.ErrorString.isEmpty() &&
+        !file.Transforms.isEmpty())
+      {
+      // Composite and non linear transforms are read by the logic
+      if (!transformLogic)
+        {
+        transformLogic = vtkSmartPointer<vtkSlicerTransformLogic>::New();
+        }
+      vtkMRMLTransformNode* node =
+        transformLogic->AddTransform(file.FileName.toLatin1(), scene);
+      nodeID = node ? node->GetID() : "";
+      }
+    if (nodeID.isEmpty())
+      {
+      if (errors)
+        {
+        *errors << (!file.ErrorString.isEmpty() ? file.ErrorString :
+          file.Transforms.isEmpty() ?
+          file.FileName + ": No transform" :
+          file.FileName + ": unsupported transform");
+        }
+      continue;
+      }
+    nodeIDs << nodeID;
+    }
+  scene->EndState(vtkMRMLScene::BatchProcessState);
+  return nodeIDs;
+}
+
+//-----------------------------------------------------------------------------
+QStringList qSlicerLITTPlanV2TransformFileReader::importDirectory(
+  const QString& directory, vtkMRMLScene* scene, QStringList* errors)
+{
+  QStringList fileNames;
+  QDirIterator it(directory, QStringList() << "*.tfm" << "*.txt",
+                  QDir::Files, QDirIterator::Subdirectories);
+  while (it.hasNext())
+    {
+    fileNames << it.next();
+    }
+  fileNames.sort();
+  return importFiles(fileNames, scene, errors);
+}
@@ -0,0 +1,113 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __qSlicerLITTPlanV2TransformFileReader_h
+#define __qSlicerLITTPlanV2TransformFileReader_h
+
+// Qt includes
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModuleExport.h"
+
+class vtkMatrix4x4;
+class vtkMRMLScene;
+
+/// \ingroup Slicer_QtModules_LITTPlanV2
+/// Fast reader of ITK transform text files (Insight Transform File V1.0,
+/// *.tfm, *.txt).
+///
+/// The file is mapped in memory and parsed in place: the numbers are
+/// scanned directly from the mapping (8 digits at a time when possible),
+/// without stream nor allocation per token. Files holding several
+/// transforms are parsed, but only the files holding a single linear
+/// transform are added to the scene by the reader: composite and non linear
+/// transforms are added by vtkSlicerTransformLogic::AddTransform().
+/// The linear transforms (affine, rigid, Euler, versor, similarity,
+/// translation, identity) are converted into RAS matrices following the
+/// conventions of vtkSlicerTransformLogic::AddTransform().
+///
+/// importFiles() and importDirectory() parse the files in parallel and
+/// create the transform nodes in the calling thread.
+class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT qSlicerLITTPlanV2TransformFileReader
+{
+public:
+  struct Transform
+  {
+    /// e.g. "AffineTransform_double_3_3"
+    QByteArray Type;
+    QVector<double> Parameters;
+    QVector<double> FixedParameters;
+  };
+
+  struct File
+  {
+    QString FileName;
+    QList<Transform> Transforms;
+    /// Empty if the file was parsed successfully
+    QString ErrorString;
+  };
+
+  /// Parse the text of a transform file. Returns false and sets the error
+  /// string if the text is not a valid transform file.
+  static bool parse(const char* begin, const char* end,
+                    QList<Transform>& transforms, QString* errorString = 0);
+
+  /// Map the file in memory and parse it
+  static File readFile(const QString& fileName);
+
+  /// Read the files in parallel, in as many threads as cores.
+  static QList<File> readFiles(const QStringList& fileNames);
+
+  /// Return true if the transform is linear and supported.
+  static bool isLinear(const Transform& transform);
+
+  /// Set the matrix to the transform to parent of the node that
+  /// vtkSlicerTransformLogic::AddTransform() would create: the ITK
+  /// (resampling, LPS) transform converted into a RAS modeling transform.
+  /// Returns false if the transform is not linear.
+  static bool matrixTransformToParent(const Transform& transform,
+                                      vtkMatrix4x4* matrix);
+
+  /// Add the linear transform node of a file holding a single linear
+  /// transform, as vtkSlicerTransformLogic::AddTransform() does: the node
+  /// is named after the file (made unique in the scene) and gets a storage
+  /// node. Returns the ID of the node added, an empty string if the file
+  /// doesn't hold a single linear transform.
+  static QString addTransformNode(const File& file, vtkMRMLScene* scene);
+
+  /// Read the files in parallel and add their transforms to the scene.
+  /// The files holding several or non linear transforms are added with
+  /// vtkSlicerTransformLogic::AddTransform(). The files that can't be read,
+  /// hold no transform or are rejected by the logic are skipped and
+  /// reported in errors.
+  static QStringList importFiles(const QStringList& fileNames,
+                                 vtkMRMLScene* scene,
+                                 QStringList* errors = 0);
+
+  /// Import the *.tfm and *.txt files of the directory and its
+  /// subdirectories.
+  static QStringList importDirectory(const QString& directory,
+                                     vtkMRMLScene* scene,
+                                     QStringList* errors = 0);
+};
+
+#endif
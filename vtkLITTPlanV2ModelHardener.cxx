@@ -0,0 +1,572 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// LITTPlanV2 includes
+#include "vtkLITTPlanV2ModelHardener.h"
+
+// MRML includes
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLTransformNode.h>
+
+// VTK includes
+#include <vtkCellData.h>
+#include <vtkDataArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkLITTPlanV2ModelHardener);
+
+namespace
+{
+//----------------------------------------------------------------------------
+struct TransformArrayThreadData
+{
+  double Matrix[3][4];
+  bool Normals;
+  vtkDataArray* Input;
+  vtkDataArray* Array;
+  vtkIdType ChunkSize;
+};
+
+//----------------------------------------------------------------------------
+template <class TIn, class T>
+void transformTuples(const TransformArrayThreadData* data,
+                     const TIn* input, T* tuples, vtkIdType count)
+{
+  const double (*m)[4] = data->Matrix;
+  for (vtkIdType i = 0; i < count; ++i, input += 3, tuples += 3)
+    {
+    const double x = input[0];
+    const double y = input[1];
+    const double z = input[2];
+    double out[3];
+    for (int r = 0; r < 3; ++r)
+      {
+      out[r] = m[r][0] * x + m[r][1] * y + m[r][2] * z + m[r][3];
+      }
+    if (data->Normals)
+      {
+      double norm = sqrt(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+      if (norm > 0.)
+        {
+        out[0] /= norm;
+        out[1] /= norm;
+        out[2] /= norm;
+        }
+      }
+    tuples[0] = static_cast<T>(out[0]);
+    tuples[1] = static_cast<T>(out[1]);
+    tuples[2] = static_cast<T>(out[2]);
+    }
+}
+
+//----------------------------------------------------------------------------
+template <class T>
+void transformTuples(const TransformArrayThreadData* data,
+                     const void* input, T* tuples, vtkIdType count)
+{
+  if (data->Input->GetDataType() == VTK_FLOAT)
+    {
+    transformTuples(data, static_cast<const float*>(input), tuples, count);
+    }
+  else
+    {
+    transformTuples(data, static_cast<const double*>(input), tuples, count);
+    }
+}
+
+//----------------------------------------------------------------------------
+/// Points, point normals and cell normals of the polydata, 0 if missing
+void getGeometryArrays(vtkPolyData* polyData, vtkDataArray* arrays[3])
+{
+  arrays[0] = polyData && polyData->GetPoints() ?
+    polyData->GetPoints()->GetData() : 0;
+  arrays[1] = polyData ? polyData->GetPointData()->GetNormals() : 0;
+  arrays[2] = polyData ? polyData->GetCellData()->GetNormals() : 0;
+}
+
+//----------------------------------------------------------------------------
+bool isUnder(vtkMRMLTransformNode* node, vtkMRMLTransformNode* ancestor)
+{
+  for (; node; node = node->GetParentTransformNode())
+    {
+    if (node == ancestor)
+      {
+      return true;
+      }
+    }
+  return false;
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLTransformNode* hardenedTransformNode(vtkMRMLModelNode* model)
+{
+  const char* transformNodeID = model->GetAttribute(
+    vtkLITTPlanV2ModelHardener::GetHardenedTransformAttributeName());
+  if (!transformNodeID || !model->GetScene())
+    {
+    return 0;
+    }
+  return vtkMRMLTransformNode::SafeDownCast(
+    model->GetScene()->GetNodeByID(transformNodeID));
+}
+
+//----------------------------------------------------------------------------
+bool isIdentity(vtkMatrix4x4* matrix)
+{
+  for (int i = 0; i < 4; ++i)
+    {
+    for (int j = 0; j < 4; ++j)
+      {
+      if (matrix->GetElement(i, j) != (i == j ? 1. : 0.))
+        {
+        return false;
+        }
+      }
+    }
+  return true;
+}
+}
+
+//----------------------------------------------------------------------------
+vtkLITTPlanV2ModelHardener::vtkLITTPlanV2ModelHardener()
+{
+  this->NumberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->ChunkSize = 65536;
+}
+
+//----------------------------------------------------------------------------
+vtkLITTPlanV2ModelHardener::~vtkLITTPlanV2ModelHardener()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2ModelHardener::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "ChunkSize: " << this->ChunkSize << "\n";
+}
+
+//----------------------------------------------------------------------------
+const char* vtkLITTPlanV2ModelHardener::GetHardenedTransformAttributeName()
+{
+  return "LITTPlanV2.HardenedTransformNodeID";
+}
+
+//----------------------------------------------------------------------------
+const char* vtkLITTPlanV2ModelHardener::GetHardenedMatrixAttributeName()
+{
+  return "LITTPlanV2.HardenedMatrix";
+}
+
+//----------------------------------------------------------------------------
+bool vtkLITTPlanV2ModelHardener::GetHardenedMatrix(vtkMRMLModelNode* model,
+                                                  vtkMatrix4x4* matrix)
+{
+  matrix->Identity();
+  const char* attribute = model ?
+    model->GetAttribute(GetHardenedMatrixAttributeName()) : 0;
+  if (!attribute)
+    {
+    return false;
+    }
+  std::istringstream stream(attribute);
+  double elements[16];
+  for (int i = 0; i < 16; ++i)
+    {
+    if (!(stream >> elements[i]))
+      {
+      return false;
+      }
+    }
+  matrix->DeepCopy(elements);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int vtkLITTPlanV2ModelHardener::CanHarden(vtkMRMLModelNode* model,
+                                          vtkMRMLTransformNode* transform)
+{
+  if (!model || !model->GetPolyData() || !model->GetPolyData()->GetPoints())
+    {
+    return NoPolyData;
+    }
+  // The model may be under a child of the transform: bake the whole chain
+  vtkMRMLTransformNode* parentTransform = model->GetParentTransformNode();
+  if (!transform || !isUnder(parentTransform, transform) ||
+      !parentTransform->GetID())
+    {
+    return NotUnderTransform;
+    }
+  if (!parentTransform->IsTransformToWorldLinear())
+    {
+    return NonLinearTransform;
+    }
+  return CanBeHardened;
+}
+
+//----------------------------------------------------------------------------
+bool vtkLITTPlanV2ModelHardener::Harden(vtkMRMLModelNode* model,
+                                        vtkMRMLTransformNode* transform)
+{
+  switch (CanHarden(model, transform))
+    {
+    case CanBeHardened:
+      break;
+    case NotUnderTransform:
+      vtkWarningMacro("Harden: " << (model->GetID() ? model->GetID() : "model")
+                      << " is not under " << (transform && transform->GetID() ?
+                      transform->GetID() : "the transform"));
+      return false;
+    case NonLinearTransform:
+      vtkWarningMacro("Harden: the transform to world of "
+                      << (model->GetID() ? model->GetID() : "model")
+                      << " is not linear");
+      return false;
+    default:
+      return false;
+    }
+  vtkMRMLTransformNode* parentTransform = model->GetParentTransformNode();
+  vtkSmartPointer<vtkMatrix4x4> toWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+  parentTransform->GetMatrixTransformToWorld(toWorld);
+  // Anchor the geometry before it is baked: nothing is baked into it yet
+  this->PruneAnchors();
+  vtkSmartPointer<vtkMatrix4x4> identity = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->SetAnchor(model, identity);
+  if (!isIdentity(toWorld))
+    {
+    this->TransformPolyData(toWorld, model->GetPolyData());
+    }
+  this->Anchors[model].PointsTime =
+    model->GetPolyData()->GetPoints()->GetMTime();
+  int wasModifying = model->StartModify();
+  this->RecordHardenedMatrix(model, toWorld, parentTransform->GetID());
+  model->SetAndObserveTransformNodeID(0);
+  model->EndModify(wasModifying);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int vtkLITTPlanV2ModelHardener::UpdateHardenedModels(
+  vtkMRMLScene* scene, vtkMRMLTransformNode* transform)
+{
+  if (!scene || !transform)
+    {
+    return 0;
+    }
+  this->PruneAnchors();
+  int updated = 0;
+  int numberOfModels = scene->GetNumberOfNodesByClass("vtkMRMLModelNode");
+  for (int i = 0; i < numberOfModels; ++i)
+    {
+    vtkMRMLModelNode* model = vtkMRMLModelNode::SafeDownCast(
+      scene->GetNthNodeByClass(i, "vtkMRMLModelNode"));
+    if (this->UpdateHardenedModel(model, transform))
+      {
+      ++updated;
+      }
+    }
+  return updated;
+}
+
+//----------------------------------------------------------------------------
+bool vtkLITTPlanV2ModelHardener::UpdateHardenedModel(
+  vtkMRMLModelNode* model, vtkMRMLTransformNode* transform)
+{
+  vtkSmartPointer<vtkMatrix4x4> delta = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (!GetHardenedDelta(model, transform, delta) || isIdentity(delta))
+    {
+    return false;
+    }
+  vtkMRMLTransformNode* hardenedTransform = hardenedTransformNode(model);
+  vtkSmartPointer<vtkMatrix4x4> toWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+  hardenedTransform->GetMatrixTransformToWorld(toWorld);
+
+  // Transform the anchor rather than the rounded current geometry:
+  // matrix = toWorld * anchor^-1
+  Anchor* anchor = this->GetAnchor(model);
+  if (!anchor)
+    {
+    vtkSmartPointer<vtkMatrix4x4> hardened =
+      vtkSmartPointer<vtkMatrix4x4>::New();
+    GetHardenedMatrix(model, hardened);
+    this->SetAnchor(model, hardened);
+    anchor = &this->Anchors[model];
+    }
+  vtkSmartPointer<vtkMatrix4x4> fromAnchor =
+    vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Invert(anchor->Matrix, fromAnchor);
+  vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Multiply4x4(toWorld, fromAnchor, matrix);
+  vtkPolyData* polyData = model->GetPolyData();
+  vtkDataArray* arrays[3];
+  getGeometryArrays(polyData, arrays);
+  for (int i = 0; i < 3; ++i)
+    {
+    if (arrays[i])
+      {
+      this->TransformArray(matrix, arrays[i], i > 0, anchor->Arrays[i]);
+      arrays[i]->Modified();
+      }
+    }
+  polyData->GetPoints()->Modified();
+  polyData->Modified();
+  anchor->PointsTime = polyData->GetPoints()->GetMTime();
+  this->RecordHardenedMatrix(model, toWorld, hardenedTransform->GetID());
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2ModelHardener::SetAnchor(vtkMRMLModelNode* model,
+                                           vtkMatrix4x4* matrix)
+{
+  Anchor& anchor = this->Anchors[model];
+  anchor.Model = model;
+  anchor.PolyData = model->GetPolyData();
+  anchor.Matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  anchor.Matrix->DeepCopy(matrix);
+  vtkDataArray* arrays[3];
+  getGeometryArrays(model->GetPolyData(), arrays);
+  for (int i = 0; i < 3; ++i)
+    {
+    anchor.Arrays[i] = 0;
+    if (arrays[i])
+      {
+      anchor.Arrays[i] = vtkSmartPointer<vtkDoubleArray>::New();
+      anchor.Arrays[i]->DeepCopy(arrays[i]);
+      }
+    }
+  anchor.PointsTime = model->GetPolyData()->GetPoints()->GetMTime();
+}
+
+//----------------------------------------------------------------------------
+vtkLITTPlanV2ModelHardener::Anchor* vtkLITTPlanV2ModelHardener::GetAnchor(
+  vtkMRMLModelNode* model)
+{
+  std::map<vtkMRMLModelNode*, Anchor>::iterator it = this->Anchors.find(model);
+  if (it == this->Anchors.end())
+    {
+    return 0;
+    }
+  Anchor& anchor = it->second;
+  // The geometry may have been replaced or edited by others since
+  vtkPolyData* polyData = model->GetPolyData();
+  if (anchor.Model != model || anchor.PolyData != polyData ||
+      polyData->GetPoints()->GetMTime() != anchor.PointsTime)
+    {
+    return 0;
+    }
+  vtkDataArray* arrays[3];
+  getGeometryArrays(polyData, arrays);
+  for (int i = 0; i < 3; ++i)
+    {
+    if ((arrays[i] != 0) != (anchor.Arrays[i] != 0) ||
+        (arrays[i] && (arrays[i]->GetNumberOfComponents() != 3 ||
+         arrays[i]->GetNumberOfTuples() != anchor.Arrays[i]->GetNumberOfTuples())))
+      {
+      return 0;
+      }
+    }
+  return &anchor;
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2ModelHardener::PruneAnchors()
+{
+  std::map<vtkMRMLModelNode*, Anchor>::iterator it = this->Anchors.begin();
+  while (it != this->Anchors.end())
+    {
+    if (!it->second.Model || !it->second.PolyData)
+      {
+      this->Anchors.erase(it++);
+      }
+    else
+      {
+      ++it;
+      }
+    }
+}
+
+//----------------------------------------------------------------------------
+int vtkLITTPlanV2ModelHardener::GetNumberOfAnchors()
+{
+  this->PruneAnchors();
+  return static_cast<int>(this->Anchors.size());
+}
+
+//----------------------------------------------------------------------------
+bool vtkLITTPlanV2ModelHardener::GetHardenedDelta(
+  vtkMRMLModelNode* model, vtkMRMLTransformNode* transform, vtkMatrix4x4* delta)
+{
+  delta->Identity();
+  vtkSmartPointer<vtkMatrix4x4> hardened = vtkSmartPointer<vtkMatrix4x4>::New();
+  // Models observing a transform again are transformed at render time
+  if (!model || !transform || model->GetParentTransformNode() ||
+      !model->GetPolyData() || !model->GetPolyData()->GetPoints() ||
+      !GetHardenedMatrix(model, hardened))
+    {
+    return false;
+    }
+  // Editing a transform moves its descendants too
+  vtkMRMLTransformNode* hardenedTransform = hardenedTransformNode(model);
+  if (!isUnder(hardenedTransform, transform) ||
+      !hardenedTransform->IsTransformToWorldLinear())
+    {
+    return false;
+    }
+  vtkSmartPointer<vtkMatrix4x4> toWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+  hardenedTransform->GetMatrixTransformToWorld(toWorld);
+  // delta = toWorld * hardened^-1
+  hardened->Invert();
+  vtkMatrix4x4::Multiply4x4(toWorld, hardened, delta);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2ModelHardener::RecordHardenedMatrix(vtkMRMLModelNode* model,
+  vtkMatrix4x4* toWorld, const char* transformNodeID)
+{
+  std::ostringstream matrix;
+  matrix.precision(17);
+  for (int i = 0; i < 4; ++i)
+    {
+    for (int j = 0; j < 4; ++j)
+      {
+      matrix << (i || j ? " " : "") << toWorld->GetElement(i, j);
+      }
+    }
+  int wasModifying = model->StartModify();
+  model->SetAttribute(GetHardenedMatrixAttributeName(), matrix.str().c_str());
+  model->SetAttribute(GetHardenedTransformAttributeName(), transformNodeID);
+  model->EndModify(wasModifying);
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2ModelHardener::TransformPolyData(vtkMatrix4x4* matrix,
+                                                   vtkPolyData* polyData)
+{
+  if (!matrix || !polyData || !polyData->GetPoints())
+    {
+    return;
+    }
+  this->TransformArray(matrix, polyData->GetPoints()->GetData(), false);
+  polyData->GetPoints()->Modified();
+  vtkDataArray* normals[2] = {polyData->GetPointData()->GetNormals(),
+                              polyData->GetCellData()->GetNormals()};
+  for (int i = 0; i < 2; ++i)
+    {
+    if (normals[i])
+      {
+      this->TransformArray(matrix, normals[i], true);
+      normals[i]->Modified();
+      }
+    }
+  polyData->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2ModelHardener::TransformArray(vtkMatrix4x4* matrix,
+                                                vtkDataArray* array,
+                                                bool normals,
+                                                vtkDataArray* input)
+{
+  input = input ? input : array;
+  if (array->GetNumberOfComponents() != 3 ||
+      (array->GetDataType() != VTK_FLOAT && array->GetDataType() != VTK_DOUBLE) ||
+      input->GetNumberOfComponents() != 3 ||
+      (input->GetDataType() != VTK_FLOAT && input->GetDataType() != VTK_DOUBLE) ||
+      input->GetNumberOfTuples() != array->GetNumberOfTuples())
+    {
+    vtkWarningMacro("TransformArray: unsupported array " << array->GetName());
+    return;
+    }
+  TransformArrayThreadData data;
+  vtkSmartPointer<vtkMatrix4x4> linear = vtkSmartPointer<vtkMatrix4x4>::New();
+  linear->DeepCopy(matrix);
+  if (normals)
+    {
+    // Normals are transformed by the inverse transpose, without translation
+    linear->Invert();
+    linear->Transpose();
+    }
+  for (int i = 0; i < 3; ++i)
+    {
+    for (int j = 0; j < 4; ++j)
+      {
+      data.Matrix[i][j] = (normals && j == 3) ? 0. : linear->GetElement(i, j);
+      }
+    }
+  data.Normals = normals;
+  data.Input = input;
+  data.Array = array;
+  data.ChunkSize = this->ChunkSize;
+
+  vtkIdType numberOfChunks =
+    (array->GetNumberOfTuples() + this->ChunkSize - 1) / this->ChunkSize;
+  if (numberOfChunks == 0)
+    {
+    return;
+    }
+  vtkSmartPointer<vtkMultiThreader> threader =
+    vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(static_cast<int>(
+    std::min(static_cast<vtkIdType>(this->NumberOfThreads), numberOfChunks)));
+  threader->SetSingleMethod(
+    vtkLITTPlanV2ModelHardener::TransformArrayThread, &data);
+  threader->SingleMethodExecute();
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkLITTPlanV2ModelHardener::TransformArrayThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* info =
+    static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  const TransformArrayThreadData* data =
+    static_cast<TransformArrayThreadData*>(info->UserData);
+  const vtkIdType numberOfTuples = data->Array->GetNumberOfTuples();
+  // Chunks are interleaved between the threads
+  for (vtkIdType start = info->ThreadID * data->ChunkSize;
+       start < numberOfTuples;
+       start += info->NumberOfThreads * data->ChunkSize)
+    {
+    vtkIdType count = std::min(data->ChunkSize, numberOfTuples - start);
+    const void* input = data->Input->GetVoidPointer(3 * start);
+    void* tuples = data->Array->GetVoidPointer(3 * start);
+    if (data->Array->GetDataType() == VTK_FLOAT)
+      {
+      transformTuples(data, input, static_cast<float*>(tuples), count);
+      }
+    else
+      {
+      transformTuples(data, input, static_cast<double*>(tuples), count);
+      }
+    }
+  return VTK_THREAD_RETURN_VALUE;
+}
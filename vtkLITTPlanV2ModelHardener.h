@@ -0,0 +1,171 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkLITTPlanV2ModelHardener_h
+#define __vtkLITTPlanV2ModelHardener_h
+
+// VTK includes
+#include <vtkMultiThreader.h>
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+#include <vtkWeakPointer.h>
+
+// STD includes
+#include <map>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModuleExport.h"
+
+class vtkDataArray;
+class vtkMatrix4x4;
+class vtkMRMLModelNode;
+class vtkMRMLScene;
+class vtkMRMLTransformNode;
+class vtkPolyData;
+
+/// \ingroup Slicer_QtModules_LITTPlanV2
+/// Bake (harden) linear transforms into the geometry of model nodes.
+///
+/// Hardening transforms the points and normals of the polydata in parallel,
+/// by chunks of ChunkSize tuples, and detaches the model from its transform:
+/// the transform is no longer applied at each render.
+/// The matrix baked into the geometry is recorded in the model node
+/// attributes (saved with the scene), with the ID of the transform node.
+/// When the transform is later edited, UpdateHardenedModels() only applies
+/// the delta between the new matrix and the recorded one: the original
+/// mesh is not reloaded.
+///
+/// To keep the rounding errors of successive edits from accumulating, the
+/// hardener keeps, in memory only, a double precision copy (anchor) of the
+/// points and normals of each model it hardens or updates, with the matrix
+/// baked into it. Updates transform the anchor instead of the current,
+/// rounded, geometry. The anchor of a model hardened in a previous session
+/// is its geometry at the first update. Anchors are dropped when their
+/// model is deleted, or replaced when its geometry is modified by others.
+class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT vtkLITTPlanV2ModelHardener
+  : public vtkObject
+{
+public:
+  static vtkLITTPlanV2ModelHardener* New();
+  vtkTypeMacro(vtkLITTPlanV2ModelHardener, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Number of threads transforming the arrays. Default is the number of
+  /// cores.
+  vtkSetClampMacro(NumberOfThreads, int, 1, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+
+  /// Number of tuples transformed at once by a thread. Default is 65536.
+  vtkSetClampMacro(ChunkSize, vtkIdType, 1, VTK_LARGE_ID);
+  vtkGetMacro(ChunkSize, vtkIdType);
+
+  /// Model attributes recording the hardened transform node ID and the
+  /// 16 elements (row major) of its matrix to world when it was last baked
+  /// into the geometry.
+  static const char* GetHardenedTransformAttributeName();
+  static const char* GetHardenedMatrixAttributeName();
+
+  /// Bake the (linear) transform to world of the parent transform of the
+  /// model into the model, and detach the model from its parent transform.
+  /// The model must be under the transform node, directly or through child
+  /// transforms: the child transforms are baked too.
+  /// Returns false if the model has no polydata, is not under the transform
+  /// or the transform to world is not linear (see CanHarden()).
+  bool Harden(vtkMRMLModelNode* model, vtkMRMLTransformNode* transform);
+  /// Reasons for Harden() to refuse a model
+  enum HardenStatus
+    {
+    CanBeHardened = 0,
+    NoPolyData,
+    NotUnderTransform,
+    NonLinearTransform
+    };
+  static int CanHarden(vtkMRMLModelNode* model, vtkMRMLTransformNode* transform);
+
+  /// Apply to the models hardened with the transform node or one of its
+  /// descendants, and not observing a transform since, the delta between
+  /// the current matrix to world of the transform they were hardened with
+  /// and the recorded one. Returns the number of models updated.
+  int UpdateHardenedModels(vtkMRMLScene* scene, vtkMRMLTransformNode* transform);
+  /// Same as UpdateHardenedModels() for a single model.
+  /// Returns true if the model is updated.
+  bool UpdateHardenedModel(vtkMRMLModelNode* model,
+                           vtkMRMLTransformNode* transform);
+
+  /// Delta between the current matrix to world of the transform the model
+  /// has been hardened with and the recorded one, without applying it.
+  /// Returns false if the model is not hardened with the transform node or
+  /// one of its descendants, or observes a transform since.
+  static bool GetHardenedDelta(vtkMRMLModelNode* model,
+                               vtkMRMLTransformNode* transform,
+                               vtkMatrix4x4* delta);
+
+  /// Matrix recorded in the model attributes, identity if the model has
+  /// never been hardened. Returns true if the model has been hardened.
+  static bool GetHardenedMatrix(vtkMRMLModelNode* model, vtkMatrix4x4* matrix);
+
+  /// Transform the points, and the point and cell normals, of the polydata.
+  void TransformPolyData(vtkMatrix4x4* matrix, vtkPolyData* polyData);
+
+  /// Number of models whose anchor is kept
+  int GetNumberOfAnchors();
+
+protected:
+  vtkLITTPlanV2ModelHardener();
+  ~vtkLITTPlanV2ModelHardener();
+
+  /// Transform the 3 components tuples of the input array into the output
+  /// array (the input by default) in parallel. Normals are transformed by
+  /// the inverse transpose and normalized.
+  void TransformArray(vtkMatrix4x4* matrix, vtkDataArray* array, bool normals,
+                      vtkDataArray* input = 0);
+  void RecordHardenedMatrix(vtkMRMLModelNode* model, vtkMatrix4x4* toWorld,
+                            const char* transformNodeID);
+
+  /// Double precision copy of the geometry of a model and the matrix to
+  /// world baked into it.
+  struct Anchor
+  {
+    vtkWeakPointer<vtkMRMLModelNode> Model;
+    vtkWeakPointer<vtkPolyData> PolyData;
+    vtkSmartPointer<vtkMatrix4x4> Matrix;
+    /// Points, point normals and cell normals, 0 if the model has none
+    vtkSmartPointer<vtkDataArray> Arrays[3];
+    /// Modification time of the points when last written by the hardener
+    unsigned long PointsTime;
+  };
+  /// Take the anchor of the model from its current geometry, which has the
+  /// matrix baked in.
+  void SetAnchor(vtkMRMLModelNode* model, vtkMatrix4x4* matrix);
+  /// Return the anchor of the model if it matches its current geometry,
+  /// 0 otherwise.
+  Anchor* GetAnchor(vtkMRMLModelNode* model);
+  /// Drop the anchors of the deleted models
+  void PruneAnchors();
+
+  static VTK_THREAD_RETURN_TYPE TransformArrayThread(void* arg);
+
+  int NumberOfThreads;
+  vtkIdType ChunkSize;
+  std::map<vtkMRMLModelNode*, Anchor> Anchors;
+
+private:
+  vtkLITTPlanV2ModelHardener(const vtkLITTPlanV2ModelHardener&); // Not implemented
+  void operator=(const vtkLITTPlanV2ModelHardener&); // Not implemented
+};
+
+#endif
@@ -0,0 +1,404 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// LITTPlanV2 includes
+#include "vtkLITTPlanV2ThermalDoseAccumulator.h"
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkTimerLog.h>
+#include <vtkUnsignedCharArray.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkLITTPlanV2ThermalDoseAccumulator);
+
+namespace
+{
+/// Gas constant in J/(mol.K)
+const double GasConstant = 8.314;
+const double CelsiusToKelvin = 273.15;
+
+//----------------------------------------------------------------------------
+struct ResampleThreadData
+{
+  const void* Frame;
+  int FrameScalarType;
+  int FrameDimensions[3];
+  int FrameNumberOfComponents;
+  double Matrix[3][4];
+  int Dimensions[3];
+  double BaseTemperature;
+  double BackgroundTemperature;
+  float* Temperature;
+};
+
+//----------------------------------------------------------------------------
+struct AccumulateThreadData
+{
+  int Dimensions[3];
+  double LogFrequencyFactor;
+  double ActivationTemperature;
+  double DamageThreshold;
+  /// 0 for the first frame: only its rate is recorded
+  double TimeStep;
+  const float* Temperature;
+  double* PreviousRate;
+  double* Damage;
+  unsigned char* LabelMap;
+};
+
+//----------------------------------------------------------------------------
+/// Slab [kStart, kEnd[ of the damage grid handled by the thread
+void threadSlab(vtkMultiThreader::ThreadInfo* info, const int dimensions[3],
+                int& kStart, int& kEnd)
+{
+  kStart = dimensions[2] * info->ThreadID / info->NumberOfThreads;
+  kEnd = dimensions[2] * (info->ThreadID + 1) / info->NumberOfThreads;
+}
+
+//----------------------------------------------------------------------------
+/// Continuous index clamped into the frame, false if farther than half a
+/// voxel from the frame.
+inline bool frameIndex(double x, int dimension, int& i0, int& i1, double& t)
+{
+  if (x < -0.5 || x > dimension - 0.5)
+    {
+    return false;
+    }
+  x = std::min(std::max(x, 0.), dimension - 1.);
+  i0 = std::min(static_cast<int>(x), dimension - 1);
+  i1 = std::min(i0 + 1, dimension - 1);
+  t = x - i0;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+template <class T>
+void resampleSlab(const ResampleThreadData* data, const T* frame,
+                  int kStart, int kEnd)
+{
+  const int* dims = data->Dimensions;
+  const int* frameDims = data->FrameDimensions;
+  const vtkIdType frameRow = static_cast<vtkIdType>(frameDims[0]) *
+    data->FrameNumberOfComponents;
+  const vtkIdType frameSlice = frameRow * frameDims[1];
+  const int components = data->FrameNumberOfComponents;
+  const double (*m)[4] = data->Matrix;
+  float* temperature = data->Temperature +
+    static_cast<vtkIdType>(kStart) * dims[0] * dims[1];
+  for (int k = kStart; k < kEnd; ++k)
+    {
+    for (int j = 0; j < dims[1]; ++j)
+      {
+      for (int i = 0; i < dims[0]; ++i, ++temperature)
+        {
+        double x[3];
+        int i0[3];
+        int i1[3];
+        double t[3];
+        bool inside = true;
+        for (int c = 0; c < 3 && inside; ++c)
+          {
+          x[c] = m[c][0] * i + m[c][1] * j + m[c][2] * k + m[c][3];
+          inside = frameIndex(x[c], frameDims[c], i0[c], i1[c], t[c]);
+          }
+        if (!inside)
+          {
+          *temperature = static_cast<float>(data->BackgroundTemperature);
+          continue;
+          }
+        const T* v000 = frame + i0[2] * frameSlice + i0[1] * frameRow + i0[0] * components;
+        const T* v100 = frame + i0[2] * frameSlice + i0[1] * frameRow + i1[0] * components;
+        const T* v010 = frame + i0[2] * frameSlice + i1[1] * frameRow + i0[0] * components;
+        const T* v110 = frame + i0[2] * frameSlice + i1[1] * frameRow + i1[0] * components;
+        const T* v001 = frame + i1[2] * frameSlice + i0[1] * frameRow + i0[0] * components;
+        const T* v101 = frame + i1[2] * frameSlice + i0[1] * frameRow + i1[0] * components;
+        const T* v011 = frame + i1[2] * frameSlice + i1[1] * frameRow + i0[0] * components;
+        const T* v111 = frame + i1[2] * frameSlice + i1[1] * frameRow + i1[0] * components;
+        double c00 = *v000 + t[0] * (*v100 - static_cast<double>(*v000));
+        double c10 = *v010 + t[0] * (*v110 - static_cast<double>(*v010));
+        double c01 = *v001 + t[0] * (*v101 - static_cast<double>(*v001));
+        double c11 = *v011 + t[0] * (*v111 - static_cast<double>(*v011));
+        double c0 = c00 + t[1] * (c10 - c00);
+        double c1 = c01 + t[1] * (c11 - c01);
+        *temperature = static_cast<float>(
+          data->BaseTemperature + c0 + t[2] * (c1 - c0));
+        }
+      }
+    }
+}
+}
+
+//----------------------------------------------------------------------------
+vtkLITTPlanV2ThermalDoseAccumulator::vtkLITTPlanV2ThermalDoseAccumulator()
+{
+  this->FrequencyFactor = 3.1e98;
+  this->ActivationEnergy = 6.28e5;
+  this->DamageThreshold = 1.;
+  this->BaseTemperature = 0.;
+  this->BackgroundTemperature = 37.;
+  this->NumberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->NumberOfFrames = 0;
+  this->LastTime = 0.;
+  this->ResampleTime = 0.;
+  this->AccumulationTime = 0.;
+  this->Temperature = vtkSmartPointer<vtkImageData>::New();
+  this->Damage = vtkSmartPointer<vtkImageData>::New();
+  this->LabelMap = vtkSmartPointer<vtkImageData>::New();
+  this->PreviousRate = vtkSmartPointer<vtkImageData>::New();
+}
+
+//----------------------------------------------------------------------------
+vtkLITTPlanV2ThermalDoseAccumulator::~vtkLITTPlanV2ThermalDoseAccumulator()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2ThermalDoseAccumulator::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "FrequencyFactor: " << this->FrequencyFactor << "\n";
+  os << indent << "ActivationEnergy: " << this->ActivationEnergy << "\n";
+  os << indent << "DamageThreshold: " << this->DamageThreshold << "\n";
+  os << indent << "BaseTemperature: " << this->BaseTemperature << "\n";
+  os << indent << "BackgroundTemperature: " << this->BackgroundTemperature << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "NumberOfFrames: " << this->NumberOfFrames << "\n";
+  os << indent << "LastTime: " << this->LastTime << "\n";
+  os << indent << "ResampleTime: " << this->ResampleTime << "\n";
+  os << indent << "AccumulationTime: " << this->AccumulationTime << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2ThermalDoseAccumulator::Initialize(const int dimensions[3])
+{
+  int* currentDimensions = this->Damage->GetDimensions();
+  if (this->Damage->GetPointData()->GetScalars() &&
+      currentDimensions[0] == dimensions[0] &&
+      currentDimensions[1] == dimensions[1] &&
+      currentDimensions[2] == dimensions[2])
+    {
+    this->Reset();
+    return;
+    }
+  const vtkIdType numberOfVoxels =
+    static_cast<vtkIdType>(dimensions[0]) * dimensions[1] * dimensions[2];
+  vtkImageData* images[4] = {this->Temperature, this->Damage, this->LabelMap,
+                             this->PreviousRate};
+  vtkSmartPointer<vtkDataArray> arrays[4] = {
+    vtkSmartPointer<vtkFloatArray>::New(),
+    vtkSmartPointer<vtkDoubleArray>::New(),
+    vtkSmartPointer<vtkUnsignedCharArray>::New(),
+    vtkSmartPointer<vtkDoubleArray>::New()};
+  for (int i = 0; i < 4; ++i)
+    {
+    arrays[i]->SetNumberOfComponents(1);
+    arrays[i]->SetNumberOfTuples(numberOfVoxels);
+    images[i]->Initialize();
+    images[i]->SetDimensions(dimensions[0], dimensions[1], dimensions[2]);
+    images[i]->SetScalarType(arrays[i]->GetDataType());
+    images[i]->SetNumberOfScalarComponents(1);
+    images[i]->GetPointData()->SetScalars(arrays[i]);
+    }
+  this->Reset();
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2ThermalDoseAccumulator::Reset()
+{
+  if (!this->Damage->GetPointData()->GetScalars())
+    {
+    return;
+    }
+  this->Temperature->GetPointData()->GetScalars()->FillComponent(
+    0, this->BackgroundTemperature);
+  this->Damage->GetPointData()->GetScalars()->FillComponent(0, 0.);
+  this->LabelMap->GetPointData()->GetScalars()->FillComponent(0, 0.);
+  this->PreviousRate->GetPointData()->GetScalars()->FillComponent(0, 0.);
+  this->NumberOfFrames = 0;
+  this->LastTime = 0.;
+  this->Temperature->Modified();
+  this->Damage->Modified();
+  this->LabelMap->Modified();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkLITTPlanV2ThermalDoseAccumulator::GetTemperature()
+{
+  return this->Temperature;
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkLITTPlanV2ThermalDoseAccumulator::GetDamage()
+{
+  return this->Damage;
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkLITTPlanV2ThermalDoseAccumulator::GetLabelMap()
+{
+  return this->LabelMap;
+}
+
+//----------------------------------------------------------------------------
+double vtkLITTPlanV2ThermalDoseAccumulator::DamageRate(double temperature)const
+{
+  return exp(log(this->FrequencyFactor) - this->ActivationEnergy /
+             (GasConstant * (temperature + CelsiusToKelvin)));
+}
+
+//----------------------------------------------------------------------------
+bool vtkLITTPlanV2ThermalDoseAccumulator::AddFrame(
+  vtkImageData* frame, vtkMatrix4x4* gridIJKToFrameIJK, double time)
+{
+  vtkDataArray* frameScalars =
+    frame ? frame->GetPointData()->GetScalars() : 0;
+  if (!frameScalars || !gridIJKToFrameIJK ||
+      !this->Damage->GetPointData()->GetScalars())
+    {
+    vtkErrorMacro("AddFrame: no frame, matrix or damage grid");
+    return false;
+    }
+  if (this->NumberOfFrames > 0 && time <= this->LastTime)
+    {
+    vtkWarningMacro("AddFrame: frame at " << time << "s is not newer than "
+                    << this->LastTime << "s, ignored");
+    return false;
+    }
+
+  // Resample the frame into the damage grid
+  double startTime = vtkTimerLog::GetUniversalTime();
+  ResampleThreadData resampleData;
+  resampleData.Frame = frameScalars->GetVoidPointer(0);
+  resampleData.FrameScalarType = frameScalars->GetDataType();
+  frame->GetDimensions(resampleData.FrameDimensions);
+  resampleData.FrameNumberOfComponents = frameScalars->GetNumberOfComponents();
+  for (int i = 0; i < 3; ++i)
+    {
+    for (int j = 0; j < 4; ++j)
+      {
+      resampleData.Matrix[i][j] = gridIJKToFrameIJK->GetElement(i, j);
+      }
+    }
+  this->Damage->GetDimensions(resampleData.Dimensions);
+  resampleData.BaseTemperature = this->BaseTemperature;
+  resampleData.BackgroundTemperature = this->BackgroundTemperature;
+  resampleData.Temperature = static_cast<float*>(
+    this->Temperature->GetScalarPointer());
+  this->Execute(vtkLITTPlanV2ThermalDoseAccumulator::ResampleThread,
+                &resampleData);
+  double resampledTime = vtkTimerLog::GetUniversalTime();
+  this->ResampleTime = resampledTime - startTime;
+
+  // Accumulate the damage
+  AccumulateThreadData accumulateData;
+  this->Damage->GetDimensions(accumulateData.Dimensions);
+  accumulateData.LogFrequencyFactor = log(this->FrequencyFactor);
+  accumulateData.ActivationTemperature = this->ActivationEnergy / GasConstant;
+  accumulateData.DamageThreshold = this->DamageThreshold;
+  accumulateData.TimeStep =
+    this->NumberOfFrames > 0 ? time - this->LastTime : 0.;
+  accumulateData.Temperature = resampleData.Temperature;
+  accumulateData.PreviousRate = static_cast<double*>(
+    this->PreviousRate->GetScalarPointer());
+  accumulateData.Damage = static_cast<double*>(
+    this->Damage->GetScalarPointer());
+  accumulateData.LabelMap = static_cast<unsigned char*>(
+    this->LabelMap->GetScalarPointer());
+  this->Execute(vtkLITTPlanV2ThermalDoseAccumulator::AccumulateThread,
+                &accumulateData);
+  this->AccumulationTime = vtkTimerLog::GetUniversalTime() - resampledTime;
+
+  ++this->NumberOfFrames;
+  this->LastTime = time;
+  this->Temperature->GetPointData()->GetScalars()->Modified();
+  this->Damage->GetPointData()->GetScalars()->Modified();
+  this->LabelMap->GetPointData()->GetScalars()->Modified();
+  this->Temperature->Modified();
+  this->Damage->Modified();
+  this->LabelMap->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2ThermalDoseAccumulator::Execute(vtkThreadFunctionType function,
+                                                  void* data)
+{
+  vtkSmartPointer<vtkMultiThreader> threader =
+    vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(
+    std::max(1, std::min(this->NumberOfThreads, this->Damage->GetDimensions()[2])));
+  threader->SetSingleMethod(function, data);
+  threader->SingleMethodExecute();
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkLITTPlanV2ThermalDoseAccumulator::ResampleThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* info =
+    static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  const ResampleThreadData* data =
+    static_cast<ResampleThreadData*>(info->UserData);
+  int kStart = 0;
+  int kEnd = 0;
+  threadSlab(info, data->Dimensions, kStart, kEnd);
+  switch (data->FrameScalarType)
+    {
+    vtkTemplateMacro(resampleSlab(data, static_cast<const VTK_TT*>(data->Frame),
+                                  kStart, kEnd));
+    }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkLITTPlanV2ThermalDoseAccumulator::AccumulateThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* info =
+    static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  const AccumulateThreadData* data =
+    static_cast<AccumulateThreadData*>(info->UserData);
+  int kStart = 0;
+  int kEnd = 0;
+  threadSlab(info, data->Dimensions, kStart, kEnd);
+  const vtkIdType sliceSize =
+    static_cast<vtkIdType>(data->Dimensions[0]) * data->Dimensions[1];
+  const double halfTimeStep = 0.5 * data->TimeStep;
+  for (vtkIdType voxel = kStart * sliceSize; voxel < kEnd * sliceSize; ++voxel)
+    {
+    const double rate = exp(data->LogFrequencyFactor -
+      data->ActivationTemperature / (data->Temperature[voxel] + CelsiusToKelvin));
+    // Trapezoidal rule between the previous frame and this one
+    data->Damage[voxel] += halfTimeStep * (data->PreviousRate[voxel] + rate);
+    data->PreviousRate[voxel] = rate;
+    if (data->Damage[voxel] >= data->DamageThreshold)
+      {
+      data->LabelMap[voxel] = 1;
+      }
+    }
+  return VTK_THREAD_RETURN_VALUE;
+}
@@ -0,0 +1,149 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkLITTPlanV2ThermalDoseAccumulator_h
+#define __vtkLITTPlanV2ThermalDoseAccumulator_h
+
+// VTK includes
+#include <vtkMultiThreader.h>
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModuleExport.h"
+
+class vtkImageData;
+class vtkMatrix4x4;
+
+/// \ingroup Slicer_QtModules_LITTPlanV2
+/// Incremental Arrhenius thermal damage from MR thermometry frames.
+///
+/// Each temperature frame is resampled (trilinearly) into the damage grid
+/// through a matrix mapping the damage grid indices to the frame indices,
+/// then the damage integral
+///   Omega = sum A.exp(-Ea / (R.T)).dt
+/// is accumulated with the trapezoidal rule between consecutive frames.
+/// Voxels where Omega reaches DamageThreshold (1 by default: 63% of cell
+/// death) are set to 1 in the label map.
+///
+/// The buffers (resampled temperature, damage rate of the previous frame,
+/// damage and label map) are allocated once by Initialize() and reused for
+/// all the frames. Both stages run in parallel, one z-slab per thread.
+/// The output images have an identity geometry (origin 0, spacing 1): the
+/// grid is placed in RAS by the IJK to RAS matrix of the caller.
+class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT vtkLITTPlanV2ThermalDoseAccumulator
+  : public vtkObject
+{
+public:
+  static vtkLITTPlanV2ThermalDoseAccumulator* New();
+  vtkTypeMacro(vtkLITTPlanV2ThermalDoseAccumulator, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Frequency factor A of the Arrhenius model in 1/s.
+  /// Default is 3.1e98 (Henriques).
+  vtkSetMacro(FrequencyFactor, double);
+  vtkGetMacro(FrequencyFactor, double);
+
+  /// Activation energy Ea of the Arrhenius model in J/mol.
+  /// Default is 6.28e5 (Henriques).
+  vtkSetMacro(ActivationEnergy, double);
+  vtkGetMacro(ActivationEnergy, double);
+
+  /// Damage from which a voxel is labeled. Default is 1.
+  vtkSetMacro(DamageThreshold, double);
+  vtkGetMacro(DamageThreshold, double);
+
+  /// Added to the frame values to get temperatures in Celsius: 0 (default)
+  /// if the frames hold temperatures, the body temperature (37) if they
+  /// hold temperature changes (PRF shift).
+  vtkSetMacro(BaseTemperature, double);
+  vtkGetMacro(BaseTemperature, double);
+
+  /// Temperature in Celsius of the voxels outside of the frames.
+  /// Default is 37.
+  vtkSetMacro(BackgroundTemperature, double);
+  vtkGetMacro(BackgroundTemperature, double);
+
+  /// Number of threads. Default is the number of cores.
+  vtkSetClampMacro(NumberOfThreads, int, 1, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+
+  /// Allocate the buffers for a damage grid of the given dimensions and
+  /// reset the damage. Reuses the buffers if the dimensions are unchanged.
+  void Initialize(const int dimensions[3]);
+  /// Reset the damage, keep the buffers.
+  void Reset();
+
+  /// Accumulate the damage of a temperature frame acquired at time (in
+  /// seconds). gridIJKToFrameIJK maps the indices of the damage grid to the
+  /// continuous indices of the frame. Frames older than the previous one
+  /// are ignored. Returns false if the frame can't be used.
+  bool AddFrame(vtkImageData* frame, vtkMatrix4x4* gridIJKToFrameIJK,
+                double time);
+
+  /// Number of frames accumulated since the last reset
+  vtkGetMacro(NumberOfFrames, int);
+  /// Time of the last frame accumulated
+  vtkGetMacro(LastTime, double);
+
+  /// Time in seconds spent by the last AddFrame() to resample the frame
+  /// and to accumulate the damage.
+  vtkGetMacro(ResampleTime, double);
+  vtkGetMacro(AccumulationTime, double);
+
+  /// Temperature (Celsius, float) of the last frame in the damage grid
+  vtkImageData* GetTemperature();
+  /// Damage integral (double)
+  vtkImageData* GetDamage();
+  /// 1 where the damage reaches DamageThreshold, 0 elsewhere (unsigned char)
+  vtkImageData* GetLabelMap();
+
+  /// Damage rate (1/s) at the temperature in Celsius
+  double DamageRate(double temperature)const;
+
+protected:
+  vtkLITTPlanV2ThermalDoseAccumulator();
+  ~vtkLITTPlanV2ThermalDoseAccumulator();
+
+  static VTK_THREAD_RETURN_TYPE ResampleThread(void* arg);
+  static VTK_THREAD_RETURN_TYPE AccumulateThread(void* arg);
+  void Execute(vtkThreadFunctionType function, void* data);
+
+  double FrequencyFactor;
+  double ActivationEnergy;
+  double DamageThreshold;
+  double BaseTemperature;
+  double BackgroundTemperature;
+  int NumberOfThreads;
+
+  int NumberOfFrames;
+  double LastTime;
+  double ResampleTime;
+  double AccumulationTime;
+
+  vtkSmartPointer<vtkImageData> Temperature;
+  vtkSmartPointer<vtkImageData> Damage;
+  vtkSmartPointer<vtkImageData> LabelMap;
+  /// Damage rate of the previous frame, for the trapezoidal rule
+  vtkSmartPointer<vtkImageData> PreviousRate;
+
+private:
+  vtkLITTPlanV2ThermalDoseAccumulator(const vtkLITTPlanV2ThermalDoseAccumulator&); // Not implemented
+  void operator=(const vtkLITTPlanV2ThermalDoseAccumulator&); // Not implemented
+};
+
+#endif
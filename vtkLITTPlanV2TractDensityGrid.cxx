@@ -0,0 +1,510 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// LITTPlanV2 includes
+#include "vtkLITTPlanV2TractDensityGrid.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkFloatArray.h>
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkPolyData.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkLITTPlanV2TractDensityGrid);
+vtkCxxSetObjectMacro(vtkLITTPlanV2TractDensityGrid, Input, vtkPolyData);
+
+namespace
+{
+//----------------------------------------------------------------------------
+struct VoxelizeThreadData
+{
+  vtkPoints* Points;
+  /// Bounds of the k-slab of each thread: slab i is [SlabStarts[i],
+  /// SlabStarts[i+1]).
+  std::vector<int> SlabStarts;
+  /// Segments crossing the slab of each thread, as pairs of point ids in
+  /// the order of the input lines.
+  std::vector<std::vector<vtkIdType> > Segments;
+  int Dimensions[3];
+  double Origin[3];
+  double Spacing[3];
+  double StepSize;
+  float* Density;
+  float* Orientation;
+};
+}
+
+//----------------------------------------------------------------------------
+vtkLITTPlanV2TractDensityGrid::vtkLITTPlanV2TractDensityGrid()
+{
+  this->Input = 0;
+  this->Spacing[0] = this->Spacing[1] = this->Spacing[2] = 1.;
+  this->Padding = 2.;
+  this->NumberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  this->Output = vtkSmartPointer<vtkImageData>::New();
+  this->RASToInputMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->QueryInputToRASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+}
+
+//----------------------------------------------------------------------------
+vtkLITTPlanV2TractDensityGrid::~vtkLITTPlanV2TractDensityGrid()
+{
+  this->SetInput(0);
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TractDensityGrid::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "Input: " << this->Input << "\n";
+  os << indent << "Spacing: " << this->Spacing[0] << " "
+     << this->Spacing[1] << " " << this->Spacing[2] << "\n";
+  os << indent << "Padding: " << this->Padding << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "InputToRASMatrix: "
+     << this->InputToRASMatrix.GetPointer() << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TractDensityGrid::SetInputToRASMatrix(vtkMatrix4x4* matrix)
+{
+  // Don't call Modified(): the grid doesn't depend on the registration.
+  this->InputToRASMatrix = matrix;
+  this->UpdateRASToInputMatrix();
+}
+
+//----------------------------------------------------------------------------
+vtkMatrix4x4* vtkLITTPlanV2TractDensityGrid::GetInputToRASMatrix()const
+{
+  return this->InputToRASMatrix.GetPointer();
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TractDensityGrid::UpdateRASToInputMatrix()
+{
+  if (!this->InputToRASMatrix)
+    {
+    this->QueryInputToRASMatrix->Identity();
+    }
+  else
+    {
+    this->QueryInputToRASMatrix->DeepCopy(this->InputToRASMatrix);
+    }
+  vtkMatrix4x4::Invert(this->QueryInputToRASMatrix, this->RASToInputMatrix);
+  this->RASToInputTime.Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TractDensityGrid::Update()
+{
+  if (this->InputToRASMatrix &&
+      this->InputToRASMatrix->GetMTime() > this->RASToInputTime)
+    {
+    this->UpdateRASToInputMatrix();
+    }
+  if (this->IsUpToDate())
+    {
+    return;
+    }
+  this->Voxelize();
+  this->BuildTime.Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkLITTPlanV2TractDensityGrid::IsUpToDate()
+{
+  return !this->Input ||
+    (this->BuildTime > this->GetMTime() &&
+     this->BuildTime > this->Input->GetMTime());
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TractDensityGrid::SetOutput(vtkImageData* output)
+{
+  if (!output)
+    {
+    vtkErrorMacro("SetOutput: no output");
+    return;
+    }
+  this->Output = output;
+  this->BuildTime.Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkLITTPlanV2TractDensityGrid::GetAlgorithmVersion()
+{
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkLITTPlanV2TractDensityGrid::GetOutput()
+{
+  return this->Output;
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TractDensityGrid::Voxelize()
+{
+  VoxelizeThreadData data;
+  data.Points = this->Input->GetPoints();
+
+  // Grid geometry
+  double bounds[6];
+  this->Input->GetBounds(bounds);
+  for (int i = 0; i < 3; ++i)
+    {
+    data.Spacing[i] = this->Spacing[i];
+    data.Origin[i] = bounds[2*i] - this->Padding;
+    double extent = bounds[2*i+1] - bounds[2*i] + 2. * this->Padding;
+    data.Dimensions[i] = std::max(1,
+      static_cast<int>(ceil(extent / this->Spacing[i])) + 1);
+    }
+  data.StepSize = 0.5 * std::min(data.Spacing[0],
+                                 std::min(data.Spacing[1], data.Spacing[2]));
+
+  vtkIdType numberOfVoxels = static_cast<vtkIdType>(data.Dimensions[0]) *
+    data.Dimensions[1] * data.Dimensions[2];
+
+  vtkSmartPointer<vtkFloatArray> density = vtkSmartPointer<vtkFloatArray>::New();
+  density->SetName("Density");
+  density->SetNumberOfComponents(1);
+  density->SetNumberOfTuples(numberOfVoxels);
+  density->FillComponent(0, 0.);
+  vtkSmartPointer<vtkFloatArray> orientation =
+    vtkSmartPointer<vtkFloatArray>::New();
+  orientation->SetName("Orientation");
+  orientation->SetNumberOfComponents(6);
+  orientation->SetNumberOfTuples(numberOfVoxels);
+  for (int c = 0; c < 6; ++c)
+    {
+    orientation->FillComponent(c, 0.);
+    }
+  data.Density = density->GetPointer(0);
+  data.Orientation = orientation->GetPointer(0);
+
+  // Each thread owns a slab of the grid along k: no synchronization needed.
+  const int numberOfThreads =
+    std::min(this->NumberOfThreads, data.Dimensions[2]);
+  for (int i = 0; i <= numberOfThreads; ++i)
+    {
+    data.SlabStarts.push_back(data.Dimensions[2] * i / numberOfThreads);
+    }
+  data.Segments.resize(numberOfThreads);
+
+  // Bucket the segments by slab so that each thread only walks the segments
+  // crossing its slab. The cell array is traversed directly (the traversal
+  // API is not thread safe anyway): [n, id0, ..., idn-1, n, ...]
+  vtkCellArray* lines = this->Input->GetLines();
+  bool empty = true;
+  if (data.Points && lines && lines->GetNumberOfCells() > 0)
+    {
+    const vtkIdType* connectivity = lines->GetPointer();
+    vtkIdType size = lines->GetNumberOfConnectivityEntries();
+    for (vtkIdType location = 0; location < size;
+         location += connectivity[location] + 1)
+      {
+      const vtkIdType npts = connectivity[location];
+      const vtkIdType* ids = connectivity + location + 1;
+      for (vtkIdType i = 0; i + 1 < npts; ++i)
+        {
+        double p0[3];
+        double p1[3];
+        data.Points->GetPoint(ids[i], p0);
+        data.Points->GetPoint(ids[i+1], p1);
+        // Samples are rounded to the nearest k: a segment touches the slabs
+        // overlapping [min(k) - 0.5, max(k) + 0.5].
+        double k0 = (p0[2] - data.Origin[2]) / data.Spacing[2];
+        double k1 = (p1[2] - data.Origin[2]) / data.Spacing[2];
+        double kMin = std::min(k0, k1) - 0.5;
+        double kMax = std::max(k0, k1) + 0.5;
+        int firstSlab = static_cast<int>(std::upper_bound(
+          data.SlabStarts.begin() + 1, data.SlabStarts.end(), kMin) -
+          (data.SlabStarts.begin() + 1));
+        int lastSlab = static_cast<int>(std::upper_bound(
+          data.SlabStarts.begin(), data.SlabStarts.end() - 1, kMax) -
+          data.SlabStarts.begin()) - 1;
+        lastSlab = std::min(lastSlab, numberOfThreads - 1);
+        for (int slab = std::max(firstSlab, 0); slab <= lastSlab; ++slab)
+          {
+          data.Segments[slab].push_back(ids[i]);
+          data.Segments[slab].push_back(ids[i+1]);
+          empty = false;
+          }
+        }
+      }
+    }
+
+  if (!empty)
+    {
+    vtkSmartPointer<vtkMultiThreader> threader =
+      vtkSmartPointer<vtkMultiThreader>::New();
+    threader->SetNumberOfThreads(numberOfThreads);
+    threader->SetSingleMethod(
+      vtkLITTPlanV2TractDensityGrid::VoxelizeThread, &data);
+    threader->SingleMethodExecute();
+    }
+
+  vtkSmartPointer<vtkImageData> output = vtkSmartPointer<vtkImageData>::New();
+  output->SetDimensions(data.Dimensions);
+  output->SetOrigin(data.Origin);
+  output->SetSpacing(data.Spacing);
+  output->GetPointData()->SetScalars(density);
+  output->GetPointData()->AddArray(orientation);
+  this->Output = output;
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkLITTPlanV2TractDensityGrid::VoxelizeThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* info =
+    static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  VoxelizeThreadData* data = static_cast<VoxelizeThreadData*>(info->UserData);
+
+  // Only the segments bucketed in the slab of the thread are walked.
+  const int* dims = data->Dimensions;
+  const int kStart = data->SlabStarts[info->ThreadID];
+  const int kEnd = data->SlabStarts[info->ThreadID + 1];
+  const vtkIdType sliceSize = static_cast<vtkIdType>(dims[0]) * dims[1];
+  const std::vector<vtkIdType>& segments = data->Segments[info->ThreadID];
+
+  for (size_t i = 0; i + 1 < segments.size(); i += 2)
+    {
+    double p0[3];
+    double p1[3];
+    data->Points->GetPoint(segments[i], p0);
+    data->Points->GetPoint(segments[i+1], p1);
+    double segment[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    double length = vtkMath::Norm(segment);
+    if (length <= 0.)
+      {
+      continue;
+      }
+    double direction[3] = {segment[0] / length, segment[1] / length,
+                           segment[2] / length};
+    int numberOfSteps = static_cast<int>(ceil(length / data->StepSize));
+    double stepLength = length / numberOfSteps;
+    for (int s = 0; s < numberOfSteps; ++s)
+      {
+      double t = (s + 0.5) / numberOfSteps;
+      int ijk[3];
+      bool inside = true;
+      for (int c = 0; c < 3 && inside; ++c)
+        {
+        double x = p0[c] + t * segment[c];
+        ijk[c] = static_cast<int>(
+          floor((x - data->Origin[c]) / data->Spacing[c] + 0.5));
+        inside = ijk[c] >= 0 && ijk[c] < dims[c];
+        }
+      if (!inside || ijk[2] < kStart || ijk[2] >= kEnd)
+        {
+        continue;
+        }
+      vtkIdType voxel = ijk[2] * sliceSize + ijk[1] * dims[0] + ijk[0];
+      data->Density[voxel] += stepLength;
+      float* tensor = data->Orientation + 6 * voxel;
+      tensor[0] += stepLength * direction[0] * direction[0];
+      tensor[1] += stepLength * direction[0] * direction[1];
+      tensor[2] += stepLength * direction[0] * direction[2];
+      tensor[3] += stepLength * direction[1] * direction[1];
+      tensor[4] += stepLength * direction[1] * direction[2];
+      tensor[5] += stepLength * direction[2] * direction[2];
+      }
+    }
+
+  // Normalize the slab: length per mm3 and unit trace tensors.
+  const double voxelVolume =
+    data->Spacing[0] * data->Spacing[1] * data->Spacing[2];
+  for (vtkIdType voxel = kStart * sliceSize; voxel < kEnd * sliceSize; ++voxel)
+    {
+    float length = data->Density[voxel];
+    if (length <= 0.f)
+      {
+      continue;
+      }
+    data->Density[voxel] = static_cast<float>(length / voxelVolume);
+    float* tensor = data->Orientation + 6 * voxel;
+    for (int c = 0; c < 6; ++c)
+      {
+      tensor[c] /= length;
+      }
+    }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TractDensityGrid::RASToContinuousIndex(
+  const double ras[3], double ijk[3])const
+{
+  double in[4] = {ras[0], ras[1], ras[2], 1.};
+  double out[4];
+  this->RASToInputMatrix->MultiplyPoint(in, out);
+  double* origin = this->Output->GetOrigin();
+  double* spacing = this->Output->GetSpacing();
+  for (int i = 0; i < 3; ++i)
+    {
+    ijk[i] = (out[i] - origin[i]) / spacing[i];
+    }
+}
+
+//----------------------------------------------------------------------------
+bool vtkLITTPlanV2TractDensityGrid::Interpolate(const float* array,
+  int numberOfComponents, const double ijk[3], double* value)const
+{
+  int* dims = this->Output->GetDimensions();
+  int base[3];
+  double f[3];
+  for (int i = 0; i < 3; ++i)
+    {
+    if (ijk[i] < 0. || ijk[i] > dims[i] - 1)
+      {
+      return false;
+      }
+    base[i] = std::min(static_cast<int>(ijk[i]), std::max(dims[i] - 2, 0));
+    f[i] = ijk[i] - base[i];
+    }
+  for (int c = 0; c < numberOfComponents; ++c)
+    {
+    value[c] = 0.;
+    }
+  const vtkIdType sliceSize = static_cast<vtkIdType>(dims[0]) * dims[1];
+  for (int corner = 0; corner < 8; ++corner)
+    {
+    int offset[3] = {corner & 1, (corner >> 1) & 1, (corner >> 2) & 1};
+    double weight = 1.;
+    for (int i = 0; i < 3; ++i)
+      {
+      if (offset[i] && base[i] + 1 >= dims[i])
+        {
+        weight = 0.;
+        break;
+        }
+      weight *= offset[i] ? f[i] : 1. - f[i];
+      }
+    if (weight == 0.)
+      {
+      continue;
+      }
+    vtkIdType voxel = (base[2] + offset[2]) * sliceSize +
+      (base[1] + offset[1]) * dims[0] + base[0] + offset[0];
+    const float* tuple = array + numberOfComponents * voxel;
+    for (int c = 0; c < numberOfComponents; ++c)
+      {
+      value[c] += weight * tuple[c];
+      }
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+double vtkLITTPlanV2TractDensityGrid::EvaluateDensity(const double ras[3])const
+{
+  vtkFloatArray* density = vtkFloatArray::SafeDownCast(
+    this->Output->GetPointData()->GetScalars());
+  if (!density)
+    {
+    return 0.;
+    }
+  double ijk[3];
+  this->RASToContinuousIndex(ras, ijk);
+  double value = 0.;
+  return this->Interpolate(density->GetPointer(0), 1, ijk, &value) ? value : 0.;
+}
+
+//----------------------------------------------------------------------------
+bool vtkLITTPlanV2TractDensityGrid::EvaluateOrientation(
+  const double ras[3], double orientation[3])const
+{
+  vtkFloatArray* tensors = vtkFloatArray::SafeDownCast(
+    this->Output->GetPointData()->GetArray("Orientation"));
+  if (!tensors)
+    {
+    return false;
+    }
+  double ijk[3];
+  this->RASToContinuousIndex(ras, ijk);
+  double t[6];
+  if (!this->Interpolate(tensors->GetPointer(0), 6, ijk, t) ||
+      t[0] + t[3] + t[5] <= 0.)
+    {
+    return false;
+    }
+  double tensor[3][3] = {{t[0], t[1], t[2]},
+                         {t[1], t[3], t[4]},
+                         {t[2], t[4], t[5]}};
+  // Express the tensor in RAS: M T M^t, M being the linear part of the
+  // input to RAS matrix.
+  double m[3][3];
+  for (int i = 0; i < 3; ++i)
+    {
+    for (int j = 0; j < 3; ++j)
+      {
+      m[i][j] = this->QueryInputToRASMatrix->GetElement(i, j);
+      }
+    }
+  double mt[3][3];
+  vtkMath::Multiply3x3(m, tensor, mt);
+  vtkMath::Transpose3x3(m, m);
+  vtkMath::Multiply3x3(mt, m, tensor);
+  double* rows[3] = {tensor[0], tensor[1], tensor[2]};
+  double eigenvalues[3];
+  double eigenvectorsData[3][3];
+  double* eigenvectors[3] = {eigenvectorsData[0], eigenvectorsData[1],
+                             eigenvectorsData[2]};
+  vtkMath::Jacobi(rows, eigenvalues, eigenvectors);
+  // Eigenvalues are sorted in decreasing order, eigenvectors are columns.
+  for (int i = 0; i < 3; ++i)
+    {
+    orientation[i] = eigenvectors[i][0];
+    }
+  vtkMath::Normalize(orientation);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+double vtkLITTPlanV2TractDensityGrid::EvaluateTrajectoryCost(
+  const double entry[3], const double target[3], double stepSize)const
+{
+  double segment[3] = {target[0] - entry[0], target[1] - entry[1],
+                       target[2] - entry[2]};
+  double length = vtkMath::Norm(segment);
+  if (length <= 0. || stepSize <= 0.)
+    {
+    return this->EvaluateDensity(entry) * length;
+    }
+  int numberOfSteps = static_cast<int>(ceil(length / stepSize));
+  double stepLength = length / numberOfSteps;
+  double cost = 0.;
+  for (int s = 0; s < numberOfSteps; ++s)
+    {
+    double t = (s + 0.5) / numberOfSteps;
+    double position[3] = {entry[0] + t * segment[0],
+                          entry[1] + t * segment[1],
+                          entry[2] + t * segment[2]};
+    cost += this->EvaluateDensity(position) * stepLength;
+    }
+  return cost;
+}
@@ -0,0 +1,149 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkLITTPlanV2TractDensityGrid_h
+#define __vtkLITTPlanV2TractDensityGrid_h
+
+// VTK includes
+#include <vtkMultiThreader.h>
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+#include <vtkTimeStamp.h>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModuleExport.h"
+
+class vtkImageData;
+class vtkMatrix4x4;
+class vtkPolyData;
+
+/// \ingroup Slicer_QtModules_LITTPlanV2
+/// Voxelized white-matter tract density and orientation.
+///
+/// The streamlines of the input polydata are rasterized once (in parallel,
+/// one z-slab per thread) into a regular grid holding, for each voxel, the
+/// length of streamline per mm3 and the mean orientation tensor of the
+/// streamlines. Queries are then trilinear lookups.
+///
+/// The grid is built in the coordinate system of the input polydata. Points
+/// given in RAS are mapped into the grid through the inverse of the
+/// InputToRASMatrix. Changing that matrix (e.g. when the registration
+/// transform is edited) does NOT trigger a re-voxelization.
+class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT vtkLITTPlanV2TractDensityGrid
+  : public vtkObject
+{
+public:
+  static vtkLITTPlanV2TractDensityGrid* New();
+  vtkTypeMacro(vtkLITTPlanV2TractDensityGrid, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Streamlines to voxelize. Only the lines of the polydata are considered.
+  void SetInput(vtkPolyData* input);
+  vtkGetObjectMacro(Input, vtkPolyData);
+
+  /// Voxel size of the grid in mm. Default is 1mm isotropic.
+  vtkSetVector3Macro(Spacing, double);
+  vtkGetVector3Macro(Spacing, double);
+
+  /// Margin added around the bounds of the streamlines, in mm. Default is 2mm.
+  vtkSetMacro(Padding, double);
+  vtkGetMacro(Padding, double);
+
+  /// Number of threads used to voxelize the streamlines.
+  /// Default is the number of cores.
+  vtkSetClampMacro(NumberOfThreads, int, 1, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+
+  /// Matrix mapping the input (tractography) coordinates to RAS. The matrix
+  /// is referenced, not copied: later modifications of the matrix are picked
+  /// up by the queries after the next Update(). Setting it does not modify
+  /// the grid. A null matrix means identity.
+  void SetInputToRASMatrix(vtkMatrix4x4* matrix);
+  vtkMatrix4x4* GetInputToRASMatrix()const;
+
+  /// Voxelize the input if it, or the grid geometry, changed since the last
+  /// call. Does nothing otherwise.
+  void Update();
+
+  /// Return true if Update() has nothing to do.
+  bool IsUpToDate();
+
+  /// Use a grid voxelized earlier (e.g. read from a result cache) as output
+  /// for the current input and geometry: the next Update() does nothing
+  /// unless they are modified.
+  void SetOutput(vtkImageData* output);
+
+  /// Version of the voxelization algorithm, to be incremented each time its
+  /// output changes. Part of the cache keys of the grid.
+  static int GetAlgorithmVersion();
+
+  /// Grid of the last Update(). Point scalars are the tract density
+  /// (streamline mm per mm3), the 6 components "Orientation" point data array
+  /// holds the mean orientation tensor (xx, xy, xz, yy, yz, zz) of the
+  /// streamlines, normalized to a unit trace.
+  vtkImageData* GetOutput();
+
+  /// Trilinearly interpolated density at the RAS position. Returns 0 outside
+  /// of the grid. The queries don't modify the grid and can be called from
+  /// concurrent threads.
+  double EvaluateDensity(const double ras[3])const;
+
+  /// Main streamline direction at the RAS position, expressed in RAS: the
+  /// principal eigenvector of the interpolated orientation tensor. The sign
+  /// of the direction is arbitrary. Returns false if there is no tract at
+  /// that position.
+  bool EvaluateOrientation(const double ras[3], double orientation[3])const;
+
+  /// Line integral of the density between entry and target, sampled every
+  /// stepSize mm. It is the cost of a trajectory regarding the tracts.
+  double EvaluateTrajectoryCost(const double entry[3], const double target[3],
+                                double stepSize = 0.5)const;
+
+protected:
+  vtkLITTPlanV2TractDensityGrid();
+  ~vtkLITTPlanV2TractDensityGrid();
+
+  void Voxelize();
+  void UpdateRASToInputMatrix();
+  void RASToContinuousIndex(const double ras[3], double ijk[3])const;
+  /// Trilinear interpolation of the numberOfComponents first components of
+  /// the float array at the continuous index. Returns false if outside.
+  bool Interpolate(const float* array, int numberOfComponents,
+                   const double ijk[3], double* value)const;
+
+  static VTK_THREAD_RETURN_TYPE VoxelizeThread(void* arg);
+
+  vtkPolyData* Input;
+  double Spacing[3];
+  double Padding;
+  int NumberOfThreads;
+
+  vtkSmartPointer<vtkImageData> Output;
+  vtkSmartPointer<vtkMatrix4x4> InputToRASMatrix;
+  /// Snapshots of InputToRASMatrix and its inverse used by the queries,
+  /// updated by Update().
+  vtkSmartPointer<vtkMatrix4x4> QueryInputToRASMatrix;
+  vtkSmartPointer<vtkMatrix4x4> RASToInputMatrix;
+  vtkTimeStamp RASToInputTime;
+  vtkTimeStamp BuildTime;
+
+private:
+  vtkLITTPlanV2TractDensityGrid(const vtkLITTPlanV2TractDensityGrid&); // Not implemented
+  void operator=(const vtkLITTPlanV2TractDensityGrid&); // Not implemented
+};
+
+#endif
@@ -0,0 +1,660 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// LITTPlanV2 includes
+#include "vtkLITTPlanV2TractDensityGrid.h"
+#include "vtkLITTPlanV2TrajectoryOptimizer.h"
+
+// VTK includes
+#include <vtkIdList.h>
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkOBBTree.h>
+#include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkTimerLog.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkLITTPlanV2TrajectoryOptimizer);
+vtkCxxSetObjectMacro(vtkLITTPlanV2TrajectoryOptimizer, TractDensityGrid,
+                     vtkLITTPlanV2TractDensityGrid);
+
+namespace
+{
+//----------------------------------------------------------------------------
+void anglesToDirection(double theta, double phi, double direction[3])
+{
+  direction[0] = sin(theta) * cos(phi);
+  direction[1] = sin(theta) * sin(phi);
+  direction[2] = cos(theta);
+}
+
+//----------------------------------------------------------------------------
+struct CoarseSearchThreadData
+{
+  vtkLITTPlanV2TrajectoryOptimizer* Self;
+  std::vector<double> Thetas;
+  std::vector<double> Phis;
+  std::vector<double> Costs;
+};
+
+//----------------------------------------------------------------------------
+struct CostLess
+{
+  CostLess(const std::vector<double>& costs) : Costs(costs) {}
+  bool operator()(int a, int b)const { return this->Costs[a] < this->Costs[b]; }
+  const std::vector<double>& Costs;
+};
+}
+
+//----------------------------------------------------------------------------
+vtkLITTPlanV2TrajectoryOptimizer::vtkLITTPlanV2TrajectoryOptimizer()
+{
+  this->Target[0] = this->Target[1] = this->Target[2] = 0.;
+  this->TumorAxis[0] = this->TumorAxis[1] = this->TumorAxis[2] = 0.;
+  this->Skull = 0;
+  this->ClearanceMap = 0;
+  this->TractDensityGrid = 0;
+  this->RASToClearanceIJK = vtkSmartPointer<vtkMatrix4x4>::New();
+
+  this->SafetyMargin = 5.;
+  this->MaximumLength = 150.;
+  this->SamplingStep = 1.;
+  this->ClearanceWeight = 1.;
+  this->CoverageWeight = 0.5;
+  this->LengthWeight = 0.2;
+  this->SkullAngleWeight = 0.2;
+  this->TractWeight = 1.;
+  this->NumberOfSamples = 2000;
+  this->NumberOfRefinedCandidates = 3;
+  this->AngularTolerance = 1e-5;
+  this->MaximumNumberOfIterations = 200;
+  this->NumberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+
+  this->Entry[0] = this->Entry[1] = this->Entry[2] = 0.;
+  this->Direction[0] = this->Direction[1] = 0.;
+  this->Direction[2] = 1.;
+  this->Cost = VTK_DOUBLE_MAX;
+  this->Converged = false;
+  this->NumberOfIterations = 0;
+  this->NumberOfEvaluations = 0;
+  this->CoarseSearchTime = 0.;
+  this->RefinementTime = 0.;
+}
+
+//----------------------------------------------------------------------------
+vtkLITTPlanV2TrajectoryOptimizer::~vtkLITTPlanV2TrajectoryOptimizer()
+{
+  this->SetSkull(0);
+  this->SetClearanceMap(0, 0);
+  this->SetTractDensityGrid(0);
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TrajectoryOptimizer::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "Target: " << this->Target[0] << " " << this->Target[1]
+     << " " << this->Target[2] << "\n";
+  os << indent << "TumorAxis: " << this->TumorAxis[0] << " "
+     << this->TumorAxis[1] << " " << this->TumorAxis[2] << "\n";
+  os << indent << "Skull: " << this->Skull << "\n";
+  os << indent << "ClearanceMap: " << this->ClearanceMap << "\n";
+  os << indent << "TractDensityGrid: " << this->TractDensityGrid << "\n";
+  os << indent << "SafetyMargin: " << this->SafetyMargin << "\n";
+  os << indent << "MaximumLength: " << this->MaximumLength << "\n";
+  os << indent << "SamplingStep: " << this->SamplingStep << "\n";
+  os << indent << "ClearanceWeight: " << this->ClearanceWeight << "\n";
+  os << indent << "CoverageWeight: " << this->CoverageWeight << "\n";
+  os << indent << "LengthWeight: " << this->LengthWeight << "\n";
+  os << indent << "SkullAngleWeight: " << this->SkullAngleWeight << "\n";
+  os << indent << "TractWeight: " << this->TractWeight << "\n";
+  os << indent << "NumberOfSamples: " << this->NumberOfSamples << "\n";
+  os << indent << "NumberOfRefinedCandidates: "
+     << this->NumberOfRefinedCandidates << "\n";
+  os << indent << "AngularTolerance: " << this->AngularTolerance << "\n";
+  os << indent << "MaximumNumberOfIterations: "
+     << this->MaximumNumberOfIterations << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "Cost: " << this->Cost << "\n";
+  os << indent << "Converged: " << this->Converged << "\n";
+  os << indent << "CoarseSearchTime: " << this->CoarseSearchTime << "\n";
+  os << indent << "RefinementTime: " << this->RefinementTime << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TrajectoryOptimizer::SetTumor(vtkPolyData* tumor)
+{
+  vtkPoints* points = tumor ? tumor->GetPoints() : 0;
+  if (!points || points->GetNumberOfPoints() == 0)
+    {
+    vtkErrorMacro("SetTumor: no tumor points");
+    return;
+    }
+  vtkIdType numberOfPoints = points->GetNumberOfPoints();
+  double centroid[3] = {0., 0., 0.};
+  double point[3];
+  for (vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+    points->GetPoint(i, point);
+    vtkMath::Add(centroid, point, centroid);
+    }
+  vtkMath::MultiplyScalar(centroid, 1. / numberOfPoints);
+
+  double covarianceData[3][3] = {{0., 0., 0.}, {0., 0., 0.}, {0., 0., 0.}};
+  for (vtkIdType i = 0; i < numberOfPoints; ++i)
+    {
+    points->GetPoint(i, point);
+    vtkMath::Subtract(point, centroid, point);
+    for (int r = 0; r < 3; ++r)
+      {
+      for (int c = 0; c < 3; ++c)
+        {
+        covarianceData[r][c] += point[r] * point[c];
+        }
+      }
+    }
+  double* covariance[3] = {covarianceData[0], covarianceData[1],
+                           covarianceData[2]};
+  double eigenvalues[3];
+  double eigenvectorsData[3][3];
+  double* eigenvectors[3] = {eigenvectorsData[0], eigenvectorsData[1],
+                             eigenvectorsData[2]};
+  vtkMath::Jacobi(covariance, eigenvalues, eigenvectors);
+
+  this->SetTarget(centroid);
+  // A spherical tumor has no main axis
+  if (eigenvalues[0] > 1.1 * eigenvalues[1])
+    {
+    this->SetTumorAxis(eigenvectors[0][0], eigenvectors[1][0],
+                       eigenvectors[2][0]);
+    }
+  else
+    {
+    this->SetTumorAxis(0., 0., 0.);
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TrajectoryOptimizer::SetSkull(vtkPolyData* skull)
+{
+  if (skull != this->Skull)
+    {
+    this->SkullLocators.clear();
+    }
+  vtkSetObjectBodyMacro(Skull, vtkPolyData, skull);
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TrajectoryOptimizer::SetClearanceMap(
+  vtkImageData* distanceMap, vtkMatrix4x4* rasToIJK)
+{
+  vtkSetObjectBodyMacro(ClearanceMap, vtkImageData, distanceMap);
+  if (rasToIJK)
+    {
+    this->RASToClearanceIJK->DeepCopy(rasToIJK);
+    }
+  else
+    {
+    this->RASToClearanceIJK->Identity();
+    }
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TrajectoryOptimizer::UpdateSkullLocators(int numberOfLocators)
+{
+  if (!this->Skull)
+    {
+    return;
+    }
+  if (this->Skull->GetMTime() > this->SkullLocatorsBuildTime)
+    {
+    this->SkullLocators.clear();
+    }
+  if (static_cast<int>(this->SkullLocators.size()) >= numberOfLocators)
+    {
+    return;
+    }
+  if (this->SkullLocators.empty())
+    {
+    // The locators read the cells of the skull concurrently: build them now
+    this->Skull->BuildCells();
+    }
+  // A locator is not thread-safe (IntersectWithLine uses its own scratch
+  // data), each thread gets its own tree on the shared, read-only skull.
+  while (static_cast<int>(this->SkullLocators.size()) < numberOfLocators)
+    {
+    vtkSmartPointer<vtkOBBTree> locator = vtkSmartPointer<vtkOBBTree>::New();
+    locator->SetDataSet(this->Skull);
+    locator->BuildLocator();
+    this->SkullLocators.push_back(locator);
+    }
+  this->SkullLocatorsBuildTime.Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkLITTPlanV2TrajectoryOptimizer::FindEntry(const double direction[3],
+                                                 double entry[3],
+                                                 double normal[3],
+                                                 vtkOBBTree* locator)
+{
+  double outside[3];
+  for (int i = 0; i < 3; ++i)
+    {
+    outside[i] = this->Target[i] + this->MaximumLength * direction[i];
+    }
+  vtkSmartPointer<vtkPoints> intersections = vtkSmartPointer<vtkPoints>::New();
+  vtkSmartPointer<vtkIdList> cellIds = vtkSmartPointer<vtkIdList>::New();
+
+  locator->IntersectWithLine(outside, this->Target, intersections, cellIds);
+  // The outermost intersection is the entry point on the skull
+  vtkIdType entryIndex = -1;
+  double maximumDistance = -1.;
+  for (vtkIdType i = 0; i < intersections->GetNumberOfPoints(); ++i)
+    {
+    double distance = vtkMath::Distance2BetweenPoints(
+      intersections->GetPoint(i), this->Target);
+    if (distance > maximumDistance)
+      {
+      maximumDistance = distance;
+      entryIndex = i;
+      }
+    }
+  vtkIdType npts = 0;
+  vtkIdType* pts = 0;
+  if (entryIndex >= 0)
+    {
+    intersections->GetPoint(entryIndex, entry);
+    this->Skull->GetCellPoints(cellIds->GetId(entryIndex), npts, pts);
+    }
+  double p0[3] = {0., 0., 0.};
+  double p1[3] = {0., 0., 0.};
+  double p2[3] = {0., 0., 0.};
+  if (npts >= 3)
+    {
+    this->Skull->GetPoint(pts[0], p0);
+    this->Skull->GetPoint(pts[1], p1);
+    this->Skull->GetPoint(pts[2], p2);
+    }
+
+  if (entryIndex < 0)
+    {
+    return false;
+    }
+  double u[3];
+  double v[3];
+  vtkMath::Subtract(p1, p0, u);
+  vtkMath::Subtract(p2, p0, v);
+  vtkMath::Cross(u, v, normal);
+  if (vtkMath::Normalize(normal) == 0.)
+    {
+    // Degenerate cell: don't penalize the skull angle
+    normal[0] = direction[0];
+    normal[1] = direction[1];
+    normal[2] = direction[2];
+    }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+double vtkLITTPlanV2TrajectoryOptimizer::ClearanceAt(const double ras[3])const
+{
+  double in[4] = {ras[0], ras[1], ras[2], 1.};
+  double ijk[4];
+  this->RASToClearanceIJK->MultiplyPoint(in, ijk);
+  int* extent = this->ClearanceMap->GetExtent();
+  int base[3];
+  double f[3];
+  for (int i = 0; i < 3; ++i)
+    {
+    if (ijk[i] < extent[2*i] || ijk[i] > extent[2*i+1])
+      {
+      // No critical structure known outside of the map
+      return VTK_DOUBLE_MAX;
+      }
+    base[i] = std::min(static_cast<int>(floor(ijk[i])),
+                       std::max(extent[2*i+1] - 1, extent[2*i]));
+    f[i] = ijk[i] - base[i];
+    }
+  double value = 0.;
+  for (int corner = 0; corner < 8; ++corner)
+    {
+    int index[3];
+    double weight = 1.;
+    for (int i = 0; i < 3; ++i)
+      {
+      int offset = (corner >> i) & 1;
+      index[i] = std::min(base[i] + offset, extent[2*i+1]);
+      weight *= offset ? f[i] : 1. - f[i];
+      }
+    if (weight != 0.)
+      {
+      value += weight * this->ClearanceMap->GetScalarComponentAsDouble(
+        index[0], index[1], index[2], 0);
+      }
+    }
+  return value;
+}
+
+//----------------------------------------------------------------------------
+double vtkLITTPlanV2TrajectoryOptimizer::EvaluateCost(
+  const double direction[3], double entry[3])
+{
+  this->UpdateSkullLocators(1);
+  return this->ComputeCost(direction, entry, 0);
+}
+
+//----------------------------------------------------------------------------
+double vtkLITTPlanV2TrajectoryOptimizer::ComputeCost(
+  const double direction[3], double entry[3], int thread)
+{
+  double unitDirection[3] = {direction[0], direction[1], direction[2]};
+  if (vtkMath::Normalize(unitDirection) == 0.)
+    {
+    return VTK_DOUBLE_MAX;
+    }
+  double entryPoint[3];
+  double normal[3];
+  if (!this->Skull || thread >= static_cast<int>(this->SkullLocators.size()) ||
+      !this->FindEntry(unitDirection, entryPoint, normal,
+                       this->SkullLocators[thread]))
+    {
+    return VTK_DOUBLE_MAX;
+    }
+  if (entry)
+    {
+    entry[0] = entryPoint[0];
+    entry[1] = entryPoint[1];
+    entry[2] = entryPoint[2];
+    }
+  double length = sqrt(vtkMath::Distance2BetweenPoints(entryPoint, this->Target));
+
+  double cost = this->LengthWeight * length / this->MaximumLength;
+  cost += this->SkullAngleWeight *
+    (1. - fabs(vtkMath::Dot(unitDirection, normal)));
+
+  double axis[3] = {this->TumorAxis[0], this->TumorAxis[1], this->TumorAxis[2]};
+  if (vtkMath::Normalize(axis) > 0.)
+    {
+    cost += this->CoverageWeight * (1. - fabs(vtkMath::Dot(unitDirection, axis)));
+    }
+
+  if (this->ClearanceMap && this->ClearanceWeight != 0. && length > 0.)
+    {
+    int numberOfSteps = std::max(1,
+      static_cast<int>(ceil(length / this->SamplingStep)));
+    double clearance = 0.;
+    for (int s = 0; s < numberOfSteps; ++s)
+      {
+      double t = length * (s + 0.5) / numberOfSteps;
+      double position[3] = {this->Target[0] + t * unitDirection[0],
+                            this->Target[1] + t * unitDirection[1],
+                            this->Target[2] + t * unitDirection[2]};
+      double distance = std::max(0., this->ClearanceAt(position));
+      clearance += exp(-distance / this->SafetyMargin);
+      }
+    cost += this->ClearanceWeight * clearance / numberOfSteps;
+    }
+
+  if (this->TractDensityGrid && this->TractWeight != 0. && length > 0.)
+    {
+    cost += this->TractWeight * this->TractDensityGrid->EvaluateTrajectoryCost(
+      entryPoint, this->Target, this->SamplingStep) / length;
+    }
+  return cost;
+}
+
+//----------------------------------------------------------------------------
+double vtkLITTPlanV2TrajectoryOptimizer::EvaluateAngles(double theta,
+                                                        double phi,
+                                                        int thread)
+{
+  double direction[3];
+  anglesToDirection(theta, phi, direction);
+  return this->ComputeCost(direction, 0, thread);
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkLITTPlanV2TrajectoryOptimizer::CoarseSearchThread(void* arg)
+{
+  vtkMultiThreader::ThreadInfo* info =
+    static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+  CoarseSearchThreadData* data =
+    static_cast<CoarseSearchThreadData*>(info->UserData);
+  const int count = static_cast<int>(data->Costs.size());
+  const int start = count * info->ThreadID / info->NumberOfThreads;
+  const int end = count * (info->ThreadID + 1) / info->NumberOfThreads;
+  for (int i = start; i < end; ++i)
+    {
+    data->Costs[i] = data->Self->EvaluateAngles(data->Thetas[i], data->Phis[i],
+                                                info->ThreadID);
+    }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+double vtkLITTPlanV2TrajectoryOptimizer::Refine(double angles[2],
+                                                int& iterations,
+                                                bool& converged)
+{
+  // Nelder-Mead on (theta, phi). The initial simplex spans the distance
+  // between two coarse samples.
+  const double step = sqrt(4. * vtkMath::Pi() / this->NumberOfSamples);
+  double simplex[3][2] = {{angles[0], angles[1]},
+                          {angles[0] + step, angles[1]},
+                          {angles[0], angles[1] + step}};
+  double costs[3];
+  for (int v = 0; v < 3; ++v)
+    {
+    costs[v] = this->EvaluateAngles(simplex[v][0], simplex[v][1]);
+    }
+  this->NumberOfEvaluations += 3;
+
+  converged = false;
+  for (iterations = 0; iterations < this->MaximumNumberOfIterations; ++iterations)
+    {
+    // Order the vertices: best, middle, worst
+    for (int i = 0; i < 2; ++i)
+      {
+      for (int j = 0; j < 2 - i; ++j)
+        {
+        if (costs[j+1] < costs[j])
+          {
+          std::swap(costs[j], costs[j+1]);
+          std::swap(simplex[j][0], simplex[j+1][0]);
+          std::swap(simplex[j][1], simplex[j+1][1]);
+          }
+        }
+      }
+    double size = 0.;
+    for (int v = 1; v < 3; ++v)
+      {
+      size = std::max(size, std::max(fabs(simplex[v][0] - simplex[0][0]),
+                                     fabs(simplex[v][1] - simplex[0][1])));
+      }
+    if (size < this->AngularTolerance)
+      {
+      converged = true;
+      break;
+      }
+
+    double centroid[2] = {0.5 * (simplex[0][0] + simplex[1][0]),
+                          0.5 * (simplex[0][1] + simplex[1][1])};
+    double reflected[2] = {2. * centroid[0] - simplex[2][0],
+                           2. * centroid[1] - simplex[2][1]};
+    double reflectedCost = this->EvaluateAngles(reflected[0], reflected[1]);
+    ++this->NumberOfEvaluations;
+    if (reflectedCost < costs[0])
+      {
+      double expanded[2] = {3. * centroid[0] - 2. * simplex[2][0],
+                            3. * centroid[1] - 2. * simplex[2][1]};
+      double expandedCost = this->EvaluateAngles(expanded[0], expanded[1]);
+      ++this->NumberOfEvaluations;
+      bool expand = expandedCost < reflectedCost;
+      simplex[2][0] = expand ? expanded[0] : reflected[0];
+      simplex[2][1] = expand ? expanded[1] : reflected[1];
+      costs[2] = expand ? expandedCost : reflectedCost;
+      continue;
+      }
+    if (reflectedCost < costs[1])
+      {
+      simplex[2][0] = reflected[0];
+      simplex[2][1] = reflected[1];
+      costs[2] = reflectedCost;
+      continue;
+      }
+    double contracted[2] = {0.5 * (centroid[0] + simplex[2][0]),
+                            0.5 * (centroid[1] + simplex[2][1])};
+    double contractedCost = this->EvaluateAngles(contracted[0], contracted[1]);
+    ++this->NumberOfEvaluations;
+    if (contractedCost < costs[2])
+      {
+      simplex[2][0] = contracted[0];
+      simplex[2][1] = contracted[1];
+      costs[2] = contractedCost;
+      continue;
+      }
+    // Shrink toward the best vertex
+    for (int v = 1; v < 3; ++v)
+      {
+      simplex[v][0] = 0.5 * (simplex[0][0] + simplex[v][0]);
+      simplex[v][1] = 0.5 * (simplex[0][1] + simplex[v][1]);
+      costs[v] = this->EvaluateAngles(simplex[v][0], simplex[v][1]);
+      }
+    this->NumberOfEvaluations += 2;
+    }
+
+  int best = std::min_element(costs, costs + 3) - costs;
+  angles[0] = simplex[best][0];
+  angles[1] = simplex[best][1];
+  return costs[best];
+}
+
+//----------------------------------------------------------------------------
+bool vtkLITTPlanV2TrajectoryOptimizer::Optimize()
+{
+  this->Cost = VTK_DOUBLE_MAX;
+  this->Converged = false;
+  this->NumberOfIterations = 0;
+  this->NumberOfEvaluations = 0;
+  this->CoarseSearchTime = 0.;
+  this->RefinementTime = 0.;
+  if (!this->Skull || this->Skull->GetNumberOfCells() == 0)
+    {
+    vtkErrorMacro("Optimize: no skull surface");
+    return false;
+    }
+
+  const int numberOfThreads =
+    std::min(this->NumberOfThreads, this->NumberOfSamples);
+  double startTime = vtkTimerLog::GetUniversalTime();
+  this->UpdateSkullLocators(numberOfThreads);
+  if (this->TractDensityGrid)
+    {
+    this->TractDensityGrid->Update();
+    }
+
+  // Coarse search: directions evenly spread on the sphere (Fibonacci
+  // lattice), evaluated in parallel.
+  CoarseSearchThreadData data;
+  data.Self = this;
+  data.Thetas.resize(this->NumberOfSamples);
+  data.Phis.resize(this->NumberOfSamples);
+  data.Costs.resize(this->NumberOfSamples, VTK_DOUBLE_MAX);
+  const double goldenAngle = vtkMath::Pi() * (3. - sqrt(5.));
+  for (int i = 0; i < this->NumberOfSamples; ++i)
+    {
+    data.Thetas[i] = acos(1. - 2. * (i + 0.5) / this->NumberOfSamples);
+    data.Phis[i] = fmod(goldenAngle * i, 2. * vtkMath::Pi());
+    }
+  vtkSmartPointer<vtkMultiThreader> threader =
+    vtkSmartPointer<vtkMultiThreader>::New();
+  threader->SetNumberOfThreads(numberOfThreads);
+  threader->SetSingleMethod(
+    vtkLITTPlanV2TrajectoryOptimizer::CoarseSearchThread, &data);
+  threader->SingleMethodExecute();
+  this->NumberOfEvaluations = this->NumberOfSamples;
+
+  std::vector<int> candidates;
+  for (int i = 0; i < this->NumberOfSamples; ++i)
+    {
+    if (data.Costs[i] < VTK_DOUBLE_MAX)
+      {
+      candidates.push_back(i);
+      }
+    }
+  int numberOfCandidates = std::min(
+    static_cast<int>(candidates.size()), this->NumberOfRefinedCandidates);
+  std::partial_sort(candidates.begin(), candidates.begin() + numberOfCandidates,
+                    candidates.end(), CostLess(data.Costs));
+  double refinementStartTime = vtkTimerLog::GetUniversalTime();
+  this->CoarseSearchTime = refinementStartTime - startTime;
+  if (numberOfCandidates == 0)
+    {
+    vtkWarningMacro("Optimize: no trajectory reaches the skull");
+    return false;
+    }
+
+  // Refinement of the best coarse candidates
+  double bestAngles[2] = {0., 0.};
+  for (int c = 0; c < numberOfCandidates; ++c)
+    {
+    double angles[2] = {data.Thetas[candidates[c]], data.Phis[candidates[c]]};
+    int iterations = 0;
+    bool converged = false;
+    double cost = this->Refine(angles, iterations, converged);
+    if (cost < this->Cost)
+      {
+      this->Cost = cost;
+      this->Converged = converged;
+      this->NumberOfIterations = iterations;
+      bestAngles[0] = angles[0];
+      bestAngles[1] = angles[1];
+      }
+    }
+  anglesToDirection(bestAngles[0], bestAngles[1], this->Direction);
+  this->EvaluateCost(this->Direction, this->Entry);
+  this->RefinementTime = vtkTimerLog::GetUniversalTime() - refinementStartTime;
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkLITTPlanV2TrajectoryOptimizer::GetTrajectoryMatrix(vtkMatrix4x4* matrix)
+{
+  if (!matrix)
+    {
+    return;
+    }
+  double x[3];
+  double y[3];
+  vtkMath::Perpendiculars(this->Direction, x, y, 0.);
+  matrix->Identity();
+  for (int i = 0; i < 3; ++i)
+    {
+    matrix->SetElement(i, 0, x[i]);
+    matrix->SetElement(i, 1, y[i]);
+    matrix->SetElement(i, 2, this->Direction[i]);
+    matrix->SetElement(i, 3, this->Target[i]);
+    }
+}
@@ -0,0 +1,221 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Copyright (c) Kitware Inc.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkLITTPlanV2TrajectoryOptimizer_h
+#define __vtkLITTPlanV2TrajectoryOptimizer_h
+
+// VTK includes
+#include <vtkMultiThreader.h>
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+// LITTPlanV2 includes
+#include "qSlicerLITTPlanV2ModuleExport.h"
+
+class vtkImageData;
+class vtkLITTPlanV2TractDensityGrid;
+class vtkMatrix4x4;
+class vtkOBBTree;
+class vtkPolyData;
+
+/// \ingroup Slicer_QtModules_LITTPlanV2
+/// Search the laser trajectory (entry point on the skull) to a target.
+///
+/// A trajectory is parameterized by the polar and azimuthal angles of its
+/// direction from the target to the entry point. The entry point is the
+/// outermost intersection of that ray with the skull surface.
+/// The cost of a trajectory is a weighted sum of:
+///  - clearance: mean of exp(-d/SafetyMargin) along the trajectory, d being
+///    the distance to the critical structures read in the clearance map
+///  - coverage: 1 - |cos| of the angle between the trajectory and the main
+///    axis of the tumor (the ablation zone is elongated along the fiber)
+///  - length: trajectory length divided by MaximumLength
+///  - skull angle: 1 - |cos| of the angle between the trajectory and the
+///    skull normal at the entry point
+///  - tracts: mean tract density along the trajectory (optional)
+///
+/// Optimize() runs two stages: a coarse search evaluating, in parallel,
+/// NumberOfSamples directions evenly spread on the sphere, then a
+/// Nelder-Mead refinement of the best NumberOfRefinedCandidates directions.
+/// The wall time of each stage and the convergence are reported.
+/// Each thread of the coarse search intersects the skull with its own
+/// locator: the threads share no mutable state.
+class Q_SLICER_QTMODULES_LITTPLANV2_EXPORT vtkLITTPlanV2TrajectoryOptimizer
+  : public vtkObject
+{
+public:
+  static vtkLITTPlanV2TrajectoryOptimizer* New();
+  vtkTypeMacro(vtkLITTPlanV2TrajectoryOptimizer, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  /// Target of the trajectory in RAS
+  vtkSetVector3Macro(Target, double);
+  vtkGetVector3Macro(Target, double);
+
+  /// Main axis of the tumor in RAS. A null axis disables the coverage term.
+  vtkSetVector3Macro(TumorAxis, double);
+  vtkGetVector3Macro(TumorAxis, double);
+
+  /// Set the target to the centroid of the tumor surface (RAS) and the
+  /// tumor axis to its principal axis.
+  void SetTumor(vtkPolyData* tumor);
+
+  /// Skull surface in RAS. Required.
+  void SetSkull(vtkPolyData* skull);
+  vtkGetObjectMacro(Skull, vtkPolyData);
+
+  /// Distance map (in mm) to the critical structures, and the matrix
+  /// mapping RAS to the IJK coordinates of the map. Optional.
+  void SetClearanceMap(vtkImageData* distanceMap, vtkMatrix4x4* rasToIJK);
+  vtkGetObjectMacro(ClearanceMap, vtkImageData);
+
+  /// Tract density grid. Optional. It must be up to date (see
+  /// vtkLITTPlanV2TractDensityGrid::Update()) before optimizing.
+  void SetTractDensityGrid(vtkLITTPlanV2TractDensityGrid* grid);
+  vtkGetObjectMacro(TractDensityGrid, vtkLITTPlanV2TractDensityGrid);
+
+  /// Distance (mm) to the critical structures under which the clearance
+  /// cost increases quickly. Default is 5mm.
+  vtkSetMacro(SafetyMargin, double);
+  vtkGetMacro(SafetyMargin, double);
+
+  /// Trajectories longer than MaximumLength mm are discarded.
+  /// Default is 150mm.
+  vtkSetMacro(MaximumLength, double);
+  vtkGetMacro(MaximumLength, double);
+
+  /// Distance (mm) between the samples along the trajectory. Default is 1mm.
+  vtkSetMacro(SamplingStep, double);
+  vtkGetMacro(SamplingStep, double);
+
+  /// Weights of the cost terms. Defaults are 1 for clearance and tracts,
+  /// 0.5 for coverage and 0.2 for length and skull angle.
+  vtkSetMacro(ClearanceWeight, double);
+  vtkGetMacro(ClearanceWeight, double);
+  vtkSetMacro(CoverageWeight, double);
+  vtkGetMacro(CoverageWeight, double);
+  vtkSetMacro(LengthWeight, double);
+  vtkGetMacro(LengthWeight, double);
+  vtkSetMacro(SkullAngleWeight, double);
+  vtkGetMacro(SkullAngleWeight, double);
+  vtkSetMacro(TractWeight, double);
+  vtkGetMacro(TractWeight, double);
+
+  /// Number of directions evaluated by the coarse search. Default is 2000.
+  vtkSetClampMacro(NumberOfSamples, int, 1, VTK_INT_MAX);
+  vtkGetMacro(NumberOfSamples, int);
+
+  /// Number of the best coarse directions refined. Default is 3.
+  vtkSetClampMacro(NumberOfRefinedCandidates, int, 1, VTK_INT_MAX);
+  vtkGetMacro(NumberOfRefinedCandidates, int);
+
+  /// The refinement stops when the simplex is smaller than
+  /// AngularTolerance (radians) or after MaximumNumberOfIterations.
+  /// Defaults are 1e-5 rad (1 micron at 100mm) and 200 iterations.
+  vtkSetMacro(AngularTolerance, double);
+  vtkGetMacro(AngularTolerance, double);
+  vtkSetMacro(MaximumNumberOfIterations, int);
+  vtkGetMacro(MaximumNumberOfIterations, int);
+
+  /// Number of threads of the coarse search. Default is the number of cores.
+  vtkSetClampMacro(NumberOfThreads, int, 1, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+
+  /// Run the coarse search and the refinement.
+  /// Returns false if no trajectory reaches the skull.
+  bool Optimize();
+
+  /// Cost of the trajectory in the direction (unit vector from the target
+  /// to the entry). Fill entry if not null. Returns VTK_DOUBLE_MAX if the
+  /// direction doesn't reach the skull within MaximumLength.
+  double EvaluateCost(const double direction[3], double entry[3] = 0);
+
+  /// Results of the last Optimize()
+  vtkGetVector3Macro(Entry, double);
+  vtkGetVector3Macro(Direction, double);
+  vtkGetMacro(Cost, double);
+  /// True if the refinement of the best candidate converged within
+  /// MaximumNumberOfIterations.
+  vtkGetMacro(Converged, bool);
+  vtkGetMacro(NumberOfIterations, int);
+  vtkGetMacro(NumberOfEvaluations, int);
+  /// Wall time in seconds of the coarse search and the refinement.
+  vtkGetMacro(CoarseSearchTime, double);
+  vtkGetMacro(RefinementTime, double);
+
+  /// Pose of the last optimized trajectory: the translation is the target,
+  /// the third column the direction from the target to the entry.
+  void GetTrajectoryMatrix(vtkMatrix4x4* matrix);
+
+protected:
+  vtkLITTPlanV2TrajectoryOptimizer();
+  ~vtkLITTPlanV2TrajectoryOptimizer();
+
+  /// Build the skull locators if the skull changed, one per thread
+  void UpdateSkullLocators(int numberOfLocators);
+  /// Cost of the direction, the skull is intersected with the locator of
+  /// the thread.
+  double ComputeCost(const double direction[3], double entry[3], int thread);
+  double EvaluateAngles(double theta, double phi, int thread = 0);
+  double Refine(double angles[2], int& iterations, bool& converged);
+  bool FindEntry(const double direction[3], double entry[3], double normal[3],
+                 vtkOBBTree* locator);
+  double ClearanceAt(const double ras[3])const;
+
+  static VTK_THREAD_RETURN_TYPE CoarseSearchThread(void* arg);
+
+  double Target[3];
+  double TumorAxis[3];
+  vtkPolyData* Skull;
+  vtkImageData* ClearanceMap;
+  vtkLITTPlanV2TractDensityGrid* TractDensityGrid;
+  vtkSmartPointer<vtkMatrix4x4> RASToClearanceIJK;
+  std::vector<vtkSmartPointer<vtkOBBTree> > SkullLocators;
+  vtkTimeStamp SkullLocatorsBuildTime;
+
+  double SafetyMargin;
+  double MaximumLength;
+  double SamplingStep;
+  double ClearanceWeight;
+  double CoverageWeight;
+  double LengthWeight;
+  double SkullAngleWeight;
+  double TractWeight;
+  int NumberOfSamples;
+  int NumberOfRefinedCandidates;
+  double AngularTolerance;
+  int MaximumNumberOfIterations;
+  int NumberOfThreads;
+
+  double Entry[3];
+  double Direction[3];
+  double Cost;
+  bool Converged;
+  int NumberOfIterations;
+  int NumberOfEvaluations;
+  double CoarseSearchTime;
+  double RefinementTime;
+
+private:
+  vtkLITTPlanV2TrajectoryOptimizer(const vtkLITTPlanV2TrajectoryOptimizer&); // Not implemented
+  void operator=(const vtkLITTPlanV2TrajectoryOptimizer&); // Not implemented
+};
+
+#endif